@@ -34,6 +34,7 @@
 #include <pulsecore/aupdate.h>
 
 #include "algorithm-hook.h"
+#include "trace.h"
 
 #define ALGORITHM_API_IDENTIFIER "meego-algorithm-hook-1"
 
@@ -282,6 +283,8 @@ pa_hook_result_t meego_algorithm_hook_fire(meego_algorithm_hook *hook, void *dat
     pa_assert_fp(hook->aupdate);
     pa_assert_fp(!hook->dead);
 
+    meego_trace_begin(hook->name);
+
     j = pa_aupdate_read_begin(hook->aupdate);
 
     /* Go through algorithm hook slots in priority order and fire hook slot
@@ -297,6 +300,8 @@ pa_hook_result_t meego_algorithm_hook_fire(meego_algorithm_hook *hook, void *dat
 
     pa_aupdate_read_end(hook->aupdate);
 
+    meego_trace_end(hook->name);
+
     return result;
 }
 
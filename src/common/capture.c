@@ -0,0 +1,512 @@
+/***
+  This file is part of PulseAudio.
+
+  Copyright (C) 2013 Jolla Ltd.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <pulse/xmalloc.h>
+#include <pulse/sample.h>
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/core-error.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/refcnt.h>
+#include <pulsecore/shared.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/memblock.h>
+
+#include "capture.h"
+
+#define CAPTURE_SHARED_NAME "meego-capture-1"
+#define CAPTURE_RING_SECONDS (2)
+#define CAPTURE_WRITER_INTERVAL_MS (20)
+#define WAV_HEADER_SIZE (44)
+
+typedef struct capture_file capture_file;
+
+/* One capture of a tap. Created by main thread, owned by writer thread once
+ * handed over, the writer opens, writes, closes and frees it. */
+struct capture_file {
+    char *name;
+    char *path;
+    pa_sample_spec ss;
+
+    /* Set by main thread when IO thread doesn't write to the ring anymore. */
+    pa_atomic_t stopped;
+    /* Set by writer thread when the file can't be written, IO thread stops
+     * filling the ring. */
+    pa_atomic_t failed;
+
+    /* Single producer (IO thread), single consumer (writer thread) ring,
+     * indexes are byte counters. */
+    uint8_t *ring;
+    unsigned ring_size;
+    pa_atomic_t write_index;
+    pa_atomic_t read_index;
+    pa_atomic_t overflows;
+
+    FILE *file;
+    uint32_t data_bytes;
+
+    PA_LLIST_FIELDS(capture_file);
+};
+
+struct meego_capture_tap {
+    meego_capture *capture;
+    char *name;
+    pa_sample_spec ss;
+
+    /* Current capture, NULL while not capturing. busy is held by IO thread
+     * while writing to the ring of the capture. */
+    pa_atomic_ptr_t file;
+    pa_atomic_t busy;
+
+    PA_LLIST_FIELDS(meego_capture_tap);
+};
+
+struct meego_capture {
+    PA_REFCNT_DECLARE;
+
+    pa_core *core;
+
+    /* Taps are only accessed from main thread. */
+    PA_LLIST_HEAD(meego_capture_tap, taps);
+
+    char *directory;    /* Non-NULL while capture is running. */
+    char *filter;
+
+    /* New captures are handed to the writer thread through incoming, mutex
+     * protects only that list. files is private to the writer thread. */
+    pa_mutex *mutex;
+    PA_LLIST_HEAD(capture_file, incoming);
+    PA_LLIST_HEAD(capture_file, files);
+
+    pa_thread *writer;
+    pa_atomic_t writer_quit;
+};
+
+static meego_capture *capture_new(pa_core *c) {
+    meego_capture *cap;
+
+    pa_assert(c);
+
+    cap = pa_xnew0(meego_capture, 1);
+    PA_REFCNT_INIT(cap);
+    cap->core = c;
+    cap->mutex = pa_mutex_new(false, false);
+    PA_LLIST_HEAD_INIT(meego_capture_tap, cap->taps);
+    PA_LLIST_HEAD_INIT(capture_file, cap->incoming);
+    PA_LLIST_HEAD_INIT(capture_file, cap->files);
+
+    pa_assert_se(pa_shared_set(c, CAPTURE_SHARED_NAME, cap) >= 0);
+
+    return cap;
+}
+
+meego_capture *meego_capture_get(pa_core *core) {
+    meego_capture *c;
+
+    if ((c = pa_shared_get(core, CAPTURE_SHARED_NAME)))
+        return meego_capture_ref(c);
+
+    return capture_new(core);
+}
+
+meego_capture *meego_capture_ref(meego_capture *c) {
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    PA_REFCNT_INC(c);
+
+    return c;
+}
+
+void meego_capture_unref(meego_capture *c) {
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    if (PA_REFCNT_DEC(c) > 0)
+        return;
+
+    /* Every tap holds a reference, so all taps are gone by now. */
+    pa_assert(!c->taps);
+
+    meego_capture_stop(c);
+
+    /* Writer closes the remaining files before exiting. */
+    if (c->writer) {
+        pa_atomic_store(&c->writer_quit, 1);
+        pa_thread_free(c->writer);
+        c->writer = NULL;
+    }
+
+    pa_assert(!c->incoming);
+    pa_assert(!c->files);
+
+    pa_assert_se(pa_shared_remove(c->core, CAPTURE_SHARED_NAME) >= 0);
+
+    pa_mutex_free(c->mutex);
+    pa_xfree(c);
+}
+
+static void write_le32(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+static void write_le16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static void wav_header(uint8_t *h, const pa_sample_spec *ss, uint32_t data_bytes) {
+    memcpy(h, "RIFF", 4);
+    write_le32(h + 4, WAV_HEADER_SIZE - 8 + data_bytes);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    write_le32(h + 16, 16);
+    write_le16(h + 20, 1);      /* PCM */
+    write_le16(h + 22, ss->channels);
+    write_le32(h + 24, ss->rate);
+    write_le32(h + 28, (uint32_t) pa_bytes_per_second(ss));
+    write_le16(h + 32, (uint16_t) pa_frame_size(ss));
+    write_le16(h + 34, 16);
+    memcpy(h + 36, "data", 4);
+    write_le32(h + 40, data_bytes);
+}
+
+/* Called from writer thread. Logs the error once and stops the capture,
+ * data written so far stays in the file without a valid header. */
+static void file_fail(capture_file *f, const char *what) {
+    pa_log("Failed to %s capture file %s: %s", what, f->path, pa_cstrerror(errno));
+
+    pa_atomic_store(&f->failed, 1);
+
+    if (f->file) {
+        fclose(f->file);
+        f->file = NULL;
+    }
+}
+
+/* Called from writer thread. */
+static void file_open(capture_file *f) {
+    uint8_t header[WAV_HEADER_SIZE];
+
+    if (!(f->file = pa_fopen_cloexec(f->path, "w"))) {
+        file_fail(f, "open");
+        return;
+    }
+
+    wav_header(header, &f->ss, 0);
+    if (fwrite(header, 1, sizeof(header), f->file) != sizeof(header)) {
+        file_fail(f, "write");
+        return;
+    }
+
+    pa_log_info("Capturing tap %s to %s", f->name, f->path);
+}
+
+/* Called from writer thread. */
+static void file_drain(capture_file *f) {
+    unsigned r, w, offset, n;
+
+    r = (unsigned) pa_atomic_load(&f->read_index);
+    w = (unsigned) pa_atomic_load(&f->write_index);
+
+    while (r != w) {
+        offset = r & (f->ring_size - 1);
+        n = PA_MIN(w - r, f->ring_size - offset);
+
+        if (fwrite(f->ring + offset, 1, n, f->file) != n) {
+            file_fail(f, "write");
+            return;
+        }
+
+        f->data_bytes += n;
+        r += n;
+    }
+
+    pa_atomic_store(&f->read_index, (int) r);
+}
+
+/* Called from writer thread, after the last drain. */
+static void file_close(capture_file *f) {
+    uint8_t header[WAV_HEADER_SIZE];
+
+    if (f->file) {
+        wav_header(header, &f->ss, f->data_bytes);
+
+        if (fseek(f->file, 0, SEEK_SET) < 0)
+            file_fail(f, "rewind");
+        else if (fwrite(header, 1, sizeof(header), f->file) != sizeof(header))
+            file_fail(f, "write");
+        else if (fclose(f->file) != 0) {
+            f->file = NULL;
+            file_fail(f, "close");
+        } else
+            f->file = NULL;
+
+        pa_log_info("Captured %u bytes from tap %s, %d chunks dropped", f->data_bytes, f->name,
+                    pa_atomic_load(&f->overflows));
+    }
+
+    pa_xfree(f->ring);
+    pa_xfree(f->path);
+    pa_xfree(f->name);
+    pa_xfree(f);
+}
+
+static void writer_iterate(meego_capture *c) {
+    capture_file *f, *next;
+    bool stopped;
+
+    pa_mutex_lock(c->mutex);
+    while ((f = c->incoming)) {
+        PA_LLIST_REMOVE(capture_file, c->incoming, f);
+        PA_LLIST_PREPEND(capture_file, c->files, f);
+    }
+    pa_mutex_unlock(c->mutex);
+
+    for (f = c->files; f; f = next) {
+        next = f->next;
+
+        /* Read before draining, so that the last drain gets everything. */
+        stopped = pa_atomic_load(&f->stopped);
+
+        if (!f->file && !pa_atomic_load(&f->failed))
+            file_open(f);
+
+        if (f->file)
+            file_drain(f);
+
+        if (stopped) {
+            PA_LLIST_REMOVE(capture_file, c->files, f);
+            file_close(f);
+        }
+    }
+}
+
+static void writer_thread_func(void *userdata) {
+    meego_capture *c = userdata;
+
+    pa_log_debug("Capture writer thread starting up");
+
+    while (!pa_atomic_load(&c->writer_quit)) {
+        writer_iterate(c);
+        pa_msleep(CAPTURE_WRITER_INTERVAL_MS);
+    }
+
+    /* All taps are stopped when quitting, close their files. */
+    writer_iterate(c);
+
+    pa_log_debug("Capture writer thread shutting down");
+}
+
+static bool tap_matches(const char *filter, const char *name) {
+    const char *state = NULL;
+    char *n;
+    bool found = false;
+
+    if (!filter)
+        return true;
+
+    while (!found && (n = pa_split(filter, ",", &state))) {
+        found = pa_streq(n, name);
+        pa_xfree(n);
+    }
+
+    return found;
+}
+
+/* Called from main thread, writer thread must be running. */
+static void tap_start(meego_capture_tap *t, const char *directory) {
+    meego_capture *c = t->capture;
+    capture_file *f;
+
+    pa_assert(c->writer);
+
+    if (t->ss.format != PA_SAMPLE_S16LE) {
+        pa_log_warn("Can't capture tap %s, only S16LE is supported", t->name);
+        return;
+    }
+
+    f = pa_xnew0(capture_file, 1);
+    f->name = pa_xstrdup(t->name);
+    f->path = pa_sprintf_malloc("%s" PA_PATH_SEP "%s.wav", directory, t->name);
+    f->ss = t->ss;
+
+    f->ring_size = 1;
+    while (f->ring_size < pa_bytes_per_second(&f->ss) * CAPTURE_RING_SECONDS)
+        f->ring_size <<= 1;
+    f->ring = pa_xmalloc(f->ring_size);
+
+    pa_mutex_lock(c->mutex);
+    PA_LLIST_PREPEND(capture_file, c->incoming, f);
+    pa_mutex_unlock(c->mutex);
+
+    pa_atomic_ptr_store(&t->file, f);
+}
+
+/* Called from main thread. The file is left to the writer thread. */
+static void tap_stop(meego_capture_tap *t) {
+    capture_file *f;
+
+    if (!(f = pa_atomic_ptr_load(&t->file)))
+        return;
+
+    pa_atomic_ptr_store(&t->file, NULL);
+
+    /* IO thread holds busy only for a single copy to the ring. */
+    while (pa_atomic_load(&t->busy))
+        pa_thread_yield();
+
+    pa_atomic_store(&f->stopped, 1);
+}
+
+int meego_capture_start(meego_capture *c, const char *directory, const char *taps) {
+    meego_capture_tap *t;
+
+    pa_assert(c);
+    pa_assert(directory);
+
+    meego_capture_stop(c);
+
+    /* Writer runs until capture is freed. */
+    if (!c->writer) {
+        pa_atomic_store(&c->writer_quit, 0);
+        if (!(c->writer = pa_thread_new("capture-writer", writer_thread_func, c))) {
+            pa_log("Failed to create capture writer thread");
+            return -1;
+        }
+    }
+
+    c->directory = pa_xstrdup(directory);
+    c->filter = pa_xstrdup(taps);
+
+    PA_LLIST_FOREACH(t, c->taps)
+        if (tap_matches(c->filter, t->name))
+            tap_start(t, c->directory);
+
+    return 0;
+}
+
+void meego_capture_stop(meego_capture *c) {
+    meego_capture_tap *t;
+
+    pa_assert(c);
+
+    if (!c->directory)
+        return;
+
+    PA_LLIST_FOREACH(t, c->taps)
+        tap_stop(t);
+
+    pa_xfree(c->directory);
+    c->directory = NULL;
+    pa_xfree(c->filter);
+    c->filter = NULL;
+}
+
+meego_capture_tap *meego_capture_tap_new(meego_capture *c, const char *name, const pa_sample_spec *ss) {
+    meego_capture_tap *t;
+
+    pa_assert(c);
+    pa_assert(name);
+    pa_assert(ss);
+    pa_assert(pa_sample_spec_valid(ss));
+
+    t = pa_xnew0(meego_capture_tap, 1);
+    t->capture = meego_capture_ref(c);
+    t->name = pa_xstrdup(name);
+    t->ss = *ss;
+
+    if (c->directory && tap_matches(c->filter, t->name))
+        tap_start(t, c->directory);
+    PA_LLIST_PREPEND(meego_capture_tap, c->taps, t);
+
+    return t;
+}
+
+void meego_capture_tap_free(meego_capture_tap *t) {
+    meego_capture *c;
+
+    pa_assert(t);
+
+    c = t->capture;
+
+    tap_stop(t);
+    PA_LLIST_REMOVE(meego_capture_tap, c->taps, t);
+
+    pa_xfree(t->name);
+    pa_xfree(t);
+
+    meego_capture_unref(c);
+}
+
+void meego_capture_tap_write(meego_capture_tap *t, const pa_memchunk *chunk) {
+    capture_file *f;
+    unsigned r, w, offset, n;
+    const uint8_t *p;
+
+    pa_assert(t);
+    pa_assert(chunk);
+
+    if (PA_LIKELY(!pa_atomic_ptr_load(&t->file)))
+        return;
+
+    pa_atomic_inc(&t->busy);
+
+    /* Load again, capture may have been stopped after the first check. */
+    if (!(f = pa_atomic_ptr_load(&t->file)) || pa_atomic_load(&f->failed))
+        goto finish;
+
+    r = (unsigned) pa_atomic_load(&f->read_index);
+    w = (unsigned) pa_atomic_load(&f->write_index);
+
+    if (chunk->length > f->ring_size - (w - r)) {
+        pa_atomic_inc(&f->overflows);
+        goto finish;
+    }
+
+    p = (const uint8_t *) pa_memblock_acquire(chunk->memblock) + chunk->index;
+
+    offset = w & (f->ring_size - 1);
+    n = PA_MIN((unsigned) chunk->length, f->ring_size - offset);
+    memcpy(f->ring + offset, p, n);
+    memcpy(f->ring, p + n, chunk->length - n);
+
+    pa_memblock_release(chunk->memblock);
+
+    pa_atomic_store(&f->write_index, (int) (w + chunk->length));
+
+finish:
+    pa_atomic_dec(&t->busy);
+}
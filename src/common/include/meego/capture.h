@@ -0,0 +1,59 @@
+#ifndef foocapturehfoo
+#define foocapturehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  Copyright (C) 2013 Jolla Ltd.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+/* Audio capture taps for debugging. Modules create named taps at points
+ * of their processing pipelines and write every chunk passing the point
+ * to the tap from IO thread. While capture is stopped writing is a no-op.
+ * When capture is started, chunks are copied to a lock-free ring per tap,
+ * and a writer thread writes them to <directory>/<tap name>.wav, so IO
+ * thread timing doesn't change.
+ *
+ * Only S16LE taps can be captured. */
+
+#include <pulsecore/core.h>
+#include <pulsecore/memchunk.h>
+#include <pulse/sample.h>
+
+typedef struct meego_capture meego_capture;
+typedef struct meego_capture_tap meego_capture_tap;
+
+meego_capture *meego_capture_get(pa_core *core);
+meego_capture *meego_capture_ref(meego_capture *c);
+void meego_capture_unref(meego_capture *c);
+
+/* Called from main thread. Tap holds a reference to capture. */
+meego_capture_tap *meego_capture_tap_new(meego_capture *c, const char *name, const pa_sample_spec *ss);
+void meego_capture_tap_free(meego_capture_tap *t);
+
+/* Start capturing taps listed in comma separated taps, or all taps if
+ * taps is NULL. Taps created while capture is running are started too,
+ * if they match. Starting a running capture restarts it. */
+int meego_capture_start(meego_capture *c, const char *directory, const char *taps);
+void meego_capture_stop(meego_capture *c);
+
+/* Called from IO thread. Chunks that don't fit to the ring are dropped
+ * and counted. */
+void meego_capture_tap_write(meego_capture_tap *t, const pa_memchunk *chunk);
+
+#endif
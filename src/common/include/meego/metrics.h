@@ -0,0 +1,99 @@
+#ifndef foometricshfoo
+#define foometricshfoo
+
+/***
+  This file is part of PulseAudio.
+
+  Copyright (C) 2013 Jolla Ltd.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+/* Shared registry of audio path health counters and histograms.
+ * Counters and histograms are registered by name from main thread, and
+ * can be updated from any thread without locks. Registering an existing
+ * name returns the existing metric, so values survive module reloads for
+ * as long as the registry exists.
+ *
+ * Snapshot of all metrics can be written periodically to a stats file,
+ * one metric per line:
+ *   counter <name> <value>
+ *   histogram <name> <count> <max> <bucket 0> ... <bucket N-1>
+ * Histogram bucket 0 counts value 0, bucket i values from 2^(i-1) to
+ * 2^i - 1, and the last bucket everything above. */
+
+#include <pulsecore/core.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/strbuf.h>
+
+#define MEEGO_METRICS_HISTOGRAM_BUCKETS (16)
+
+typedef struct meego_metrics meego_metrics;
+
+typedef struct meego_metrics_counter {
+    pa_atomic_t value;
+} meego_metrics_counter;
+
+typedef struct meego_metrics_histogram {
+    pa_atomic_t count;
+    pa_atomic_t max;
+    pa_atomic_t buckets[MEEGO_METRICS_HISTOGRAM_BUCKETS];
+} meego_metrics_histogram;
+
+meego_metrics *meego_metrics_get(pa_core *core);
+meego_metrics *meego_metrics_ref(meego_metrics *m);
+void meego_metrics_unref(meego_metrics *m);
+
+/* Returned metrics are valid for as long as the caller holds a reference
+ * to the registry. */
+meego_metrics_counter *meego_metrics_counter_get(meego_metrics *m, const char *name);
+meego_metrics_histogram *meego_metrics_histogram_get(meego_metrics *m, const char *name);
+
+/* Append snapshot of all metrics to buf, format as described above. */
+void meego_metrics_snapshot(meego_metrics *m, pa_strbuf *buf);
+
+/* Write snapshot to path every interval and when the registry is freed.
+ * NULL path stops writing. */
+void meego_metrics_export_file(meego_metrics *m, const char *path, pa_usec_t interval);
+
+/* Safe to call from any thread. */
+static inline void meego_metrics_counter_inc(meego_metrics_counter *c) {
+    pa_atomic_inc(&c->value);
+}
+
+static inline void meego_metrics_counter_add(meego_metrics_counter *c, int value) {
+    pa_atomic_add(&c->value, value);
+}
+
+static inline void meego_metrics_histogram_record(meego_metrics_histogram *h, unsigned value) {
+    unsigned bucket = 0;
+    unsigned v = value;
+    int max;
+
+    while (v && bucket < MEEGO_METRICS_HISTOGRAM_BUCKETS - 1) {
+        v >>= 1;
+        bucket++;
+    }
+
+    pa_atomic_inc(&h->buckets[bucket]);
+    pa_atomic_inc(&h->count);
+
+    do {
+        max = pa_atomic_load(&h->max);
+    } while ((unsigned) max < value && !pa_atomic_cmpxchg(&h->max, max, (int) value));
+}
+
+#endif
@@ -29,6 +29,7 @@ typedef struct meego_parameter_connection_args {
     pa_hook_cb_t cb;
     pa_hook_priority_t prio;
     bool full_updates;
+    bool delta_updates;
     void *userdata;
 } meego_parameter_connection_args;
 
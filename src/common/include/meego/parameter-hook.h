@@ -26,9 +26,18 @@ typedef enum meego_parameter_status {
     MEEGO_PARAM_ENABLE,
     MEEGO_PARAM_DISABLE,
     MEEGO_PARAM_UPDATE,
-    MEEGO_PARAM_MODE_CHANGE
+    MEEGO_PARAM_MODE_CHANGE,
+    MEEGO_PARAM_DELTA
 } meego_parameter_status_t;
 
+/*
+ * Byte range of parameters that changed, see MEEGO_PARAM_DELTA below.
+ */
+typedef struct meego_parameter_delta {
+    unsigned offset;
+    unsigned length;
+} meego_parameter_delta;
+
 /*
  * Parameter updates are received in pa_hook_cb_t.
  * hook_data is pointer to pa_core.
@@ -60,6 +69,18 @@ typedef enum meego_parameter_status {
  *      parameters and length are set to currently active parameters.
  *      This status is also always set if only mode changes
  *      are requested. In that case parameters is NULL and length 0.
+ *      Delta update requestors always get NULL parameters and length 0,
+ *      as they already hold the active parameters.
+ *
+ * status MEEGO_PARAM_DELTA:
+ *      Received only if delta updates were requested. Parameters for
+ *      mode have changed from previous values, but their length has
+ *      not. parameters and length are set to the complete updated
+ *      parameter and deltas lists the n_deltas byte ranges that differ
+ *      from the previously received parameter. If nothing changed, no
+ *      update is sent at all.
+ *
+ * deltas and n_deltas are NULL and 0 with all other statuses.
  *
  * Hook callback should always return PA_HOOK_OK.
  */
@@ -68,6 +89,8 @@ typedef struct meego_parameter_update_args {
     meego_parameter_status_t status;
     const void *parameters;
     unsigned length;
+    const meego_parameter_delta *deltas;
+    unsigned n_deltas;
 } meego_parameter_update_args;
 
 /*
@@ -78,6 +101,13 @@ typedef struct meego_parameter_update_args {
  */
 int meego_parameter_request_updates(const char *name, pa_hook_cb_t cb, pa_hook_priority_t prio, bool full_updates, void *userdata);
 
+/*
+ * Same as meego_parameter_request_updates, but parameter changes that keep the parameter length are
+ * delivered as MEEGO_PARAM_DELTA updates listing the changed byte ranges, and unchanged parameters are
+ * not delivered again. Deltas are only used while all requestors of the same name asked for them.
+ */
+int meego_parameter_request_delta_updates(const char *name, pa_hook_cb_t cb, pa_hook_priority_t prio, bool full_updates, void *userdata);
+
 /*
  * Stop calling the given callback "cb" with "userdata" for the algorithm
  * called "name". Every call to meego_parameter_request_updates must have a
@@ -0,0 +1,72 @@
+#ifndef foortloghfoo
+#define foortloghfoo
+
+/***
+  This file is part of PulseAudio.
+
+  Copyright (C) 2013 Jolla Ltd.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+/* Logging for IO thread code. Messages are formatted into a preallocated
+ * ring without locks or allocations, and written to PulseAudio log from
+ * the main thread. Every call site logs at most once per interval, the
+ * number of suppressed messages is added to the next message.
+ *
+ * Messages are only stored while at least one module has attached the log
+ * to the main loop, otherwise they are dropped. */
+
+#include <pulsecore/core.h>
+#include <pulsecore/log.h>
+#include <pulsecore/atomic.h>
+#include <pulse/gccmacro.h>
+
+/* Minimum time between messages from one call site. */
+#define MEEGO_RT_LOG_INTERVAL_MS (1000)
+
+/* Per call site state, see meego_rt_log(). A call site may be reached from
+ * several IO threads, for example in a shared library function. */
+typedef struct meego_rt_log_site {
+    pa_atomic_t next;           /* Monotonic time in ms, 0 before first message */
+    pa_atomic_t suppressed;
+} meego_rt_log_site;
+
+/* Called from main thread. Attach and detach calls are counted. */
+void meego_rt_log_attach(pa_core *core);
+void meego_rt_log_detach(void);
+
+/* Safe to call from any thread. Use the macros below instead. */
+void meego_rt_log_write(meego_rt_log_site *site,
+                        pa_log_level_t level,
+                        const char *file,
+                        int line,
+                        const char *func,
+                        const char *format, ...) PA_GCC_PRINTF_ATTR(6,7);
+
+#define meego_rt_log(level, ...)                                            \
+    do {                                                                    \
+        static meego_rt_log_site _rt_log_site;                              \
+        meego_rt_log_write(&_rt_log_site, level, __FILE__, __LINE__,        \
+                           __func__, __VA_ARGS__);                          \
+    } while (0)
+
+#define meego_rt_log_debug(...)     meego_rt_log(PA_LOG_DEBUG, __VA_ARGS__)
+#define meego_rt_log_info(...)      meego_rt_log(PA_LOG_INFO, __VA_ARGS__)
+#define meego_rt_log_warn(...)      meego_rt_log(PA_LOG_WARN, __VA_ARGS__)
+#define meego_rt_log_error(...)     meego_rt_log(PA_LOG_ERROR, __VA_ARGS__)
+
+#endif
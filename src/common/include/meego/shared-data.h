@@ -26,6 +26,9 @@
 #include <pulsecore/hook-list.h>
 
 typedef struct pa_shared_data pa_shared_data;
+typedef struct pa_shared_data_key pa_shared_data_key_t;
+
+#define PA_SHARED_DATA_MAX_EXPORTS (32)
 
 pa_shared_data *pa_shared_data_get(pa_core *core);
 pa_shared_data *pa_shared_data_ref(pa_shared_data *t);
@@ -67,6 +70,35 @@ int pa_shared_data_setd(pa_shared_data *t, const char *key, const void *data, si
  * Return 0 on success, -1 on failure or if item with key doesn't exist. */
 int pa_shared_data_getd(pa_shared_data *t, const char *key, const void **data, size_t *nbytes);
 
+/* Key handles. Get handle for key once, for example at module init, and use the _key
+ * variants of the functions above to access the item without looking up the key again.
+ * Handle is valid for as long as the caller holds a reference to shared data.
+ * Returns NULL if key is invalid. */
+pa_shared_data_key_t *pa_shared_data_key(pa_shared_data *t, const char *key);
+/* Key name of handle. Same pointer is passed as call data to changed hook callbacks
+ * and returned in pa_shared_data_changed_keys(), so it can be compared directly. */
+const char *pa_shared_data_key_name(pa_shared_data_key_t *k);
+int pa_shared_data_set_boolean_key(pa_shared_data *t, pa_shared_data_key_t *k, bool value);
+bool pa_shared_data_get_boolean_key(pa_shared_data *t, pa_shared_data_key_t *k);
+int pa_shared_data_set_integer_key(pa_shared_data *t, pa_shared_data_key_t *k, int32_t value);
+int pa_shared_data_get_integer_key(pa_shared_data *t, pa_shared_data_key_t *k, int32_t *return_value);
+int pa_shared_data_inc_integer_key(pa_shared_data *t, pa_shared_data_key_t *k, int32_t change);
+int pa_shared_data_sets_key(pa_shared_data *t, pa_shared_data_key_t *k, const char *value);
+const char *pa_shared_data_gets_key(pa_shared_data *t, pa_shared_data_key_t *k);
+pa_hook_slot *pa_shared_data_connect_key(pa_shared_data *t, pa_shared_data_key_t *k, pa_hook_cb_t callback, void *userdata);
+
+/* Begin transaction. Values set until the matching pa_shared_data_commit() are stored
+ * immediately, but changed hooks are not fired and exported values are not republished
+ * until commit. Transactions can be nested, changes are committed by the outermost commit. */
+void pa_shared_data_begin(pa_shared_data *t);
+/* Commit transaction. Exported values changed in the transaction are republished at once
+ * and changed hook of every changed item is fired once, after all values are in place. */
+void pa_shared_data_commit(pa_shared_data *t);
+/* NULL terminated array of keys changed in the transaction being committed. Can be used
+ * from changed hook callbacks to handle related changes together. Returns NULL when not
+ * called from a commit. */
+const char * const *pa_shared_data_changed_keys(pa_shared_data *t);
+
 /**
  * hook_data    - pa_shared_data *
  * call_data    - const char *
@@ -75,4 +107,18 @@ int pa_shared_data_getd(pa_shared_data *t, const char *key, const void **data, s
 pa_hook_slot *pa_shared_data_connect(pa_shared_data *t, const char *key, pa_hook_cb_t callback, void *userdata);
 void pa_shared_data_hook_slot_free(pa_hook_slot *slot);
 
+/* Export boolean or integer shared item for reading from IO threads. Exported item
+ * value is republished every time it changes from main thread and can't be changed
+ * to string or data item anymore. Exporting the same key again returns the same slot.
+ * Call from main thread only. Returns export slot on success, -1 on failure. */
+int pa_shared_data_export(pa_shared_data *t, const char *key);
+/* Read exported item values, safe to call from any thread. Reading never blocks or
+ * allocates. Value of item that hasn't been set yet is 0. */
+int32_t pa_shared_data_read_integer(pa_shared_data *t, int slot);
+bool pa_shared_data_read_boolean(pa_shared_data *t, int slot);
+/* Consistent view of all exported values indexed by export slot, when more than one
+ * value needs to be read at once. Every _read_begin() must be paired with _read_end(). */
+const int32_t *pa_shared_data_read_begin(pa_shared_data *t);
+void pa_shared_data_read_end(pa_shared_data *t);
+
 #endif
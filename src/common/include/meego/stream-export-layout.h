@@ -0,0 +1,89 @@
+#ifndef foostreamexportlayouthfoo
+#define foostreamexportlayouthfoo
+
+/***
+  This file is part of PulseAudio.
+
+  Copyright (C) 2013 Jolla Ltd.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+/* Shared memory layout of an exported stream, see stream-export.h. This
+ * header is for consumers too and doesn't depend on PulseAudio headers.
+ *
+ * A consumer maps the whole descriptor read-only, reads the position with
+ * meego_stream_export_position(), and reads the audio in place. The ring
+ * is never blocked by consumers. A consumer that falls more than data_size
+ * bytes behind loses data, which it notices by reading the position again
+ * after reading the audio. */
+
+#include <stdint.h>
+#include <errno.h>
+
+#define MEEGO_STREAM_EXPORT_MAGIC (0x4d535845) /* "MSXE" */
+#define MEEGO_STREAM_EXPORT_VERSION (2)
+
+/* Retries before meego_stream_export_position() gives up. */
+#define MEEGO_STREAM_EXPORT_POSITION_RETRIES (1000)
+
+/* Native byte order. Audio data follows at offset header_size. */
+typedef struct meego_stream_export_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t data_size;         /* Power of two */
+    uint32_t format;            /* pa_sample_format_t */
+    uint32_t rate;
+    uint32_t channels;
+
+    /* Odd while the position below is being updated. Producer updates the
+     * fields with full memory barriers (__sync_synchronize()) around them. */
+    volatile uint32_t sequence;
+    /* Total number of bytes written, the next byte goes to data offset
+     * write_index % data_size. */
+    volatile uint64_t write_index;
+    /* CLOCK_MONOTONIC time in usec when the chunk ending at write_index was
+     * processed. This is processing time, stream latency is not included. */
+    volatile uint64_t timestamp;
+} meego_stream_export_header;
+
+/* Reads a consistent write position. Returns 0 on success, or -EAGAIN if
+ * the producer stays in the middle of an update, for example because it
+ * died. */
+static inline int meego_stream_export_position(const meego_stream_export_header *h,
+                                               uint64_t *write_index, uint64_t *timestamp) {
+    uint32_t seq;
+    unsigned i;
+
+    for (i = 0; i < MEEGO_STREAM_EXPORT_POSITION_RETRIES; i++) {
+        seq = h->sequence;
+        __sync_synchronize();
+        if (seq & 1)
+            continue;
+
+        *write_index = h->write_index;
+        *timestamp = h->timestamp;
+
+        __sync_synchronize();
+        if (h->sequence == seq)
+            return 0;
+    }
+
+    return -EAGAIN;
+}
+
+#endif
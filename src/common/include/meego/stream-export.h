@@ -0,0 +1,57 @@
+#ifndef foostreamexporthfoo
+#define foostreamexporthfoo
+
+/***
+  This file is part of PulseAudio.
+
+  Copyright (C) 2013 Jolla Ltd.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+/* Export of an audio stream to a memfd backed shared memory ring. The
+ * producer writes every chunk of the stream to the ring from IO thread,
+ * consumers map a file descriptor of the ring and read the audio in place,
+ * without copies and without any calls to the producer. Memory layout is
+ * in stream-export-layout.h.
+ *
+ * On kernels that support F_SEAL_FUTURE_WRITE (Linux 5.1 and later) the
+ * memfd is sealed so that consumers can't write to the ring. On older
+ * kernels consumers must be trusted not to map it writable. */
+
+#include <pulsecore/memchunk.h>
+#include <pulse/sample.h>
+
+#include "stream-export-layout.h"
+
+typedef struct meego_stream_export meego_stream_export;
+
+/* Called from main thread. Ring holds at least ring_usec of audio.
+ * Returns NULL if memfd is not supported. */
+meego_stream_export *meego_stream_export_new(const char *name, const pa_sample_spec *ss, pa_usec_t ring_usec);
+void meego_stream_export_free(meego_stream_export *e);
+
+/* File descriptor for consumers and size of the mapping. The descriptor
+ * stays owned by the export, dup() it to keep it. */
+int meego_stream_export_fd(meego_stream_export *e);
+size_t meego_stream_export_size(meego_stream_export *e);
+
+/* Called from IO thread, single producer. timestamp is the time chunk was
+ * processed. */
+void meego_stream_export_write(meego_stream_export *e, const pa_memchunk *chunk, pa_usec_t timestamp);
+void meego_stream_export_write_data(meego_stream_export *e, const void *data, size_t length, pa_usec_t timestamp);
+
+#endif
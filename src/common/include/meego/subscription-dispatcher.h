@@ -0,0 +1,62 @@
+#ifndef foosubscriptiondispatcherhfoo
+#define foosubscriptiondispatcherhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  Copyright (C) 2013 Jolla Ltd.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+/* Shared core subscription for modules. Instead of every module getting
+ * every event of a facility through its own pa_subscription, modules
+ * connect slots for single objects (or all objects of a facility) and
+ * event types, and only matching slots are called. */
+
+#include <pulsecore/core.h>
+#include <pulsecore/core-subscribe.h>
+
+typedef struct pa_subscription_dispatcher pa_subscription_dispatcher;
+typedef struct pa_subscription_dispatcher_slot pa_subscription_dispatcher_slot;
+
+/* Event types to connect to, can be combined. */
+typedef enum pa_subscription_dispatcher_event {
+    PA_SUBSCRIPTION_DISPATCHER_NEW      = 1 << 0,
+    PA_SUBSCRIPTION_DISPATCHER_CHANGE   = 1 << 1,
+    PA_SUBSCRIPTION_DISPATCHER_REMOVE   = 1 << 2,
+    PA_SUBSCRIPTION_DISPATCHER_ALL      = 0x7
+} pa_subscription_dispatcher_event_t;
+
+pa_subscription_dispatcher *pa_subscription_dispatcher_get(pa_core *core);
+pa_subscription_dispatcher *pa_subscription_dispatcher_ref(pa_subscription_dispatcher *d);
+void pa_subscription_dispatcher_unref(pa_subscription_dispatcher *d);
+
+/* Call cb for events of facility (PA_SUBSCRIPTION_EVENT_SINK etc.) with
+ * event type in events, for object with index idx. If idx is
+ * PA_INVALID_INDEX cb is called for all objects of the facility.
+ * Callback arguments are the same as with pa_subscription_new(). */
+pa_subscription_dispatcher_slot *pa_subscription_dispatcher_connect(pa_subscription_dispatcher *d,
+                                                                    pa_subscription_event_type_t facility,
+                                                                    uint32_t idx,
+                                                                    pa_subscription_dispatcher_event_t events,
+                                                                    pa_subscription_cb_t cb,
+                                                                    void *userdata);
+
+/* Safe to call from any slot callback. */
+void pa_subscription_dispatcher_slot_free(pa_subscription_dispatcher_slot *s);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef footracehfoo
+#define footracehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  Copyright (C) 2013 Jolla Ltd.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+/* Timeline trace of IO thread work. Events are written with timestamp and
+ * thread id to a fixed size ring that always holds the latest events, so
+ * the ring can be dumped after a glitch. Dump is in Chrome trace event
+ * JSON format, which chrome://tracing and Perfetto UI can open.
+ *
+ * Tracing is off by default, and disabled trace points only cost one
+ * atomic load. Event names are copied, longer names are truncated. */
+
+#include <pulsecore/atomic.h>
+
+typedef enum meego_trace_type {
+    MEEGO_TRACE_BEGIN,
+    MEEGO_TRACE_END,
+    MEEGO_TRACE_COUNTER
+} meego_trace_type_t;
+
+extern pa_atomic_t meego_trace_active;
+
+/* Called from main thread. */
+void meego_trace_set_enabled(bool enabled);
+int meego_trace_dump(const char *path);
+
+/* Safe to call from any thread, use the inline functions below. */
+void meego_trace_record(meego_trace_type_t type, const char *name, int value);
+
+static inline void meego_trace_begin(const char *name) {
+    if (pa_atomic_load(&meego_trace_active))
+        meego_trace_record(MEEGO_TRACE_BEGIN, name, 0);
+}
+
+static inline void meego_trace_end(const char *name) {
+    if (pa_atomic_load(&meego_trace_active))
+        meego_trace_record(MEEGO_TRACE_END, name, 0);
+}
+
+static inline void meego_trace_counter(const char *name, int value) {
+    if (pa_atomic_load(&meego_trace_active))
+        meego_trace_record(MEEGO_TRACE_COUNTER, name, value);
+}
+
+#endif
@@ -36,6 +36,7 @@
 
 typedef struct pa_volume_proxy pa_volume_proxy;
 typedef struct pa_volume_proxy_entry pa_volume_proxy_entry;
+typedef struct pa_volume_proxy_key pa_volume_proxy_key_t;
 
 struct pa_volume_proxy_entry {
     const char *name;
@@ -67,6 +68,19 @@ void pa_volume_proxy_set_volume(pa_volume_proxy *r,
  * to valid pa_cvolume struct. */
 bool pa_volume_proxy_get_volume(pa_volume_proxy *r, const char *name, pa_cvolume *return_volume);
 
+/* Key handles. Get handle for stream name once and use the _key variants
+ * to set and get volume without looking up the name again. Handle is valid
+ * for as long as the caller holds a reference to volume proxy. Getting a
+ * handle doesn't create volume entry, get returns false until volume is set. */
+pa_volume_proxy_key_t *pa_volume_proxy_key(pa_volume_proxy *r, const char *name);
+void pa_volume_proxy_set_volume_key(pa_volume_proxy *r,
+                                    pa_volume_proxy_key_t *k,
+                                    const pa_cvolume *volume,
+                                    bool allow_update);
+bool pa_volume_proxy_get_volume_key(pa_volume_proxy *r, pa_volume_proxy_key_t *k, pa_cvolume *return_volume);
+/* Return true if hook call data entry is the entry of key handle. */
+bool pa_volume_proxy_key_matches(pa_volume_proxy_key_t *k, const pa_volume_proxy_entry *entry);
+
 pa_hook *pa_volume_proxy_hooks(pa_volume_proxy *r);
 
 #endif
@@ -0,0 +1,248 @@
+/***
+  This file is part of PulseAudio.
+
+  Copyright (C) 2013 Jolla Ltd.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/core-error.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/refcnt.h>
+#include <pulsecore/shared.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/strbuf.h>
+
+#include "metrics.h"
+
+#define METRICS_SHARED_NAME "meego-metrics-1"
+
+enum metric_type {
+    METRIC_COUNTER,
+    METRIC_HISTOGRAM
+};
+
+struct metric {
+    char *name;
+    enum metric_type type;
+    union {
+        meego_metrics_counter counter;
+        meego_metrics_histogram histogram;
+    } data;
+};
+
+struct meego_metrics {
+    PA_REFCNT_DECLARE;
+
+    pa_core *core;
+    pa_hashmap *metrics;    /* name -> struct metric, in registration order */
+
+    char *export_path;
+    pa_usec_t export_interval;
+    pa_time_event *export_event;
+};
+
+static void metric_free(struct metric *e) {
+    pa_assert(e);
+
+    pa_xfree(e->name);
+    pa_xfree(e);
+}
+
+static meego_metrics *metrics_new(pa_core *c) {
+    meego_metrics *m;
+
+    pa_assert(c);
+
+    m = pa_xnew0(meego_metrics, 1);
+    PA_REFCNT_INIT(m);
+    m->core = c;
+    m->metrics = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                     pa_idxset_string_compare_func,
+                                     NULL,
+                                     (pa_free_cb_t) metric_free);
+
+    pa_assert_se(pa_shared_set(c, METRICS_SHARED_NAME, m) >= 0);
+
+    return m;
+}
+
+meego_metrics *meego_metrics_get(pa_core *core) {
+    meego_metrics *m;
+
+    if ((m = pa_shared_get(core, METRICS_SHARED_NAME)))
+        return meego_metrics_ref(m);
+
+    return metrics_new(core);
+}
+
+meego_metrics *meego_metrics_ref(meego_metrics *m) {
+    pa_assert(m);
+    pa_assert(PA_REFCNT_VALUE(m) >= 1);
+
+    PA_REFCNT_INC(m);
+
+    return m;
+}
+
+static void export_write(meego_metrics *m) {
+    pa_strbuf *buf;
+    char *data;
+    char *tmp_path;
+    FILE *f;
+    bool failed;
+
+    pa_assert(m->export_path);
+
+    buf = pa_strbuf_new();
+    meego_metrics_snapshot(m, buf);
+    data = pa_strbuf_tostring_free(buf);
+
+    /* Write to temporary file first so that readers never see partial
+     * snapshot. */
+    tmp_path = pa_sprintf_malloc("%s.tmp", m->export_path);
+
+    if (!(f = pa_fopen_cloexec(tmp_path, "w"))) {
+        pa_log_warn("Failed to open metrics file %s: %s", tmp_path, pa_cstrerror(errno));
+        goto finish;
+    }
+
+    failed = fputs(data, f) < 0;
+    failed = (fclose(f) != 0) || failed;
+
+    if (failed || rename(tmp_path, m->export_path) < 0) {
+        pa_log_warn("Failed to write metrics file %s: %s", m->export_path, pa_cstrerror(errno));
+        unlink(tmp_path);
+    }
+
+finish:
+    pa_xfree(tmp_path);
+    pa_xfree(data);
+}
+
+static void export_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
+    meego_metrics *m = userdata;
+
+    pa_assert(m);
+
+    export_write(m);
+    pa_core_rttime_restart(m->core, m->export_event, pa_rtclock_now() + m->export_interval);
+}
+
+void meego_metrics_export_file(meego_metrics *m, const char *path, pa_usec_t interval) {
+    pa_assert(m);
+    pa_assert(!path || interval > 0);
+
+    if (m->export_event) {
+        m->core->mainloop->time_free(m->export_event);
+        m->export_event = NULL;
+    }
+
+    pa_xfree(m->export_path);
+    m->export_path = NULL;
+
+    if (!path)
+        return;
+
+    m->export_path = pa_xstrdup(path);
+    m->export_interval = interval;
+    m->export_event = pa_core_rttime_new(m->core, pa_rtclock_now() + interval, export_cb, m);
+}
+
+void meego_metrics_unref(meego_metrics *m) {
+    pa_assert(m);
+    pa_assert(PA_REFCNT_VALUE(m) >= 1);
+
+    if (PA_REFCNT_DEC(m) > 0)
+        return;
+
+    if (m->export_path) {
+        export_write(m);
+        meego_metrics_export_file(m, NULL, 0);
+    }
+
+    pa_assert_se(pa_shared_remove(m->core, METRICS_SHARED_NAME) >= 0);
+
+    pa_hashmap_free(m->metrics);
+    pa_xfree(m);
+}
+
+static struct metric *metric_get(meego_metrics *m, const char *name, enum metric_type type) {
+    struct metric *e;
+
+    pa_assert(m);
+    pa_assert(name);
+
+    if ((e = pa_hashmap_get(m->metrics, name))) {
+        pa_assert(e->type == type);
+        return e;
+    }
+
+    e = pa_xnew0(struct metric, 1);
+    e->name = pa_xstrdup(name);
+    e->type = type;
+    pa_hashmap_put(m->metrics, e->name, e);
+
+    return e;
+}
+
+meego_metrics_counter *meego_metrics_counter_get(meego_metrics *m, const char *name) {
+    return &metric_get(m, name, METRIC_COUNTER)->data.counter;
+}
+
+meego_metrics_histogram *meego_metrics_histogram_get(meego_metrics *m, const char *name) {
+    return &metric_get(m, name, METRIC_HISTOGRAM)->data.histogram;
+}
+
+void meego_metrics_snapshot(meego_metrics *m, pa_strbuf *buf) {
+    struct metric *e;
+    void *state;
+    unsigned i;
+
+    pa_assert(m);
+    pa_assert(buf);
+
+    PA_HASHMAP_FOREACH(e, m->metrics, state) {
+        switch (e->type) {
+            case METRIC_COUNTER:
+                pa_strbuf_printf(buf, "counter %s %u\n", e->name,
+                                 (unsigned) pa_atomic_load(&e->data.counter.value));
+                break;
+
+            case METRIC_HISTOGRAM:
+                pa_strbuf_printf(buf, "histogram %s %u %u", e->name,
+                                 (unsigned) pa_atomic_load(&e->data.histogram.count),
+                                 (unsigned) pa_atomic_load(&e->data.histogram.max));
+                for (i = 0; i < MEEGO_METRICS_HISTOGRAM_BUCKETS; i++)
+                    pa_strbuf_printf(buf, " %u", (unsigned) pa_atomic_load(&e->data.histogram.buckets[i]));
+                pa_strbuf_puts(buf, "\n");
+                break;
+        }
+    }
+}
@@ -24,6 +24,7 @@
 
 #include "pa-optimized.h"
 #include "optimized.h"
+#include "rt-log.h"
 
 int pa_optimized_take_channel(const pa_memchunk *ichunk, pa_memchunk *ochunk, int channel) {
     pa_mempool *pool;
@@ -93,7 +94,7 @@ int pa_optimized_mix_in_with_volume(pa_memchunk *ochunk, const pa_memchunk *ichu
     short volume = INT16_MAX;
     if (vol < PA_VOLUME_NORM)
 	volume = (short) lrint(pa_sw_volume_to_linear(vol)*INT16_MAX);
-    pa_log_debug("pavolume 0x%x, volume %d (linear %f)", vol, volume, pa_sw_volume_to_linear(vol));
+    meego_rt_log_debug("pavolume 0x%x, volume %d (linear %f)", vol, volume, pa_sw_volume_to_linear(vol));
     short *output = ((short *)pa_memblock_acquire(ochunk->memblock) + ochunk->index/sizeof(short));
     const short *input = ((short *)pa_memblock_acquire(ichunk->memblock) + ichunk->index/sizeof(short));
     mix_in_with_volume(volume, input, output, ichunk->length/sizeof(short));
@@ -43,7 +43,7 @@ static pa_hook *modifier_register_requests_ptr = NULL;
 static pa_hook modifier_unregister_requests;
 static pa_hook *modifier_unregister_requests_ptr = NULL;
 
-int meego_parameter_request_updates(const char *name, pa_hook_cb_t cb, pa_hook_priority_t prio, bool full_updates, void *userdata) {
+static int request_updates(const char *name, pa_hook_cb_t cb, pa_hook_priority_t prio, bool full_updates, bool delta_updates, void *userdata) {
     meego_parameter_connection_args args;
 
     pa_assert(cb);
@@ -57,15 +57,24 @@ int meego_parameter_request_updates(const char *name, pa_hook_cb_t cb, pa_hook_p
     args.cb = cb;
     args.prio = prio;
     args.full_updates = full_updates;
+    args.delta_updates = delta_updates;
     args.userdata = userdata;
 
-    pa_log_debug("Requesting updates for %s", name ? name : "mode changes");
+    pa_log_debug("Requesting %supdates for %s", delta_updates ? "delta " : "", name ? name : "mode changes");
 
     pa_hook_fire(parameter_update_requests_ptr, &args);
 
     return 0;
 }
 
+int meego_parameter_request_updates(const char *name, pa_hook_cb_t cb, pa_hook_priority_t prio, bool full_updates, void *userdata) {
+    return request_updates(name, cb, prio, full_updates, false, userdata);
+}
+
+int meego_parameter_request_delta_updates(const char *name, pa_hook_cb_t cb, pa_hook_priority_t prio, bool full_updates, void *userdata) {
+    return request_updates(name, cb, prio, full_updates, true, userdata);
+}
+
 int meego_parameter_stop_updates(const char *name, pa_hook_cb_t cb, void *userdata) {
     meego_parameter_connection_args args;
 
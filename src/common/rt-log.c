@@ -0,0 +1,237 @@
+/***
+  This file is part of PulseAudio.
+
+  Copyright (C) 2013 Jolla Ltd.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <pulse/rtclock.h>
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/core-error.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/atomic.h>
+
+#include "rt-log.h"
+
+/* Must be a power of two. */
+#define RT_LOG_RECORDS (128)
+#define RT_LOG_TEXT_MAX (256)
+
+/* Slot is free for writer at position pos when seq == pos, and readable by
+ * reader at position pos when seq == pos + 1. */
+struct rt_log_record {
+    pa_atomic_t seq;
+    pa_log_level_t level;
+    const char *file;
+    int line;
+    const char *func;
+    char text[RT_LOG_TEXT_MAX];
+};
+
+static struct rt_log {
+    /* Written from any thread */
+    pa_atomic_t write_pos;
+    pa_atomic_t wakeup_pending;
+    pa_atomic_t dropped;
+    pa_atomic_t attached;
+
+    /* Main thread only. The pipe and the ring are set up on first attach
+     * and never torn down, writers that passed the attached check before
+     * detach may still use them. */
+    bool initialized;
+    unsigned read_pos;
+    unsigned refcnt;
+    pa_core *core;
+    pa_io_event *io_event;
+    int fds[2];
+
+    struct rt_log_record records[RT_LOG_RECORDS];
+} rt_log = {
+    .fds = { -1, -1 },
+};
+
+static void rt_log_drain(void) {
+    struct rt_log_record *r;
+    int dropped;
+
+    for (;;) {
+        r = &rt_log.records[rt_log.read_pos & (RT_LOG_RECORDS - 1)];
+
+        if ((unsigned) pa_atomic_load(&r->seq) != rt_log.read_pos + 1)
+            break;
+
+        pa_log_level_meta(r->level, r->file, r->line, r->func, "%s", r->text);
+
+        pa_atomic_store(&r->seq, (int) (rt_log.read_pos + RT_LOG_RECORDS));
+        rt_log.read_pos++;
+    }
+
+    if ((dropped = pa_atomic_load(&rt_log.dropped)) > 0) {
+        pa_atomic_sub(&rt_log.dropped, dropped);
+        pa_log_warn("%d real-time log messages dropped, log ring full.", dropped);
+    }
+}
+
+static void io_cb(pa_mainloop_api *a, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
+    char buf[16];
+
+    /* Clear before draining, so that messages written while draining
+     * wake us up again. */
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+    pa_atomic_store(&rt_log.wakeup_pending, 0);
+
+    rt_log_drain();
+}
+
+/* Called before the log is attached for the first time, no writers yet. */
+static int rt_log_init(void) {
+    unsigned i;
+
+    if (pa_pipe_cloexec(rt_log.fds) < 0) {
+        pa_log_error("Failed to create real-time log pipe: %s", pa_cstrerror(errno));
+        rt_log.fds[0] = rt_log.fds[1] = -1;
+        return -1;
+    }
+
+    pa_make_fd_nonblock(rt_log.fds[0]);
+    pa_make_fd_nonblock(rt_log.fds[1]);
+
+    for (i = 0; i < RT_LOG_RECORDS; i++)
+        pa_atomic_store(&rt_log.records[i].seq, (int) i);
+
+    rt_log.initialized = true;
+
+    return 0;
+}
+
+void meego_rt_log_attach(pa_core *core) {
+    pa_assert(core);
+
+    if (rt_log.refcnt++ > 0)
+        return;
+
+    if (!rt_log.initialized && rt_log_init() < 0)
+        return;
+
+    rt_log.core = core;
+    rt_log.io_event = core->mainloop->io_new(core->mainloop, rt_log.fds[0], PA_IO_EVENT_INPUT, io_cb, NULL);
+
+    /* Messages of writers that were in flight at the last detach. */
+    rt_log_drain();
+
+    pa_atomic_store(&rt_log.attached, 1);
+}
+
+void meego_rt_log_detach(void) {
+    pa_assert(rt_log.refcnt > 0);
+
+    if (--rt_log.refcnt > 0)
+        return;
+
+    pa_atomic_store(&rt_log.attached, 0);
+
+    if (rt_log.io_event) {
+        rt_log.core->mainloop->io_free(rt_log.io_event);
+        rt_log.io_event = NULL;
+        rt_log_drain();
+    }
+
+    rt_log.core = NULL;
+}
+
+void meego_rt_log_write(meego_rt_log_site *site,
+                        pa_log_level_t level,
+                        const char *file,
+                        int line,
+                        const char *func,
+                        const char *format, ...) {
+    struct rt_log_record *r;
+    unsigned pos, now, next;
+    int diff, suppressed;
+    size_t len = 0;
+    va_list ap;
+
+    pa_assert(site);
+    pa_assert(format);
+
+    if (!pa_atomic_load(&rt_log.attached))
+        return;
+
+    /* Times wrap around, compare differences. Only the thread that moves
+     * next forward logs. */
+    now = (unsigned) (pa_rtclock_now() / PA_USEC_PER_MSEC);
+    next = (unsigned) pa_atomic_load(&site->next);
+    if ((next != 0 && (int) (now - next) < 0) ||
+        !pa_atomic_cmpxchg(&site->next, (int) next, (int) (now + MEEGO_RT_LOG_INTERVAL_MS))) {
+        pa_atomic_inc(&site->suppressed);
+        return;
+    }
+
+    /* Reserve a slot, any number of writers. */
+    pos = (unsigned) pa_atomic_load(&rt_log.write_pos);
+    for (;;) {
+        r = &rt_log.records[pos & (RT_LOG_RECORDS - 1)];
+        diff = (int) ((unsigned) pa_atomic_load(&r->seq) - pos);
+
+        if (diff == 0) {
+            if (pa_atomic_cmpxchg(&rt_log.write_pos, (int) pos, (int) (pos + 1)))
+                break;
+        } else if (diff < 0) {
+            pa_atomic_inc(&rt_log.dropped);
+            return;
+        }
+
+        pos = (unsigned) pa_atomic_load(&rt_log.write_pos);
+    }
+
+    r->level = level;
+    r->file = file;
+    r->line = line;
+    r->func = func;
+
+    va_start(ap, format);
+    vsnprintf(r->text, sizeof(r->text), format, ap);
+    va_end(ap);
+
+    if ((suppressed = pa_atomic_load(&site->suppressed)) > 0) {
+        pa_atomic_sub(&site->suppressed, suppressed);
+        len = strlen(r->text);
+        snprintf(r->text + len, sizeof(r->text) - len, " (%d similar suppressed)", suppressed);
+    }
+
+    pa_atomic_store(&r->seq, (int) (pos + 1));
+
+    if (pa_atomic_cmpxchg(&rt_log.wakeup_pending, 0, 1)) {
+        char c = 0;
+
+        if (write(rt_log.fds[1], &c, 1) < 0 && errno != EAGAIN)
+            pa_atomic_store(&rt_log.wakeup_pending, 0);
+    }
+}
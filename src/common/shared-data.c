@@ -30,6 +30,7 @@
 #include <pulsecore/refcnt.h>
 #include <pulsecore/shared.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/aupdate.h>
 #include <pulse/utf8.h>
 #include <pulse/proplist.h>
 
@@ -44,11 +45,12 @@ enum shared_item_type {
     SHARED_ITEM_MAX
 };
 
-typedef struct shared_item {
+typedef struct pa_shared_data_key {
     char *key;
     enum shared_item_type type;
     void *value;
     size_t nbytes;
+    int slot;               /* Export slot, -1 if item is not exported. */
     pa_hook changed_hook;
 } shared_item;
 
@@ -57,6 +59,17 @@ struct pa_shared_data {
 
     pa_core *core;
     pa_hashmap *items;
+
+    /* Exported values are stored twice for aupdate, readers from IO threads
+     * always see one complete copy while main thread writes to the other. */
+    pa_aupdate *aupdate;
+    int32_t exports[2][PA_SHARED_DATA_MAX_EXPORTS];
+    unsigned n_exports;
+
+    /* Transaction nesting depth and items changed in current transaction. */
+    unsigned transaction;
+    pa_idxset *pending;
+    const char **changed_keys;
 };
 
 static void shared_item_free(shared_item *i);
@@ -70,6 +83,8 @@ static pa_shared_data* shared_data_new(pa_core *c) {
     PA_REFCNT_INIT(t);
     t->core = c;
     t->items = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, NULL, (pa_free_cb_t) shared_item_free);
+    t->aupdate = pa_aupdate_new();
+    t->pending = pa_idxset_new(NULL, NULL);
 
     pa_assert_se(pa_shared_set(c, "shared-data-0", t) >= 0);
 
@@ -109,7 +124,12 @@ void pa_shared_data_unref(pa_shared_data *t) {
     if (PA_REFCNT_DEC(t) > 0)
         return;
 
+    if (t->transaction > 0)
+        pa_log_warn("Shared data freed with open transaction");
+
+    pa_idxset_free(t->pending, NULL);
     pa_hashmap_free(t->items);
+    pa_aupdate_free(t->aupdate);
 
     pa_assert_se(pa_shared_remove(t->core, "shared-data-0") >= 0);
 
@@ -128,6 +148,7 @@ static shared_item *item_get(pa_shared_data *t, pa_hashmap *items, const char *k
 
         item = pa_xnew0(shared_item, 1);
         item->key = pa_xstrdup(key);
+        item->slot = -1;
         pa_hashmap_put(items, item->key, item);
         pa_hook_init(&item->changed_hook, t);
     }
@@ -140,6 +161,131 @@ static shared_item *item_get(pa_shared_data *t, pa_hashmap *items, const char *k
     pa_assert(key);     \
     pa_assert_se((item = item_get(t, t->items, key)));
 
+/* Called from main thread. Write values of exported items to both copies of
+ * exported values, so that readers see all of the changes at once. */
+static void exports_publish(pa_shared_data *t, shared_item **items, unsigned n) {
+    unsigned i, j, k;
+
+    pa_assert(t);
+    pa_assert(items);
+
+    for (i = 0; i < n; i++)
+        if (items[i]->slot >= 0)
+            break;
+
+    if (i == n)
+        return;
+
+    j = pa_aupdate_write_begin(t->aupdate);
+
+    for (k = 0; k < 2; k++) {
+        for (i = 0; i < n; i++) {
+            if (items[i]->slot < 0)
+                continue;
+
+            t->exports[j][items[i]->slot] = items[i]->type == SHARED_ITEM_NONE ? 0 : PA_PTR_TO_INT(items[i]->value);
+        }
+
+        if (k == 0)
+            j = pa_aupdate_write_swap(t->aupdate);
+    }
+
+    pa_aupdate_write_end(t->aupdate);
+}
+
+/* Item value has changed, fire changed hook now or when transaction is committed. */
+static void item_changed(pa_shared_data *t, shared_item *item) {
+    pa_assert(t);
+    pa_assert(item);
+
+    if (t->transaction > 0) {
+        pa_idxset_put(t->pending, item, NULL);
+        return;
+    }
+
+    exports_publish(t, &item, 1);
+    pa_hook_fire(&item->changed_hook, item->key);
+}
+
+void pa_shared_data_begin(pa_shared_data *t) {
+    pa_assert(t);
+    pa_assert(PA_REFCNT_VALUE(t) >= 1);
+
+    t->transaction++;
+}
+
+void pa_shared_data_commit(pa_shared_data *t) {
+    shared_item **items;
+    const char **keys;
+    const char **previous_keys;
+    unsigned i, n;
+
+    pa_assert(t);
+    pa_assert(PA_REFCNT_VALUE(t) >= 1);
+    pa_assert(t->transaction > 0);
+
+    if (--t->transaction > 0)
+        return;
+
+    if ((n = pa_idxset_size(t->pending)) == 0)
+        return;
+
+    /* Take the changed items out of pending set first, hook callbacks
+     * may start new transactions of their own. */
+    items = pa_xnew(shared_item *, n);
+    keys = pa_xnew(const char *, n + 1);
+
+    for (i = 0; i < n; i++) {
+        pa_assert_se(items[i] = pa_idxset_steal_first(t->pending, NULL));
+        keys[i] = items[i]->key;
+    }
+    keys[n] = NULL;
+
+    exports_publish(t, items, n);
+
+    pa_log_debug("Commit %u changed shared items", n);
+
+    /* Keep the shared data alive while firing, hook callbacks may unref it. */
+    pa_shared_data_ref(t);
+
+    previous_keys = t->changed_keys;
+    t->changed_keys = keys;
+
+    for (i = 0; i < n; i++)
+        pa_hook_fire(&items[i]->changed_hook, items[i]->key);
+
+    t->changed_keys = previous_keys;
+
+    pa_xfree(keys);
+    pa_xfree(items);
+
+    pa_shared_data_unref(t);
+}
+
+const char * const *pa_shared_data_changed_keys(pa_shared_data *t) {
+    pa_assert(t);
+
+    return t->changed_keys;
+}
+
+pa_shared_data_key_t *pa_shared_data_key(pa_shared_data *t, const char *key) {
+    shared_item *item;
+
+    pa_assert(key);
+
+    if (!pa_proplist_key_valid(key))
+        return NULL;
+
+    GETI(t, key);
+
+    return item;
+}
+
+const char *pa_shared_data_key_name(pa_shared_data_key_t *k) {
+    pa_assert(k);
+
+    return k->key;
+}
 
 pa_hook_slot *pa_shared_data_connect(pa_shared_data *t, const char *key, pa_hook_cb_t callback, void *userdata) {
     shared_item *item;
@@ -148,15 +294,20 @@ pa_hook_slot *pa_shared_data_connect(pa_shared_data *t, const char *key, pa_hook
     return pa_hook_connect(&item->changed_hook, PA_HOOK_NORMAL, callback, userdata);
 }
 
+pa_hook_slot *pa_shared_data_connect_key(pa_shared_data *t, pa_shared_data_key_t *k, pa_hook_cb_t callback, void *userdata) {
+    pa_assert(t);
+    pa_assert(k);
+
+    return pa_hook_connect(&k->changed_hook, PA_HOOK_NORMAL, callback, userdata);
+}
+
 void pa_shared_data_hook_slot_free(pa_hook_slot *slot) {
     pa_assert(slot);
     pa_hook_slot_free(slot);
 }
 
-int pa_shared_data_set_boolean(pa_shared_data *t, const char *key, bool value) {
-    shared_item *item;
+static int item_set_boolean(pa_shared_data *t, shared_item *item, bool value) {
     bool changed = false;
-    GETI(t, key);
 
     if (item->type != SHARED_ITEM_NONE && item->type != SHARED_ITEM_BOOL)
         return -1;
@@ -173,16 +324,27 @@ int pa_shared_data_set_boolean(pa_shared_data *t, const char *key, bool value) {
 
     if (changed) {
         pa_log_debug("Shared item '%s' changes to bool value %s", item->key, value ? "true" : "false");
-        pa_hook_fire(&item->changed_hook, item->key);
+        item_changed(t, item);
     }
 
     return 0;
 }
 
-bool pa_shared_data_get_boolean(pa_shared_data *t, const char *key) {
+int pa_shared_data_set_boolean(pa_shared_data *t, const char *key, bool value) {
     shared_item *item;
     GETI(t, key);
 
+    return item_set_boolean(t, item, value);
+}
+
+int pa_shared_data_set_boolean_key(pa_shared_data *t, pa_shared_data_key_t *k, bool value) {
+    pa_assert(t);
+    pa_assert(k);
+
+    return item_set_boolean(t, k, value);
+}
+
+static bool item_get_boolean(shared_item *item) {
     if (item->type == SHARED_ITEM_BOOL)
         return !!PA_PTR_TO_UINT(item->value);
     else if (item->type == SHARED_ITEM_NONE)
@@ -193,21 +355,21 @@ bool pa_shared_data_get_boolean(pa_shared_data *t, const char *key) {
         return false;
 }
 
-int pa_shared_data_get_integer(pa_shared_data *t, const char *key, int32_t *return_value) {
+bool pa_shared_data_get_boolean(pa_shared_data *t, const char *key) {
     shared_item *item;
+    GETI(t, key);
 
-    pa_assert(t);
-    pa_assert(key);
-    pa_assert(return_value);
-
-    if (!pa_proplist_key_valid(key))
-        return -1;
+    return item_get_boolean(item);
+}
 
-    if (!(item = pa_hashmap_get(t->items, key)))
-        return -1;
+bool pa_shared_data_get_boolean_key(pa_shared_data *t, pa_shared_data_key_t *k) {
+    pa_assert(t);
+    pa_assert(k);
 
-    GETI(t, key);
+    return item_get_boolean(k);
+}
 
+static int item_get_integer(shared_item *item, int32_t *return_value) {
     if (item->type != SHARED_ITEM_INTEGER)
         return -1;
 
@@ -216,16 +378,31 @@ int pa_shared_data_get_integer(pa_shared_data *t, const char *key, int32_t *retu
     return 0;
 }
 
-int pa_shared_data_set_integer(pa_shared_data *t, const char *key, int32_t value) {
+int pa_shared_data_get_integer(pa_shared_data *t, const char *key, int32_t *return_value) {
     shared_item *item;
 
+    pa_assert(t);
     pa_assert(key);
+    pa_assert(return_value);
 
     if (!pa_proplist_key_valid(key))
         return -1;
 
-    GETI(t, key);
+    if (!(item = pa_hashmap_get(t->items, key)))
+        return -1;
+
+    return item_get_integer(item, return_value);
+}
+
+int pa_shared_data_get_integer_key(pa_shared_data *t, pa_shared_data_key_t *k, int32_t *return_value) {
+    pa_assert(t);
+    pa_assert(k);
+    pa_assert(return_value);
 
+    return item_get_integer(k, return_value);
+}
+
+static int item_set_integer(pa_shared_data *t, shared_item *item, int32_t value) {
     if (item->type == SHARED_ITEM_NONE) {
         item->type = SHARED_ITEM_INTEGER;
         item->value = PA_INT_TO_PTR(value);
@@ -238,26 +415,34 @@ int pa_shared_data_set_integer(pa_shared_data *t, const char *key, int32_t value
     item->value = PA_INT_TO_PTR(value);
 
     pa_log_debug("Shared item '%s' changes to integer value '%d'", item->key, PA_PTR_TO_INT(item->value));
-    pa_hook_fire(&item->changed_hook, item->key);
+    item_changed(t, item);
 
     return 0;
 }
 
-int pa_shared_data_inc_integer(pa_shared_data *t, const char *key, int32_t change) {
+int pa_shared_data_set_integer(pa_shared_data *t, const char *key, int32_t value) {
     shared_item *item;
-    int32_t new_value;
 
-    pa_assert(t);
     pa_assert(key);
 
-    if (change == 0)
-        return 0;
-
     if (!pa_proplist_key_valid(key))
         return -1;
 
     GETI(t, key);
 
+    return item_set_integer(t, item, value);
+}
+
+int pa_shared_data_set_integer_key(pa_shared_data *t, pa_shared_data_key_t *k, int32_t value) {
+    pa_assert(t);
+    pa_assert(k);
+
+    return item_set_integer(t, k, value);
+}
+
+static int item_inc_integer(pa_shared_data *t, shared_item *item, int32_t change) {
+    int32_t new_value;
+
     if (item->type == SHARED_ITEM_NONE) {
         item->value = PA_INT_TO_PTR(0);
         item->type = SHARED_ITEM_INTEGER;
@@ -270,27 +455,51 @@ int pa_shared_data_inc_integer(pa_shared_data *t, const char *key, int32_t chang
     if (new_value != PA_PTR_TO_INT(item->value)) {
         item->value = PA_INT_TO_PTR(new_value);
         pa_log_debug("Shared item '%s' changes to integer value '%d'", item->key, PA_PTR_TO_INT(item->value));
-        pa_hook_fire(&item->changed_hook, item->key);
+        item_changed(t, item);
     }
 
     return 0;
 }
 
-static int shared_data_sets(pa_shared_data *t, const char *key, const char *value, bool fire_always) {
+int pa_shared_data_inc_integer(pa_shared_data *t, const char *key, int32_t change) {
     shared_item *item;
-    bool changed = true;
 
+    pa_assert(t);
     pa_assert(key);
-    pa_assert(value);
 
-    if (!pa_proplist_key_valid(key) || !pa_utf8_valid(value))
+    if (change == 0)
+        return 0;
+
+    if (!pa_proplist_key_valid(key))
         return -1;
 
     GETI(t, key);
 
+    return item_inc_integer(t, item, change);
+}
+
+int pa_shared_data_inc_integer_key(pa_shared_data *t, pa_shared_data_key_t *k, int32_t change) {
+    pa_assert(t);
+    pa_assert(k);
+
+    if (change == 0)
+        return 0;
+
+    return item_inc_integer(t, k, change);
+}
+
+static int item_sets(pa_shared_data *t, shared_item *item, const char *value, bool fire_always) {
+    bool changed = true;
+
+    if (!pa_utf8_valid(value))
+        return -1;
+
     if (item->type != SHARED_ITEM_NONE && item->type != SHARED_ITEM_STR)
         return -1;
 
+    if (item->slot >= 0)
+        return -1;
+
     if (item->value) {
         if (pa_streq(item->value, value))
             changed = false;
@@ -306,12 +515,26 @@ static int shared_data_sets(pa_shared_data *t, const char *key, const char *valu
 
     if (fire_always || changed) {
         pa_log_debug("Shared item '%s' changes to str value '%s'", item->key, (const char *) item->value);
-        pa_hook_fire(&item->changed_hook, item->key);
+        item_changed(t, item);
     }
 
     return 0;
 }
 
+static int shared_data_sets(pa_shared_data *t, const char *key, const char *value, bool fire_always) {
+    shared_item *item;
+
+    pa_assert(key);
+    pa_assert(value);
+
+    if (!pa_proplist_key_valid(key))
+        return -1;
+
+    GETI(t, key);
+
+    return item_sets(t, item, value, fire_always);
+}
+
 int pa_shared_data_sets_always(pa_shared_data *t, const char *key, const char *value) {
     return shared_data_sets(t, key, value, true);
 }
@@ -320,6 +543,14 @@ int pa_shared_data_sets(pa_shared_data *t, const char *key, const char *value) {
     return shared_data_sets(t, key, value, false);
 }
 
+int pa_shared_data_sets_key(pa_shared_data *t, pa_shared_data_key_t *k, const char *value) {
+    pa_assert(t);
+    pa_assert(k);
+    pa_assert(value);
+
+    return item_sets(t, k, value, false);
+}
+
 const char *pa_shared_data_gets(pa_shared_data *t, const char *key) {
     shared_item *item;
 
@@ -331,6 +562,16 @@ const char *pa_shared_data_gets(pa_shared_data *t, const char *key) {
         return NULL;
 }
 
+const char *pa_shared_data_gets_key(pa_shared_data *t, pa_shared_data_key_t *k) {
+    pa_assert(t);
+    pa_assert(k);
+
+    if (k->type == SHARED_ITEM_STR)
+        return (char *) k->value;
+    else
+        return NULL;
+}
+
 int pa_shared_data_setd(pa_shared_data *t, const char *key, const void *data, size_t nbytes) {
     shared_item *item;
 
@@ -341,6 +582,9 @@ int pa_shared_data_setd(pa_shared_data *t, const char *key, const void *data, si
 
     GETI(t, key);
 
+    if (item->slot >= 0)
+        return -1;
+
     if (item->value)
         pa_xfree(item->value);
 
@@ -351,7 +595,7 @@ int pa_shared_data_setd(pa_shared_data *t, const char *key, const void *data, si
     ((char *) item->value)[nbytes] = 0;
 
     pa_log_debug("Shared item '%s' changes to data ptr from %p", item->key, (void *) data);
-    pa_hook_fire(&item->changed_hook, item->key);
+    item_changed(t, item);
 
     return 0;
 }
@@ -381,4 +625,64 @@ bool pa_shared_data_has_key(pa_shared_data *t, const char *key) {
     return !!pa_hashmap_get(t->items, key);
 }
 
+int pa_shared_data_export(pa_shared_data *t, const char *key) {
+    shared_item *item;
+
+    pa_assert(key);
+
+    if (!pa_proplist_key_valid(key))
+        return -1;
+
+    GETI(t, key);
+
+    if (item->slot >= 0)
+        return item->slot;
+
+    if (item->type != SHARED_ITEM_NONE && item->type != SHARED_ITEM_BOOL && item->type != SHARED_ITEM_INTEGER) {
+        pa_log("Shared item '%s' cannot be exported, only boolean and integer items are supported", item->key);
+        return -1;
+    }
+
+    if (t->n_exports >= PA_SHARED_DATA_MAX_EXPORTS) {
+        pa_log("Cannot export shared item '%s', all %d export slots are in use", item->key, PA_SHARED_DATA_MAX_EXPORTS);
+        return -1;
+    }
+
+    item->slot = (int) t->n_exports++;
+    exports_publish(t, &item, 1);
+
+    pa_log_debug("Shared item '%s' exported to slot %d", item->key, item->slot);
+
+    return item->slot;
+}
+
+const int32_t *pa_shared_data_read_begin(pa_shared_data *t) {
+    pa_assert_fp(t);
+
+    return t->exports[pa_aupdate_read_begin(t->aupdate)];
+}
+
+void pa_shared_data_read_end(pa_shared_data *t) {
+    pa_assert_fp(t);
+
+    pa_aupdate_read_end(t->aupdate);
+}
+
+int32_t pa_shared_data_read_integer(pa_shared_data *t, int slot) {
+    const int32_t *values;
+    int32_t value;
+
+    pa_assert_fp(slot >= 0 && slot < PA_SHARED_DATA_MAX_EXPORTS);
+
+    values = pa_shared_data_read_begin(t);
+    value = values[slot];
+    pa_shared_data_read_end(t);
+
+    return value;
+}
+
+bool pa_shared_data_read_boolean(pa_shared_data *t, int slot) {
+    return !!pa_shared_data_read_integer(t, slot);
+}
+
 #undef GETI
@@ -0,0 +1,216 @@
+/***
+  This file is part of PulseAudio.
+
+  Copyright (C) 2013 Jolla Ltd.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+/* For the memfd sealing constants. */
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/core-error.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memblock.h>
+
+#include "stream-export.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC (0x0001U)
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING (0x0002U)
+#endif
+
+#define HEADER_SIZE (4096)
+
+struct meego_stream_export {
+    int fd;
+    size_t size;
+
+    meego_stream_export_header *header;
+    uint8_t *data;
+    uint32_t data_size;
+    uint64_t write_index;
+};
+
+static int memfd_new(const char *name) {
+#ifdef __NR_memfd_create
+    return (int) syscall(__NR_memfd_create, name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/* Size is fixed so that mappings can never SIGBUS, and future writes are
+ * denied so that consumers can't corrupt the ring. Our own mapping is
+ * already established and stays writable. */
+static void seal(meego_stream_export *e, const char *name) {
+#ifdef F_ADD_SEALS
+    int seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+
+#ifdef F_SEAL_FUTURE_WRITE
+    if (fcntl(e->fd, F_ADD_SEALS, seals | F_SEAL_FUTURE_WRITE) == 0)
+        return;
+#endif
+
+    if (fcntl(e->fd, F_ADD_SEALS, seals) < 0)
+        pa_log_debug("Failed to seal stream export %s: %s", name, pa_cstrerror(errno));
+#endif
+
+    pa_log_warn("Stream export %s can't be sealed against writes, consumers can write to it", name);
+}
+
+meego_stream_export *meego_stream_export_new(const char *name, const pa_sample_spec *ss, pa_usec_t ring_usec) {
+    meego_stream_export *e;
+    size_t bytes;
+    void *p;
+
+    pa_assert(name);
+    pa_assert(ss);
+    pa_assert(pa_sample_spec_valid(ss));
+    pa_assert(ring_usec > 0);
+
+    e = pa_xnew0(meego_stream_export, 1);
+
+    bytes = pa_usec_to_bytes(ring_usec, ss);
+    for (e->data_size = 1; e->data_size < bytes; e->data_size <<= 1)
+        ;
+    e->size = HEADER_SIZE + e->data_size;
+
+    if ((e->fd = memfd_new(name)) < 0) {
+        pa_log_warn("Failed to create memfd for stream export %s: %s", name, pa_cstrerror(errno));
+        goto fail;
+    }
+
+    if (ftruncate(e->fd, (off_t) e->size) < 0) {
+        pa_log("Failed to size stream export %s: %s", name, pa_cstrerror(errno));
+        goto fail;
+    }
+
+    if ((p = mmap(NULL, e->size, PROT_READ | PROT_WRITE, MAP_SHARED, e->fd, 0)) == MAP_FAILED) {
+        pa_log("Failed to map stream export %s: %s", name, pa_cstrerror(errno));
+        goto fail;
+    }
+
+    e->header = p;
+    e->data = (uint8_t *) p + HEADER_SIZE;
+
+    /* Fault the pages in now, so that IO thread never takes a page fault
+     * on its first pass through the ring. */
+    memset(p, 0, e->size);
+
+    seal(e, name);
+
+    e->header->magic = MEEGO_STREAM_EXPORT_MAGIC;
+    e->header->version = MEEGO_STREAM_EXPORT_VERSION;
+    e->header->header_size = HEADER_SIZE;
+    e->header->data_size = e->data_size;
+    e->header->format = (uint32_t) ss->format;
+    e->header->rate = ss->rate;
+    e->header->channels = ss->channels;
+    e->header->sequence = 0;
+    __sync_synchronize();
+
+    pa_log_debug("Stream export %s: %u bytes of shared memory", name, e->data_size);
+
+    return e;
+
+fail:
+    meego_stream_export_free(e);
+    return NULL;
+}
+
+void meego_stream_export_free(meego_stream_export *e) {
+    pa_assert(e);
+
+    if (e->header)
+        munmap(e->header, e->size);
+
+    if (e->fd >= 0)
+        pa_close(e->fd);
+
+    pa_xfree(e);
+}
+
+int meego_stream_export_fd(meego_stream_export *e) {
+    pa_assert(e);
+
+    return e->fd;
+}
+
+size_t meego_stream_export_size(meego_stream_export *e) {
+    pa_assert(e);
+
+    return e->size;
+}
+
+void meego_stream_export_write_data(meego_stream_export *e, const void *data, size_t length, pa_usec_t timestamp) {
+    const uint8_t *p = data;
+    uint32_t offset, n;
+
+    pa_assert(e);
+    pa_assert(data);
+
+    /* Only the latest data_size bytes fit. */
+    if (length > e->data_size) {
+        p += length - e->data_size;
+        e->write_index += length - e->data_size;
+        length = e->data_size;
+    }
+
+    offset = (uint32_t) (e->write_index & (e->data_size - 1));
+    n = PA_MIN((uint32_t) length, e->data_size - offset);
+    memcpy(e->data + offset, p, n);
+    memcpy(e->data, p + n, length - n);
+
+    e->write_index += length;
+
+    /* Data is visible before the new position, and the position before
+     * the even sequence. */
+    __sync_synchronize();
+    e->header->sequence++;
+    __sync_synchronize();
+    e->header->write_index = e->write_index;
+    e->header->timestamp = timestamp;
+    __sync_synchronize();
+    e->header->sequence++;
+}
+
+void meego_stream_export_write(meego_stream_export *e, const pa_memchunk *chunk, pa_usec_t timestamp) {
+    pa_assert(e);
+    pa_assert(chunk);
+    pa_assert(chunk->memblock);
+
+    meego_stream_export_write_data(e, (const uint8_t *) pa_memblock_acquire(chunk->memblock) + chunk->index,
+                                   chunk->length, timestamp);
+    pa_memblock_release(chunk->memblock);
+}
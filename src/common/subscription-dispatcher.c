@@ -0,0 +1,290 @@
+/***
+  This file is part of PulseAudio.
+
+  Copyright (C) 2013 Jolla Ltd.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/core.h>
+#include <pulsecore/core-subscribe.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/refcnt.h>
+#include <pulsecore/shared.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/llist.h>
+
+#include "subscription-dispatcher.h"
+
+#define SUBSCRIPTION_DISPATCHER_SHARED_NAME "subscription-dispatcher-1"
+#define FACILITY_MAX (PA_SUBSCRIPTION_EVENT_FACILITY_MASK + 1)
+
+struct pa_subscription_dispatcher_slot {
+    pa_subscription_dispatcher *dispatcher;
+    unsigned facility;
+    uint32_t idx;
+    pa_subscription_dispatcher_event_t events;
+    pa_subscription_cb_t cb;
+    void *userdata;
+    bool dead;  /* Freed during dispatch, removed from lists afterwards. */
+    pa_subscription_dispatcher_slot *next_dead;
+
+    PA_LLIST_FIELDS(pa_subscription_dispatcher_slot);
+};
+
+/* Slots connected to one object. */
+struct object_slots {
+    PA_LLIST_HEAD(pa_subscription_dispatcher_slot, slots);
+};
+
+struct pa_subscription_dispatcher {
+    PA_REFCNT_DECLARE;
+
+    pa_core *core;
+    pa_subscription *subscription;
+    pa_subscription_mask_t mask;
+
+    pa_hashmap *objects[FACILITY_MAX];  /* Object index -> struct object_slots */
+    PA_LLIST_HEAD(pa_subscription_dispatcher_slot, any[FACILITY_MAX]);
+    unsigned n_slots[FACILITY_MAX];
+
+    unsigned dispatching;
+    pa_subscription_dispatcher_slot *dead_slots;
+};
+
+static void object_slots_free(struct object_slots *o) {
+    pa_assert(o);
+    pa_assert(!o->slots);
+
+    pa_xfree(o);
+}
+
+static pa_subscription_dispatcher *subscription_dispatcher_new(pa_core *c) {
+    pa_subscription_dispatcher *d;
+    unsigned f;
+
+    pa_assert(c);
+
+    d = pa_xnew0(pa_subscription_dispatcher, 1);
+    PA_REFCNT_INIT(d);
+    d->core = c;
+
+    for (f = 0; f < FACILITY_MAX; f++)
+        d->objects[f] = pa_hashmap_new_full(pa_idxset_trivial_hash_func,
+                                            pa_idxset_trivial_compare_func,
+                                            NULL,
+                                            (pa_free_cb_t) object_slots_free);
+
+    pa_assert_se(pa_shared_set(c, SUBSCRIPTION_DISPATCHER_SHARED_NAME, d) >= 0);
+
+    return d;
+}
+
+pa_subscription_dispatcher *pa_subscription_dispatcher_get(pa_core *core) {
+    pa_subscription_dispatcher *d;
+
+    if ((d = pa_shared_get(core, SUBSCRIPTION_DISPATCHER_SHARED_NAME)))
+        return pa_subscription_dispatcher_ref(d);
+
+    return subscription_dispatcher_new(core);
+}
+
+pa_subscription_dispatcher *pa_subscription_dispatcher_ref(pa_subscription_dispatcher *d) {
+    pa_assert(d);
+    pa_assert(PA_REFCNT_VALUE(d) >= 1);
+
+    PA_REFCNT_INC(d);
+
+    return d;
+}
+
+void pa_subscription_dispatcher_unref(pa_subscription_dispatcher *d) {
+    unsigned f;
+
+    pa_assert(d);
+    pa_assert(PA_REFCNT_VALUE(d) >= 1);
+
+    if (PA_REFCNT_DEC(d) > 0)
+        return;
+
+    /* Every slot holds a reference, so all slots are gone by now. */
+    pa_assert(!d->subscription);
+    pa_assert(!d->dispatching);
+
+    pa_assert_se(pa_shared_remove(d->core, SUBSCRIPTION_DISPATCHER_SHARED_NAME) >= 0);
+
+    for (f = 0; f < FACILITY_MAX; f++)
+        pa_hashmap_free(d->objects[f]);
+
+    pa_xfree(d);
+}
+
+static void dispatch_list(pa_subscription_dispatcher_slot *s, pa_core *c,
+                          pa_subscription_event_type_t t, uint32_t idx,
+                          pa_subscription_dispatcher_event_t event) {
+    pa_subscription_dispatcher_slot *next;
+
+    /* Slots freed by callbacks are only marked dead during dispatch, so
+     * next stays valid. Slots connected by callbacks are prepended and
+     * not called for this event. */
+    for (; s; s = next) {
+        next = s->next;
+
+        if (!s->dead && (s->events & event))
+            s->cb(c, t, idx, s->userdata);
+    }
+}
+
+static void remove_slot(pa_subscription_dispatcher *d, pa_subscription_dispatcher_slot *s) {
+    struct object_slots *o;
+
+    if (s->idx == PA_INVALID_INDEX)
+        PA_LLIST_REMOVE(pa_subscription_dispatcher_slot, d->any[s->facility], s);
+    else {
+        pa_assert_se((o = pa_hashmap_get(d->objects[s->facility], PA_UINT32_TO_PTR(s->idx))));
+        PA_LLIST_REMOVE(pa_subscription_dispatcher_slot, o->slots, s);
+
+        if (!o->slots)
+            pa_hashmap_remove_and_free(d->objects[s->facility], PA_UINT32_TO_PTR(s->idx));
+    }
+
+    pa_xfree(s);
+}
+
+static void remove_dead_slots(pa_subscription_dispatcher *d) {
+    pa_subscription_dispatcher_slot *s;
+
+    while ((s = d->dead_slots)) {
+        d->dead_slots = s->next_dead;
+        remove_slot(d, s);
+    }
+}
+
+static void subscription_cb(pa_core *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata) {
+    pa_subscription_dispatcher *d = userdata;
+    pa_subscription_dispatcher_event_t event;
+    struct object_slots *o;
+    unsigned facility;
+
+    pa_assert(c);
+    pa_assert(d);
+
+    facility = t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+    event = 1 << ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) >> 4);
+
+    pa_subscription_dispatcher_ref(d);
+    d->dispatching++;
+
+    if ((o = pa_hashmap_get(d->objects[facility], PA_UINT32_TO_PTR(idx))))
+        dispatch_list(o->slots, c, t, idx, event);
+
+    dispatch_list(d->any[facility], c, t, idx, event);
+
+    if (--d->dispatching == 0 && d->dead_slots)
+        remove_dead_slots(d);
+
+    pa_subscription_dispatcher_unref(d);
+}
+
+static void update_subscription(pa_subscription_dispatcher *d) {
+    pa_subscription_mask_t mask = 0;
+    unsigned f;
+
+    for (f = 0; f < FACILITY_MAX; f++)
+        if (d->n_slots[f])
+            mask |= 1 << f;
+
+    if (mask == d->mask)
+        return;
+
+    /* Freeing subscription from its own callback is fine, core frees
+     * dead subscriptions later. */
+    if (d->subscription) {
+        pa_subscription_free(d->subscription);
+        d->subscription = NULL;
+    }
+
+    d->mask = mask;
+
+    if (mask)
+        d->subscription = pa_subscription_new(d->core, mask, subscription_cb, d);
+}
+
+pa_subscription_dispatcher_slot *pa_subscription_dispatcher_connect(pa_subscription_dispatcher *d,
+                                                                    pa_subscription_event_type_t facility,
+                                                                    uint32_t idx,
+                                                                    pa_subscription_dispatcher_event_t events,
+                                                                    pa_subscription_cb_t cb,
+                                                                    void *userdata) {
+    pa_subscription_dispatcher_slot *s;
+    struct object_slots *o;
+
+    pa_assert(d);
+    pa_assert(PA_REFCNT_VALUE(d) >= 1);
+    pa_assert((facility & ~PA_SUBSCRIPTION_EVENT_FACILITY_MASK) == 0);
+    pa_assert(events);
+    pa_assert(cb);
+
+    s = pa_xnew0(pa_subscription_dispatcher_slot, 1);
+    s->dispatcher = pa_subscription_dispatcher_ref(d);
+    s->facility = facility;
+    s->idx = idx;
+    s->events = events;
+    s->cb = cb;
+    s->userdata = userdata;
+
+    if (idx == PA_INVALID_INDEX)
+        PA_LLIST_PREPEND(pa_subscription_dispatcher_slot, d->any[facility], s);
+    else {
+        if (!(o = pa_hashmap_get(d->objects[facility], PA_UINT32_TO_PTR(idx)))) {
+            o = pa_xnew0(struct object_slots, 1);
+            pa_hashmap_put(d->objects[facility], PA_UINT32_TO_PTR(idx), o);
+        }
+        PA_LLIST_PREPEND(pa_subscription_dispatcher_slot, o->slots, s);
+    }
+
+    d->n_slots[facility]++;
+    update_subscription(d);
+
+    return s;
+}
+
+void pa_subscription_dispatcher_slot_free(pa_subscription_dispatcher_slot *s) {
+    pa_subscription_dispatcher *d;
+
+    pa_assert(s);
+    pa_assert(!s->dead);
+
+    d = s->dispatcher;
+
+    pa_assert(d->n_slots[s->facility] > 0);
+    d->n_slots[s->facility]--;
+    update_subscription(d);
+
+    if (d->dispatching) {
+        s->dead = true;
+        s->next_dead = d->dead_slots;
+        d->dead_slots = s;
+    } else
+        remove_slot(d, s);
+
+    pa_subscription_dispatcher_unref(d);
+}
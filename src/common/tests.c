@@ -22,7 +22,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <check.h>
+
 #include "optimized.h"
+#include "module-voice-api.h"
+#include "stream-export.h"
 
 #define TEST_LENGTH 160
 
@@ -290,7 +296,197 @@ int test_apply_volume(int argc, char *argv[])
   return 0;
 }
 
+static voice_sideinfo sideinfo_make(unsigned int n) {
+    voice_sideinfo info;
+
+    info.flags = n & VOICE_SIDEINFO_FLAG_SPEECH;
+    info.codec_mode = n;
+    info.timestamp = (pa_usec_t) n * 20000;
+
+    return info;
+}
+
+/* Pushes and pops n entries one by one, starting from index start. */
+static void sideinfo_ring_run(unsigned int start, unsigned int n) {
+    voice_sideinfo_ring r;
+    voice_sideinfo in, out;
+    unsigned int i;
+
+    memset(&r, 0, sizeof(r));
+    pa_atomic_store(&r.write_index, (int) start);
+    pa_atomic_store(&r.read_index, (int) start);
+
+    for (i = 0; i < n; i++) {
+        in = sideinfo_make(i);
+        fail_unless(voice_sideinfo_ring_push(&r, &in), "Push %u failed", i);
+        fail_unless(voice_sideinfo_ring_pop(&r, &out), "Pop %u failed", i);
+        fail_unless(out.codec_mode == i && out.flags == in.flags && out.timestamp == in.timestamp,
+                    "Entry %u corrupted", i);
+    }
+
+    fail_unless((unsigned int) pa_atomic_load(&r.write_index) == start + n, NULL);
+    fail_unless((unsigned int) pa_atomic_load(&r.read_index) == start + n, NULL);
+    fail_unless(pa_atomic_load(&r.overflows) == 0, NULL);
+    fail_unless(pa_atomic_load(&r.underflows) == 0, NULL);
+}
+
+START_TEST (sideinfo_ring_wrap)
+{
+    /* Around the ring a few times */
+    sideinfo_ring_run(0, 3 * VOICE_SIDEINFO_RING_SIZE + 5);
+}
+END_TEST
+
+START_TEST (sideinfo_ring_index_wrap)
+{
+    /* Across the wrap of the unsigned indexes */
+    sideinfo_ring_run(UINT32_MAX - 10, 2 * VOICE_SIDEINFO_RING_SIZE);
+}
+END_TEST
+
+START_TEST (sideinfo_ring_overflow_underflow)
+{
+    voice_sideinfo_ring r;
+    voice_sideinfo in, out;
+    unsigned int i;
+
+    memset(&r, 0, sizeof(r));
+
+    fail_unless(!voice_sideinfo_ring_pop(&r, &out), NULL);
+    fail_unless(pa_atomic_load(&r.underflows) == 1, NULL);
+
+    for (i = 0; i < VOICE_SIDEINFO_RING_SIZE; i++) {
+        in = sideinfo_make(i);
+        fail_unless(voice_sideinfo_ring_push(&r, &in), "Push %u failed", i);
+    }
+
+    /* Full ring drops the new entry, not the old ones */
+    in = sideinfo_make(1000);
+    fail_unless(!voice_sideinfo_ring_push(&r, &in), NULL);
+    fail_unless(!voice_sideinfo_ring_push(&r, &in), NULL);
+    fail_unless(pa_atomic_load(&r.overflows) == 2, NULL);
+
+    for (i = 0; i < VOICE_SIDEINFO_RING_SIZE; i++) {
+        fail_unless(voice_sideinfo_ring_pop(&r, &out), "Pop %u failed", i);
+        fail_unless(out.codec_mode == i, "Expected entry %u - got %u", i, out.codec_mode);
+    }
+
+    fail_unless(!voice_sideinfo_ring_pop(&r, &out), NULL);
+    fail_unless(pa_atomic_load(&r.underflows) == 2, NULL);
+    fail_unless(pa_atomic_load(&r.overflows) == 2, NULL);
+}
+END_TEST
+
+/* 1000 usec of 8 kHz mono S16LE is 16 bytes, data_size is 16. */
+#define STREAM_EXPORT_TEST_USEC (1000)
+#define STREAM_EXPORT_TEST_SIZE (16)
+
+/* Writes length bytes, each byte is its position in the stream. */
+static void stream_export_test_write(meego_stream_export *e, uint64_t *position, size_t length, pa_usec_t timestamp) {
+    uint8_t data[64];
+    size_t i;
+
+    fail_unless(length <= sizeof(data), NULL);
+
+    for (i = 0; i < length; i++)
+        data[i] = (uint8_t) (*position + i);
+
+    meego_stream_export_write_data(e, data, length, timestamp);
+    *position += length;
+}
+
+/* Reads the export like a consumer does. */
+static void stream_export_test_check(const meego_stream_export_header *h, uint64_t position, pa_usec_t timestamp) {
+    const uint8_t *data = (const uint8_t *) h + h->header_size;
+    uint64_t write_index, ts, i;
+
+    fail_unless(meego_stream_export_position(h, &write_index, &ts) == 0, NULL);
+    fail_unless(write_index == position, "Expected write_index %llu - got %llu",
+                (unsigned long long) position, (unsigned long long) write_index);
+    fail_unless(ts == timestamp, NULL);
+    fail_unless((h->sequence & 1) == 0, NULL);
+
+    for (i = position > h->data_size ? position - h->data_size : 0; i < position; i++)
+        fail_unless(data[i & (h->data_size - 1)] == (uint8_t) i, "Byte %llu corrupted", (unsigned long long) i);
+}
+
+START_TEST (stream_export_ring)
+{
+    pa_sample_spec ss = { PA_SAMPLE_S16LE, 8000, 1 };
+    meego_stream_export *e;
+    meego_stream_export_header *h;
+    uint64_t position = 0;
+
+    if (!(e = meego_stream_export_new("check-common", &ss, STREAM_EXPORT_TEST_USEC))) {
+        printf("memfd not supported, skipping stream export test\n");
+        return;
+    }
+
+    h = mmap(NULL, meego_stream_export_size(e), PROT_READ, MAP_SHARED, meego_stream_export_fd(e), 0);
+    fail_unless(h != MAP_FAILED, NULL);
+    fail_unless(h->magic == MEEGO_STREAM_EXPORT_MAGIC, NULL);
+    fail_unless(h->data_size == STREAM_EXPORT_TEST_SIZE, NULL);
+
+    stream_export_test_write(e, &position, 10, 1);
+    stream_export_test_check(h, position, 1);
+
+    /* Across the wrap point */
+    stream_export_test_write(e, &position, 10, 2);
+    stream_export_test_check(h, position, 2);
+
+    /* Larger than the ring, only the latest data_size bytes are kept */
+    stream_export_test_write(e, &position, 3 * STREAM_EXPORT_TEST_SIZE + 5, 3);
+    stream_export_test_check(h, position, 3);
+
+    /* Exactly the ring size, at an unaligned offset */
+    stream_export_test_write(e, &position, STREAM_EXPORT_TEST_SIZE, 4);
+    stream_export_test_check(h, position, 4);
+
+    munmap(h, meego_stream_export_size(e));
+    meego_stream_export_free(e);
+}
+END_TEST
+
+START_TEST (stream_export_position_busy)
+{
+    meego_stream_export_header h;
+    uint64_t write_index = 0, timestamp = 0;
+
+    memset(&h, 0, sizeof(h));
+    h.write_index = 100;
+    h.timestamp = 200;
+
+    /* Producer stuck in the middle of an update */
+    h.sequence = 3;
+    fail_unless(meego_stream_export_position(&h, &write_index, &timestamp) == -EAGAIN, NULL);
+
+    h.sequence = 4;
+    fail_unless(meego_stream_export_position(&h, &write_index, &timestamp) == 0, NULL);
+    fail_unless(write_index == 100 && timestamp == 200, NULL);
+}
+END_TEST
+
+static Suite *common_suite(void) {
+    Suite *s = suite_create("Common");
+
+    TCase *tc_core = tcase_create("Common");
+
+    /* add test cases */
+    tcase_add_test(tc_core, sideinfo_ring_wrap);
+    tcase_add_test(tc_core, sideinfo_ring_index_wrap);
+    tcase_add_test(tc_core, sideinfo_ring_overflow_underflow);
+    tcase_add_test(tc_core, stream_export_ring);
+    tcase_add_test(tc_core, stream_export_position_busy);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
 int main (int argc, char * argv[]) {
+    int number_failed;
+    SRunner *sr;
+
     test_interleave(argc, argv);
     test_deinterleave(argc, argv);
     test_dup(argc, argv);
@@ -299,4 +495,11 @@ int main (int argc, char * argv[]) {
     test_mix(argc, argv);
     test_mix_in_with_volume(argc, argv);
     test_apply_volume(argc, argv);
+
+    sr = srunner_create(common_suite());
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,149 @@
+/***
+  This file is part of PulseAudio.
+
+  Copyright (C) 2013 Jolla Ltd.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <pulse/rtclock.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/core-error.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/atomic.h>
+
+#include "trace.h"
+
+/* Must be a power of two. */
+#define TRACE_EVENTS (8192)
+#define TRACE_NAME_MAX (32)
+
+/* seq is 0 while the event is being written, otherwise ring position + 1. */
+struct trace_event {
+    pa_atomic_t seq;
+    int tid;
+    pa_usec_t ts;
+    int value;
+    meego_trace_type_t type;
+    char name[TRACE_NAME_MAX];
+};
+
+pa_atomic_t meego_trace_active = PA_ATOMIC_INIT(0);
+
+static pa_atomic_t trace_write_pos = PA_ATOMIC_INIT(0);
+static struct trace_event trace_events[TRACE_EVENTS];
+static __thread int trace_tid;
+
+void meego_trace_set_enabled(bool enabled) {
+    if (enabled == !!pa_atomic_load(&meego_trace_active))
+        return;
+
+    pa_log_info("Timeline trace %s", enabled ? "enabled" : "disabled");
+    pa_atomic_store(&meego_trace_active, enabled ? 1 : 0);
+}
+
+void meego_trace_record(meego_trace_type_t type, const char *name, int value) {
+    struct trace_event *e;
+    unsigned pos;
+
+    pa_assert(name);
+
+    if (PA_UNLIKELY(!trace_tid))
+        trace_tid = (int) syscall(SYS_gettid);
+
+    /* Oldest event is overwritten, the ring always holds latest events. */
+    pos = (unsigned) pa_atomic_inc(&trace_write_pos);
+    e = &trace_events[pos & (TRACE_EVENTS - 1)];
+
+    pa_atomic_store(&e->seq, 0);
+    e->tid = trace_tid;
+    e->ts = pa_rtclock_now();
+    e->value = value;
+    e->type = type;
+    pa_strlcpy(e->name, name, sizeof(e->name));
+    pa_atomic_store(&e->seq, (int) (pos + 1));
+}
+
+static void write_name(FILE *f, const char *name) {
+    for (; *name; name++)
+        fputc(*name == '"' || *name == '\\' || (unsigned char) *name < 0x20 ? '_' : *name, f);
+}
+
+int meego_trace_dump(const char *path) {
+    struct trace_event e;
+    unsigned end, pos;
+    unsigned count = 0;
+    int seq;
+    FILE *f;
+    bool first = true;
+
+    pa_assert(path);
+
+    if (!(f = pa_fopen_cloexec(path, "w"))) {
+        pa_log("Failed to open trace file %s: %s", path, pa_cstrerror(errno));
+        return -1;
+    }
+
+    end = (unsigned) pa_atomic_load(&trace_write_pos);
+    pos = end > TRACE_EVENTS ? end - TRACE_EVENTS : 0;
+
+    fputs("{\"traceEvents\":[\n", f);
+
+    for (; pos != end; pos++) {
+        struct trace_event *r = &trace_events[pos & (TRACE_EVENTS - 1)];
+
+        /* Skip events being written or already overwritten. */
+        if ((seq = pa_atomic_load(&r->seq)) != (int) (pos + 1))
+            continue;
+        e = *r;
+        if (pa_atomic_load(&r->seq) != seq)
+            continue;
+        e.name[TRACE_NAME_MAX - 1] = 0;
+
+        fprintf(f, "%s{\"name\":\"", first ? "" : ",\n");
+        write_name(f, e.name);
+        fprintf(f, "\",\"ph\":\"%s\",\"ts\":%llu,\"pid\":%d,\"tid\":%d",
+                e.type == MEEGO_TRACE_BEGIN ? "B" : e.type == MEEGO_TRACE_END ? "E" : "C",
+                (unsigned long long) e.ts, (int) getpid(), e.tid);
+        if (e.type == MEEGO_TRACE_COUNTER)
+            fprintf(f, ",\"args\":{\"value\":%d}", e.value);
+        fputc('}', f);
+
+        first = false;
+        count++;
+    }
+
+    fputs("\n]}\n", f);
+
+    if (fclose(f) != 0) {
+        pa_log("Failed to write trace file %s: %s", path, pa_cstrerror(errno));
+        return -1;
+    }
+
+    pa_log_info("Wrote %u trace events to %s", count, path);
+
+    return 0;
+}
@@ -45,12 +45,15 @@ struct pa_volume_proxy {
     pa_hook hooks[PA_VOLUME_PROXY_HOOK_MAX];
 };
 
-struct volume_entry {
+/* Entries are never removed, so pointer to entry is used as key handle. */
+struct pa_volume_proxy_key {
     char *name;
+    bool valid;             /* False until volume has been set, entry may exist
+                             * before that if key handle was requested. */
     pa_volume_proxy_entry data;
 };
 
-static void volume_entry_free(struct volume_entry *e);
+static void volume_entry_free(pa_volume_proxy_key_t *e);
 
 static pa_volume_proxy* volume_proxy_new(pa_core *c) {
     pa_volume_proxy *r;
@@ -92,7 +95,7 @@ pa_volume_proxy *pa_volume_proxy_ref(pa_volume_proxy *r) {
     return r;
 }
 
-static void volume_entry_free(struct volume_entry *e) {
+static void volume_entry_free(pa_volume_proxy_key_t *e) {
     pa_assert(e);
     pa_assert(e->name);
 
@@ -119,42 +122,71 @@ void pa_volume_proxy_unref(pa_volume_proxy *r) {
     pa_xfree(r);
 }
 
-bool pa_volume_proxy_get_volume(pa_volume_proxy *r, const char *name, pa_cvolume *return_volume) {
-    struct volume_entry *e;
+static pa_volume_proxy_key_t *entry_get(pa_volume_proxy *r, const char *name) {
+    pa_volume_proxy_key_t *e;
+
+    if (!(e = pa_hashmap_get(r->volumes, name))) {
+        e = pa_xnew0(pa_volume_proxy_key_t, 1);
+        e->name = pa_xstrdup(name);
+        e->data.name = e->name;
+        pa_hashmap_put(r->volumes, e->name, e);
+    }
 
+    return e;
+}
+
+pa_volume_proxy_key_t *pa_volume_proxy_key(pa_volume_proxy *r, const char *name) {
     pa_assert(r);
     pa_assert(PA_REFCNT_VALUE(r) >= 1);
-    pa_assert(return_volume);
+    pa_assert(name);
 
-    if ((e = pa_hashmap_get(r->volumes, name))) {
-        *return_volume = e->data.volume;
-        return true;
-    }
+    return entry_get(r, name);
+}
+
+bool pa_volume_proxy_key_matches(pa_volume_proxy_key_t *k, const pa_volume_proxy_entry *entry) {
+    pa_assert(k);
+    pa_assert(entry);
 
-    return false;
+    return &k->data == entry;
 }
 
-void pa_volume_proxy_set_volume(pa_volume_proxy *r,
-                                const char *name,
-                                const pa_cvolume *volume,
-                                bool allow_update) {
-    struct volume_entry *e;
-    bool changed = false;
-    pa_cvolume vol;
+static bool entry_get_volume(pa_volume_proxy_key_t *e, pa_cvolume *return_volume) {
+    if (!e || !e->valid)
+        return false;
+
+    *return_volume = e->data.volume;
+    return true;
+}
 
+bool pa_volume_proxy_get_volume(pa_volume_proxy *r, const char *name, pa_cvolume *return_volume) {
+    pa_assert(r);
+    pa_assert(PA_REFCNT_VALUE(r) >= 1);
+    pa_assert(return_volume);
+
+    return entry_get_volume(pa_hashmap_get(r->volumes, name), return_volume);
+}
+
+bool pa_volume_proxy_get_volume_key(pa_volume_proxy *r, pa_volume_proxy_key_t *k, pa_cvolume *return_volume) {
     pa_assert(r);
-    pa_assert(name);
-    pa_assert(volume);
     pa_assert(PA_REFCNT_VALUE(r) >= 1);
+    pa_assert(k);
+    pa_assert(return_volume);
+
+    return entry_get_volume(k, return_volume);
+}
+
+static void entry_set_volume(pa_volume_proxy *r,
+                             pa_volume_proxy_key_t *e,
+                             const pa_cvolume *volume,
+                             bool allow_update) {
+    bool changed = false;
+    pa_cvolume vol;
 
     vol = *volume;
 
-    if (!(e = pa_hashmap_get(r->volumes, name))) {
-        e = pa_xnew0(struct volume_entry, 1);
-        e->name = pa_xstrdup(name);
-        e->data.name = e->name;
+    if (!e->valid) {
         e->data.volume = vol;
-        pa_hashmap_put(r->volumes, e->name, e);
+        e->valid = true;
         changed = true;
     }
 
@@ -174,6 +206,30 @@ void pa_volume_proxy_set_volume(pa_volume_proxy *r,
         pa_hook_fire(&r->hooks[PA_VOLUME_PROXY_HOOK_CHANGED], (void *) &e->data);
 }
 
+void pa_volume_proxy_set_volume(pa_volume_proxy *r,
+                                const char *name,
+                                const pa_cvolume *volume,
+                                bool allow_update) {
+    pa_assert(r);
+    pa_assert(name);
+    pa_assert(volume);
+    pa_assert(PA_REFCNT_VALUE(r) >= 1);
+
+    entry_set_volume(r, entry_get(r, name), volume, allow_update);
+}
+
+void pa_volume_proxy_set_volume_key(pa_volume_proxy *r,
+                                    pa_volume_proxy_key_t *k,
+                                    const pa_cvolume *volume,
+                                    bool allow_update) {
+    pa_assert(r);
+    pa_assert(k);
+    pa_assert(volume);
+    pa_assert(PA_REFCNT_VALUE(r) >= 1);
+
+    entry_set_volume(r, k, volume, allow_update);
+}
+
 pa_hook *pa_volume_proxy_hooks(pa_volume_proxy *r) {
     pa_assert(r);
     pa_assert(PA_REFCNT_VALUE(r) >= 1);
@@ -328,7 +328,7 @@ bool mv_notifier_active(struct mv_userdata *u)
 {
     pa_assert(u);
 
-    if (u->notifier.mode_active && u->notifier.enabled_slots && !u->call_active && !u->voip_active)
+    if (u->notifier.mode_active && u->notifier.running_streams && !u->call_active && !u->voip_active)
         return true;
     else
         return false;
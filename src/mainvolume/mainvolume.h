@@ -86,6 +86,10 @@ struct mv_userdata {
     char *route;
 
     pa_shared_data *shared;
+    pa_shared_data_key_t *call_state_key;
+    pa_shared_data_key_t *media_state_key;
+    pa_shared_data_key_t *emergency_call_state_key;
+    pa_shared_data_key_t *volume_sync_key;
     pa_hook_slot *call_state_hook_slot;
     pa_hook_slot *media_state_hook_slot;
     pa_hook_slot *emergency_call_state_hook_slot;
@@ -101,6 +105,9 @@ struct mv_userdata {
     uint32_t volume_sync_delay_ms;
 
     pa_volume_proxy *volume_proxy;
+    pa_volume_proxy_key_t *media_stream_key;
+    pa_volume_proxy_key_t *call_stream_key;
+    pa_volume_proxy_key_t *voip_stream_key;
     pa_hook_slot *volume_proxy_slot;
 
     pa_hook_slot *sink_proplist_changed_slot;
@@ -109,6 +116,14 @@ struct mv_userdata {
     pa_usec_t last_signal_timestamp;
     pa_usec_t last_step_set_timestamp;
 
+    /* Outgoing D-Bus signals are merged and sent signal_delay_ms after
+     * the first queued one. */
+    pa_time_event *signal_queue_time_event;
+    uint32_t signal_queue;          /* bit flags of queued signals */
+    uint32_t queued_safe_step;
+    uint32_t queued_listening_time;
+    uint32_t signal_delay_ms;
+
     pa_dbus_protocol *dbus_protocol;
     char *dbus_path;
 
@@ -126,12 +141,10 @@ struct mv_userdata {
         pa_hashmap *roles;
 
         /* Currently existing sink-inputs matching with roles.
-         * key: sink-input-object data: uint32_t bit flag for sink-input
-         * When sink-input is in playing state, si's flag is applied to enabled_slots
-         * and vice-versa. */
+         * key: sink-input-object data: NOTIFIER_STREAM_IDLE or NOTIFIER_STREAM_RUNNING
+         * running_streams counts sink-inputs that are in playing state. */
         pa_hashmap *sink_inputs;
-        uint32_t enabled_slots; /* bit slots that are enabled */
-        uint32_t free_slots;    /* 1 means free, 0 means taken. */
+        uint32_t running_streams;
 
         bool streams_active;                /* Active media streams. */
         media_state_t policy_media_state;   /* Media state from policy enforcement point of view. */
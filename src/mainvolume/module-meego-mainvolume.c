@@ -54,7 +54,8 @@ PA_MODULE_USAGE("tuning_mode=<true/false> defaults to false "
                 "virtual_stream=<true/false> create virtual stream for voice call volume control (default false) "
                 "listening_time_notifier_conf=<file location for listening time notifier configuration> "
                 "mute_routing=<true/false> apply muting to media streams when volumes are out of sync (default true) "
-                "unmute_delay=<time in ms> time to keep media streams muted after volumes are in sync (default 50)");
+                "unmute_delay=<time in ms> time to keep media streams muted after volumes are in sync (default 50) "
+                "signal_delay=<time in ms> time to collect state changes before sending D-Bus signals (default 50)");
 PA_MODULE_VERSION(PACKAGE_VERSION);
 
 static const char* const valid_modargs[] = {
@@ -63,6 +64,7 @@ static const char* const valid_modargs[] = {
     "listening_time_notifier_conf",
     "mute_routing",
     "unmute_delay",
+    "signal_delay",
     NULL,
 };
 
@@ -89,6 +91,7 @@ static void check_notifier(struct mv_userdata *u);
 
 #define DEFAULT_MUTE_ROUTING (true)
 #define DEFAULT_VOLUME_SYNC_DELAY_MS (50)
+#define DEFAULT_SIGNAL_DELAY_MS (50)
 
 static void signal_steps(struct mv_userdata *u);
 
@@ -237,6 +240,26 @@ static void update_virtual_stream(struct mv_userdata *u) {
         destroy_virtual_stream(u);
 }
 
+static void update_media_state(struct mv_userdata *u);
+static bool update_policy_media_state(struct mv_userdata *u);
+
+/* Returns true if key changed in the same shared data transaction that is being committed. */
+static bool changed_together(struct mv_userdata *u, pa_shared_data_key_t *k) {
+    const char * const *keys;
+    const char *key;
+
+    if (!(keys = pa_shared_data_changed_keys(u->shared)))
+        return false;
+
+    key = pa_shared_data_key_name(k);
+
+    for (; *keys; keys++)
+        if (*keys == key)
+            return true;
+
+    return false;
+}
+
 static pa_hook_result_t call_state_cb(void *hook_data, void *call_data, void *slot_data) {
     const char *key       = call_data;
     struct mv_userdata *u = slot_data;
@@ -247,7 +270,7 @@ static pa_hook_result_t call_state_cb(void *hook_data, void *call_data, void *sl
     pa_assert(u);
     pa_assert(u->current_steps);
 
-    if ((str = pa_shared_data_gets(u->shared, key))) {
+    if ((str = pa_shared_data_gets_key(u->shared, u->call_state_key))) {
         if (pa_streq(str, PA_NEMO_PROP_CALL_STATE_ACTIVE)) {
             u->call_active = true;
             u->voip_active = false;
@@ -280,6 +303,11 @@ static pa_hook_result_t call_state_cb(void *hook_data, void *call_data, void *sl
     /* Notify users of new call status. */
     dbus_signal_call_status(u);
 
+    /* Media state depends on call state, so when both change at once
+     * update media state only after call state is known. */
+    if (changed_together(u, u->media_state_key) && update_policy_media_state(u))
+        update_media_state(u);
+
     return PA_HOOK_OK;
 }
 
@@ -302,27 +330,38 @@ static void update_media_state(struct mv_userdata *u) {
     }
 }
 
-static pa_hook_result_t media_state_cb(void *hook_data, void *call_data, void *slot_data) {
-    const char *key       = call_data;
-    struct mv_userdata *u = slot_data;
-
+static bool update_policy_media_state(struct mv_userdata *u) {
     const char *str;
     media_state_t state;
 
-    pa_assert(key);
     pa_assert(u);
 
-    if (!(str = pa_shared_data_gets(u->shared, key)))
-        return PA_HOOK_OK;
+    if (!(str = pa_shared_data_gets_key(u->shared, u->media_state_key)))
+        return false;
 
     if (!mv_media_state_from_string(str, &state)) {
         pa_log_warn("Unknown media state %s", str);
-        return PA_HOOK_OK;
+        return false;
     }
 
     u->notifier.policy_media_state = state;
 
-    update_media_state(u);
+    return true;
+}
+
+static pa_hook_result_t media_state_cb(void *hook_data, void *call_data, void *slot_data) {
+    const char *key       = call_data;
+    struct mv_userdata *u = slot_data;
+
+    pa_assert(key);
+    pa_assert(u);
+
+    /* Handled in call_state_cb() */
+    if (changed_together(u, u->call_state_key))
+        return PA_HOOK_OK;
+
+    if (update_policy_media_state(u))
+        update_media_state(u);
 
     return PA_HOOK_OK;
 }
@@ -340,14 +379,14 @@ static void update_emergency_call_state(struct mv_userdata *u, bool new_state) {
         update_virtual_stream(u);
         steps = mv_active_steps(u);
 
-        pa_volume_proxy_get_volume(u->volume_proxy, CALL_STREAM, &vol);
+        pa_volume_proxy_get_volume_key(u->volume_proxy, u->call_stream_key, &vol);
 
         if (u->emergency_call_active)
             pa_cvolume_set(&vol, vol.channels, mv_step_value(steps, steps->n_steps - 1));
         else
             pa_cvolume_set(&vol, vol.channels, mv_step_value(steps, steps->current_step));
 
-        pa_volume_proxy_set_volume(u->volume_proxy, CALL_STREAM, &vol, false);
+        pa_volume_proxy_set_volume_key(u->volume_proxy, u->call_stream_key, &vol, false);
     }
 }
 
@@ -360,7 +399,7 @@ static pa_hook_result_t emergency_call_state_cb(void *hook_data, void *call_data
     pa_assert(key);
     pa_assert(u);
 
-    if (!(str = pa_shared_data_gets(u->shared, key)))
+    if (!(str = pa_shared_data_gets_key(u->shared, u->emergency_call_state_key)))
         return PA_HOOK_OK;
 
     update_emergency_call_state(u, pa_streq(str, PA_NEMO_PROP_EMERGENCY_CALL_STATE_ACTIVE));
@@ -448,14 +487,13 @@ static void volume_sync_delayed_unmute_set(struct mv_userdata *u) {
 }
 
 static pa_hook_result_t volume_sync_cb(void *hook_data, void *call_data, void *slot_data) {
-    const char *key       = call_data;
     struct mv_userdata *u = slot_data;
 
     pa_sink_input *si;
     uint32_t idx;
     int32_t state;
 
-    if (pa_shared_data_get_integer(u->shared, key, &state) == 0) {
+    if (pa_shared_data_get_integer_key(u->shared, u->volume_sync_key, &state) == 0) {
         if (u->prev_state != PA_SAILFISHOS_MEDIA_VOLUME_IN_SYNC &&
             state         == PA_SAILFISHOS_MEDIA_VOLUME_IN_SYNC) {
 
@@ -529,8 +567,8 @@ static pa_hook_result_t parameters_changed_cb(void *hook_data, void *call_data,
     pa_assert(ua);
     pa_assert(u);
 
-    pa_shared_data_inc_integer(u->shared, PA_SAILFISHOS_MEDIA_VOLUME_SYNC,
-                                          PA_SAILFISHOS_MEDIA_VOLUME_CHANGING);
+    pa_shared_data_inc_integer_key(u->shared, u->volume_sync_key,
+                                              PA_SAILFISHOS_MEDIA_VOLUME_CHANGING);
 
     if (u->route)
         pa_xfree(u->route);
@@ -587,29 +625,29 @@ static pa_hook_result_t parameters_changed_cb(void *hook_data, void *call_data,
         check_notifier(u);
     }
 
-    /* When mode changes immediately send HighVolume signal
-     * containing the safe step if one is defined */
+    /* When mode changes queue HighVolume signal containing the safe
+     * step if one is defined, it is sent after signal_delay */
     check_and_signal_high_volume(u);
 
-    pa_shared_data_inc_integer(u->shared, PA_SAILFISHOS_MEDIA_VOLUME_SYNC,
-                                          PA_SAILFISHOS_MEDIA_VOLUME_CHANGE_DONE);
+    pa_shared_data_inc_integer_key(u->shared, u->volume_sync_key,
+                                              PA_SAILFISHOS_MEDIA_VOLUME_CHANGE_DONE);
 
     return PA_HOOK_OK;
 }
 
 static bool step_and_call_values(struct mv_userdata *u,
-                                 const char *name,
+                                 const pa_volume_proxy_entry *e,
                                  struct mv_volume_steps **steps,
                                  bool *call_steps) {
-    if (pa_streq(name, CALL_STREAM)) {
+    if (pa_volume_proxy_key_matches(u->call_stream_key, e)) {
         *steps = &u->current_steps->call;
         *call_steps = true;
         return true;
-    } else if (pa_streq(name, VOIP_STREAM)) {
+    } else if (pa_volume_proxy_key_matches(u->voip_stream_key, e)) {
         *steps = &u->current_steps->voip;
         *call_steps = true;
         return true;
-    } else if (pa_streq(name, MEDIA_STREAM)) {
+    } else if (pa_volume_proxy_key_matches(u->media_stream_key, e)) {
         *steps = &u->current_steps->media;
         *call_steps = false;
         return true;
@@ -627,10 +665,10 @@ static pa_hook_result_t volume_changing_cb(void *hook_data, void *call_data, voi
 
     pa_assert(u);
 
-    if (!step_and_call_values(u, e->name, &steps, &call_steps))
+    if (!step_and_call_values(u, e, &steps, &call_steps))
         return PA_HOOK_OK;
 
-    if (u->emergency_call_active && pa_streq(e->name, CALL_STREAM)) {
+    if (u->emergency_call_active && pa_volume_proxy_key_matches(u->call_stream_key, e)) {
         pa_log_info("Reset call volume to maximum with emergency call.");
         pa_cvolume_set(&e->volume, e->volume.channels, mv_step_value(steps, steps->n_steps - 1));
         return PA_HOOK_OK;
@@ -662,7 +700,7 @@ static pa_hook_result_t volume_changed_cb(void *hook_data, void *call_data, void
 
     pa_assert(u);
 
-    if (!step_and_call_values(u, e->name, &steps, &call_steps))
+    if (!step_and_call_values(u, e, &steps, &call_steps))
         return PA_HOOK_OK;
 
     new_step = mv_search_step(steps->step, steps->n_steps, pa_cvolume_avg(&e->volume));
@@ -691,7 +729,7 @@ static void check_notifier(struct mv_userdata *u) {
     else
         mv_listening_watchdog_pause(u->notifier.watchdog);
 
-    u->notifier.streams_active = u->notifier.enabled_slots ? true : false;
+    u->notifier.streams_active = u->notifier.running_streams > 0;
     update_media_state(u);
 }
 
@@ -710,37 +748,19 @@ static void notify_event_cb(struct mv_listening_watchdog *wd, bool initial_notif
     }
 }
 
-static uint32_t acquire_slot(struct mv_userdata *u) {
-    uint32_t i;
-    uint32_t slot;
-
-    pa_assert(u);
-
-    if (!u->notifier.free_slots) {
-        pa_log_warn("All sink-input watcher slots taken.");
-        return 0;
-    }
+/* Values stored in notifier.sink_inputs, non-zero so that they can be
+ * told apart from missing entries. */
+#define NOTIFIER_STREAM_IDLE    (1)
+#define NOTIFIER_STREAM_RUNNING (2)
 
-    for (i = 0; i < 32; i++) {
-        slot = (1 << i);
-        if (u->notifier.free_slots & slot) {
-            u->notifier.free_slots &= ~slot;
-            return slot;
-        }
-    }
-    return 0;
-}
-
-static void release_slot(struct mv_userdata *u, uint32_t slot) {
-    pa_assert(u);
-
-    u->notifier.free_slots |= slot;
+static uint32_t notifier_stream_state(pa_sink_input *si) {
+    return si->state == PA_SINK_INPUT_RUNNING ? NOTIFIER_STREAM_RUNNING : NOTIFIER_STREAM_IDLE;
 }
 
 static pa_hook_result_t sink_input_put_cb(pa_core *c, pa_object *o, struct mv_userdata *u) {
     pa_sink_input *si;
     const char *role;
-    uint32_t slot;
+    uint32_t state;
 
     pa_assert(o);
     pa_assert(u);
@@ -757,20 +777,17 @@ static pa_hook_result_t sink_input_put_cb(pa_core *c, pa_object *o, struct mv_us
         /* Not our stream, skip */
         goto end;
 
-    if (!(slot = acquire_slot(u)))
-        /* All slots taken, skip */
-        goto end;
+    state = notifier_stream_state(si);
 
     pa_sink_input_ref(si);
-    if (pa_hashmap_put(u->notifier.sink_inputs, si, PA_UINT32_TO_PTR(slot))) {
+    if (pa_hashmap_put(u->notifier.sink_inputs, si, PA_UINT32_TO_PTR(state))) {
         /* Already in our hashmap? Shouldn't happen... */
         pa_sink_input_unref(si);
-        release_slot(u, slot);
         goto end;
     }
 
-    if (si->state == PA_SINK_INPUT_RUNNING)
-        u->notifier.enabled_slots |= slot;
+    if (state == NOTIFIER_STREAM_RUNNING)
+        u->notifier.running_streams++;
 
     check_notifier(u);
 
@@ -779,8 +796,9 @@ end:
 }
 static pa_hook_result_t sink_input_state_changed_cb(pa_core *c, pa_object *o, struct mv_userdata *u) {
     pa_sink_input *si;
-    uintptr_t *slot_ptr;
-    uint32_t slot;
+    void *state_ptr;
+    uint32_t old_state;
+    uint32_t state;
 
     pa_assert(o);
     pa_assert(u);
@@ -788,16 +806,26 @@ static pa_hook_result_t sink_input_state_changed_cb(pa_core *c, pa_object *o, st
 
     si = PA_SINK_INPUT(o);
 
-    if (!(slot_ptr = pa_hashmap_get(u->notifier.sink_inputs, si)))
+    if (!(state_ptr = pa_hashmap_get(u->notifier.sink_inputs, si)))
         /* Not our stream, skip */
         goto end;
 
-    slot = PA_PTR_TO_UINT32(slot_ptr);
+    old_state = PA_PTR_TO_UINT32(state_ptr);
+    state = notifier_stream_state(si);
 
-    if (si->state == PA_SINK_INPUT_RUNNING)
-        u->notifier.enabled_slots |= slot;
-    else
-        u->notifier.enabled_slots &= ~slot;
+    if (state == old_state)
+        goto end;
+
+    /* Keeps the reference taken in sink_input_put_cb(). */
+    pa_hashmap_remove(u->notifier.sink_inputs, si);
+    pa_assert_se(pa_hashmap_put(u->notifier.sink_inputs, si, PA_UINT32_TO_PTR(state)) == 0);
+
+    if (state == NOTIFIER_STREAM_RUNNING)
+        u->notifier.running_streams++;
+    else {
+        pa_assert(u->notifier.running_streams > 0);
+        u->notifier.running_streams--;
+    }
 
     check_notifier(u);
 
@@ -807,8 +835,7 @@ end:
 
 static pa_hook_result_t sink_input_unlink_cb(pa_core *c, pa_object *o, struct mv_userdata *u) {
     pa_sink_input *si;
-    uintptr_t *slot_ptr;
-    uint32_t slot;
+    void *state_ptr;
 
     pa_assert(o);
     pa_assert(u);
@@ -816,13 +843,14 @@ static pa_hook_result_t sink_input_unlink_cb(pa_core *c, pa_object *o, struct mv
 
     si = PA_SINK_INPUT(o);
 
-    if (!(slot_ptr = pa_hashmap_remove(u->notifier.sink_inputs, si)))
+    if (!(state_ptr = pa_hashmap_remove(u->notifier.sink_inputs, si)))
         /* Not our stream, skip */
         goto end;
 
-    slot = PA_PTR_TO_UINT32(slot_ptr);
-    u->notifier.enabled_slots &= ~slot;
-    release_slot(u, slot);
+    if (PA_PTR_TO_UINT32(state_ptr) == NOTIFIER_STREAM_RUNNING) {
+        pa_assert(u->notifier.running_streams > 0);
+        u->notifier.running_streams--;
+    }
 
     pa_sink_input_unref(si);
 
@@ -888,7 +916,6 @@ static void setup_notifier(struct mv_userdata *u, const char *conf_file) {
     u->notifier.timeout = timeout;
     u->notifier.roles = role_list;
     u->notifier.modes = mode_list;
-    u->notifier.free_slots = UINT32_MAX;
     u->notifier.sink_inputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
 
     u->notifier.sink_input_put_slot = pa_hook_connect(&u->core->hooks[PA_CORE_HOOK_SINK_INPUT_PUT], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_put_cb, u);
@@ -971,6 +998,7 @@ int pa__init(pa_module *m) {
     u->virtual_stream = false;
     u->mute_routing = DEFAULT_MUTE_ROUTING;
     u->volume_sync_delay_ms = DEFAULT_VOLUME_SYNC_DELAY_MS;
+    u->signal_delay_ms = DEFAULT_SIGNAL_DELAY_MS;
 
     if (pa_modargs_get_value_boolean(ma, "tuning_mode", &u->tuning_mode) < 0) {
         pa_log_error("tuning_mode expects boolean argument");
@@ -992,20 +1020,32 @@ int pa__init(pa_module *m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_u32(ma, "signal_delay", &u->signal_delay_ms) < 0) {
+        pa_log_error("signal_delay expects unsigned integer argument");
+        goto fail;
+    }
+
     notifier_conf = pa_modargs_get_value(ma, "listening_time_notifier_conf", NULL);
     setup_notifier(u, notifier_conf);
 
     u->shared = pa_shared_data_get(u->core);
-    u->call_state_hook_slot = pa_shared_data_connect(u->shared, PA_NEMO_PROP_CALL_STATE, call_state_cb, u);
-    u->media_state_hook_slot = pa_shared_data_connect(u->shared, PA_NEMO_PROP_MEDIA_STATE, media_state_cb, u);
-    u->emergency_call_state_hook_slot = pa_shared_data_connect(u->shared, PA_NEMO_PROP_EMERGENCY_CALL_STATE, emergency_call_state_cb, u);
+    u->call_state_key = pa_shared_data_key(u->shared, PA_NEMO_PROP_CALL_STATE);
+    u->media_state_key = pa_shared_data_key(u->shared, PA_NEMO_PROP_MEDIA_STATE);
+    u->emergency_call_state_key = pa_shared_data_key(u->shared, PA_NEMO_PROP_EMERGENCY_CALL_STATE);
+    u->volume_sync_key = pa_shared_data_key(u->shared, PA_SAILFISHOS_MEDIA_VOLUME_SYNC);
+    u->call_state_hook_slot = pa_shared_data_connect_key(u->shared, u->call_state_key, call_state_cb, u);
+    u->media_state_hook_slot = pa_shared_data_connect_key(u->shared, u->media_state_key, media_state_cb, u);
+    u->emergency_call_state_hook_slot = pa_shared_data_connect_key(u->shared, u->emergency_call_state_key, emergency_call_state_cb, u);
     if (u->mute_routing)
-        u->volume_sync_hook_slot = pa_shared_data_connect(u->shared,
-                                                          PA_SAILFISHOS_MEDIA_VOLUME_SYNC,
-                                                          volume_sync_cb, u);
+        u->volume_sync_hook_slot = pa_shared_data_connect_key(u->shared,
+                                                              u->volume_sync_key,
+                                                              volume_sync_cb, u);
     u->prev_state = PA_SAILFISHOS_MEDIA_VOLUME_IN_SYNC;
 
     u->volume_proxy = pa_volume_proxy_get(u->core);
+    u->media_stream_key = pa_volume_proxy_key(u->volume_proxy, MEDIA_STREAM);
+    u->call_stream_key = pa_volume_proxy_key(u->volume_proxy, CALL_STREAM);
+    u->voip_stream_key = pa_volume_proxy_key(u->volume_proxy, VOIP_STREAM);
     u->volume_proxy_slot = pa_hook_connect(&pa_volume_proxy_hooks(u->volume_proxy)[PA_VOLUME_PROXY_HOOK_CHANGING],
                                            PA_HOOK_NORMAL,
                                            volume_changing_cb,
@@ -1084,7 +1124,7 @@ void pa__done(pa_module *m) {
  */
 
 #define MAINVOLUME_API_MAJOR (2)
-#define MAINVOLUME_API_MINOR (3)
+#define MAINVOLUME_API_MINOR (4)
 #define MAINVOLUME_PATH "/com/meego/mainvolume2"
 #define MAINVOLUME_IFACE "com.Meego.MainVolume2"
 
@@ -1152,6 +1192,7 @@ enum mainvolume_signal_index {
     MAINVOLUME_SIGNAL_HIGH_VOLUME,      /* Notify user that current volume is harmful for hearing. */
     MAINVOLUME_SIGNAL_CALL_STATE,       /* Notify user of current call state. */
     MAINVOLUME_SIGNAL_MEDIA_STATE,      /* Notify user about media state. */
+    MAINVOLUME_SIGNAL_PROPERTIES_CHANGED, /* All properties changed since last signal, in one signal. */
     MAINVOLUME_SIGNAL_MAX
 };
 
@@ -1172,6 +1213,10 @@ static pa_dbus_arg_info media_or_call_state_args[] = {
     {"State", "s", NULL}
 };
 
+static pa_dbus_arg_info properties_changed_args[] = {
+    {"Properties", "a{sv}", NULL}
+};
+
 static pa_dbus_signal_info mainvolume_signals[MAINVOLUME_SIGNAL_MAX] = {
     [MAINVOLUME_SIGNAL_STEPS_UPDATED] = {
         .name = "StepsUpdated",
@@ -1197,6 +1242,11 @@ static pa_dbus_signal_info mainvolume_signals[MAINVOLUME_SIGNAL_MAX] = {
         .name = "MediaStateChanged",
         .arguments = media_or_call_state_args,
         .n_arguments = 1
+    },
+    [MAINVOLUME_SIGNAL_PROPERTIES_CHANGED] = {
+        .name = "PropertiesChanged",
+        .arguments = properties_changed_args,
+        .n_arguments = 1
     }
 };
 
@@ -1222,16 +1272,73 @@ void dbus_init(struct mv_userdata *u) {
     pa_dbus_protocol_register_extension(u->dbus_protocol, MAINVOLUME_IFACE);
 }
 
+static void dbus_signal_queue_flush(struct mv_userdata *u);
+
 void dbus_done(struct mv_userdata *u) {
     pa_assert(u);
 
+    /* Don't lose signals still waiting for signal_delay. */
+    dbus_signal_queue_flush(u);
+
     pa_dbus_protocol_unregister_extension(u->dbus_protocol, MAINVOLUME_IFACE);
     pa_dbus_protocol_remove_interface(u->dbus_protocol, u->dbus_path, mainvolume_info.name);
     pa_xfree(u->dbus_path);
     pa_dbus_protocol_unref(u->dbus_protocol);
+    u->dbus_protocol = NULL;
+}
+
+static void signal_queue_time_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
+    struct mv_userdata *u = userdata;
+
+    pa_assert(a);
+    pa_assert(e);
+    pa_assert(u);
+    pa_assert(e == u->signal_queue_time_event);
+
+    dbus_signal_queue_flush(u);
+}
+
+/* Queue signal, only latest state is sent if the same signal is queued
+ * again before queue is flushed. */
+static void dbus_signal_queue(struct mv_userdata *u, enum mainvolume_signal_index signal) {
+    pa_assert(u);
+
+    if (!u->dbus_protocol)
+        return;
+
+    u->signal_queue |= 1U << signal;
+
+    if (!u->signal_queue_time_event)
+        u->signal_queue_time_event = pa_core_rttime_new(u->core,
+                                                        pa_rtclock_now() + u->signal_delay_ms * PA_USEC_PER_MSEC,
+                                                        signal_queue_time_cb,
+                                                        u);
 }
 
 static void dbus_signal_call_status(struct mv_userdata *u) {
+    dbus_signal_queue(u, MAINVOLUME_SIGNAL_CALL_STATE);
+}
+
+static void dbus_signal_high_volume(struct mv_userdata *u, uint32_t safe_step) {
+    u->queued_safe_step = safe_step;
+    dbus_signal_queue(u, MAINVOLUME_SIGNAL_HIGH_VOLUME);
+}
+
+void dbus_signal_steps(struct mv_userdata *u) {
+    dbus_signal_queue(u, MAINVOLUME_SIGNAL_STEPS_UPDATED);
+    u->last_signal_timestamp = pa_rtclock_now();
+}
+
+static void dbus_signal_listening_notifier(struct mv_userdata *u, uint32_t timeout) {
+    u->queued_listening_time = timeout;
+    dbus_signal_queue(u, MAINVOLUME_SIGNAL_NOTIFY_LISTENER);
+}
+
+static void dbus_signal_media_state(struct mv_userdata *u) {
+    dbus_signal_queue(u, MAINVOLUME_SIGNAL_MEDIA_STATE);
+}
+
+static void dbus_send_call_status(struct mv_userdata *u) {
     DBusMessage *signal;
     const char *state_str;
 
@@ -1251,7 +1358,7 @@ static void dbus_signal_call_status(struct mv_userdata *u) {
     pa_log_debug("Signal %s. State: %s", mainvolume_signals[MAINVOLUME_SIGNAL_CALL_STATE].name, state_str);
 }
 
-static void dbus_signal_high_volume(struct mv_userdata *u, uint32_t safe_step) {
+static void dbus_send_high_volume(struct mv_userdata *u, uint32_t safe_step) {
     DBusMessage *signal;
 
     pa_assert(u);
@@ -1268,7 +1375,7 @@ static void dbus_signal_high_volume(struct mv_userdata *u, uint32_t safe_step) {
     pa_log_debug("Signal %s. Safe step: %u", mainvolume_signals[MAINVOLUME_SIGNAL_HIGH_VOLUME].name, safe_step);
 }
 
-void dbus_signal_steps(struct mv_userdata *u) {
+static void dbus_send_steps(struct mv_userdata *u) {
     DBusMessage *signal;
     struct mv_volume_steps *steps;
     uint32_t current_step;
@@ -1295,11 +1402,9 @@ void dbus_signal_steps(struct mv_userdata *u) {
                                           DBUS_TYPE_INVALID));
     pa_dbus_protocol_send_signal(u->dbus_protocol, signal);
     dbus_message_unref(signal);
-
-    u->last_signal_timestamp = pa_rtclock_now();
 }
 
-static void dbus_signal_listening_notifier(struct mv_userdata *u, uint32_t timeout) {
+static void dbus_send_listening_notifier(struct mv_userdata *u, uint32_t timeout) {
     DBusMessage *signal;
 
     pa_assert(u);
@@ -1315,7 +1420,7 @@ static void dbus_signal_listening_notifier(struct mv_userdata *u, uint32_t timeo
     dbus_message_unref(signal);
 }
 
-static void dbus_signal_media_state(struct mv_userdata *u) {
+static void dbus_send_media_state(struct mv_userdata *u) {
     DBusMessage *signal;
     const char *state;
 
@@ -1337,6 +1442,98 @@ static void dbus_signal_media_state(struct mv_userdata *u) {
 }
 
 
+static void dbus_send_properties_changed(struct mv_userdata *u, uint32_t queue) {
+    DBusMessage *signal;
+    DBusMessageIter msg_iter;
+    DBusMessageIter dict_iter;
+    struct mv_volume_steps *steps;
+    uint32_t step_count;
+    uint32_t current_step;
+    uint32_t high_volume_step = 0;
+    const char *state;
+
+    pa_assert(u);
+
+    pa_assert_se((signal = dbus_message_new_signal(MAINVOLUME_PATH,
+                                                   MAINVOLUME_IFACE,
+                                                   mainvolume_signals[MAINVOLUME_SIGNAL_PROPERTIES_CHANGED].name)));
+    dbus_message_iter_init_append(signal, &msg_iter);
+    pa_assert_se(dbus_message_iter_open_container(&msg_iter, DBUS_TYPE_ARRAY, "{sv}", &dict_iter));
+
+    if (queue & (1U << MAINVOLUME_SIGNAL_STEPS_UPDATED)) {
+        steps = mv_active_steps(u);
+        step_count = steps->n_steps;
+        current_step = u->emergency_call_active ? steps->n_steps - 1 : steps->current_step;
+        pa_dbus_append_basic_variant_dict_entry(&dict_iter,
+                                                mainvolume_handlers[MAINVOLUME_HANDLER_STEP_COUNT].property_name,
+                                                DBUS_TYPE_UINT32, &step_count);
+        pa_dbus_append_basic_variant_dict_entry(&dict_iter,
+                                                mainvolume_handlers[MAINVOLUME_HANDLER_CURRENT_STEP].property_name,
+                                                DBUS_TYPE_UINT32, &current_step);
+    }
+
+    if (queue & (1U << MAINVOLUME_SIGNAL_HIGH_VOLUME)) {
+        if (mv_has_high_volume(u))
+            high_volume_step = mv_safe_step(u) + 1;
+        pa_dbus_append_basic_variant_dict_entry(&dict_iter,
+                                                mainvolume_handlers[MAINVOLUME_HANDLER_HIGH_VOLUME].property_name,
+                                                DBUS_TYPE_UINT32, &high_volume_step);
+    }
+
+    if (queue & (1U << MAINVOLUME_SIGNAL_CALL_STATE)) {
+        state = u->call_active ? PA_NEMO_PROP_CALL_STATE_ACTIVE : PA_NEMO_PROP_CALL_STATE_INACTIVE;
+        pa_dbus_append_basic_variant_dict_entry(&dict_iter,
+                                                mainvolume_handlers[MAINVOLUME_HANDLER_CALL_STATE].property_name,
+                                                DBUS_TYPE_STRING, &state);
+    }
+
+    if (queue & (1U << MAINVOLUME_SIGNAL_MEDIA_STATE)) {
+        state = mv_media_state_from_enum(u->notifier.media_state);
+        pa_dbus_append_basic_variant_dict_entry(&dict_iter,
+                                                mainvolume_handlers[MAINVOLUME_HANDLER_MEDIA_STATE].property_name,
+                                                DBUS_TYPE_STRING, &state);
+    }
+
+    pa_assert_se(dbus_message_iter_close_container(&msg_iter, &dict_iter));
+
+    pa_dbus_protocol_send_signal(u->dbus_protocol, signal);
+    dbus_message_unref(signal);
+}
+
+/* Send all queued signals, each with the latest state, followed by
+ * PropertiesChanged carrying every property that changed. */
+static void dbus_signal_queue_flush(struct mv_userdata *u) {
+    uint32_t queue;
+
+    pa_assert(u);
+
+    if (u->signal_queue_time_event) {
+        u->core->mainloop->time_free(u->signal_queue_time_event);
+        u->signal_queue_time_event = NULL;
+    }
+
+    queue = u->signal_queue;
+    u->signal_queue = 0;
+
+    if (queue & (1U << MAINVOLUME_SIGNAL_CALL_STATE))
+        dbus_send_call_status(u);
+
+    if (queue & (1U << MAINVOLUME_SIGNAL_MEDIA_STATE))
+        dbus_send_media_state(u);
+
+    if (queue & (1U << MAINVOLUME_SIGNAL_HIGH_VOLUME))
+        dbus_send_high_volume(u, u->queued_safe_step);
+
+    if (queue & (1U << MAINVOLUME_SIGNAL_STEPS_UPDATED))
+        dbus_send_steps(u);
+
+    if (queue & (1U << MAINVOLUME_SIGNAL_NOTIFY_LISTENER))
+        dbus_send_listening_notifier(u, u->queued_listening_time);
+
+    if (queue & ~(1U << MAINVOLUME_SIGNAL_NOTIFY_LISTENER))
+        dbus_send_properties_changed(u, queue);
+}
+
 void mainvolume_get_revision(DBusConnection *conn, DBusMessage *msg, void *_u) {
     uint32_t rev = MAINVOLUME_API_MINOR;
     pa_dbus_send_basic_value_reply(conn, msg, DBUS_TYPE_UINT32, &rev);
@@ -1374,19 +1571,19 @@ void mainvolume_get_current_step(DBusConnection *conn, DBusMessage *msg, void *_
     pa_dbus_send_basic_variant_reply(conn, msg, DBUS_TYPE_UINT32, &step);
 }
 
-static const char *active_stream_type(struct mv_userdata *u) {
+static pa_volume_proxy_key_t *active_stream_key(struct mv_userdata *u) {
     if (u->voip_active)
-        return VOIP_STREAM;
+        return u->voip_stream_key;
     else if (u->call_active)
-        return CALL_STREAM;
+        return u->call_stream_key;
 
-    return MEDIA_STREAM;
+    return u->media_stream_key;
 }
 
 void mainvolume_set_current_step(DBusConnection *conn, DBusMessage *msg, DBusMessageIter *iter, void *_u) {
     struct mv_userdata *u = (struct mv_userdata*)_u;
     struct mv_volume_steps *steps;
-    const char *stream;
+    pa_volume_proxy_key_t *stream;
     pa_cvolume vol;
     uint32_t set_step;
 
@@ -1412,10 +1609,10 @@ void mainvolume_set_current_step(DBusConnection *conn, DBusMessage *msg, DBusMes
     }
 
     if (mv_set_step(u, set_step)) {
-        stream = active_stream_type(u);
-        pa_volume_proxy_get_volume(u->volume_proxy, stream, &vol);
+        stream = active_stream_key(u);
+        pa_volume_proxy_get_volume_key(u->volume_proxy, stream, &vol);
         pa_cvolume_set(&vol, vol.channels, mv_current_step_value(u));
-        pa_volume_proxy_set_volume(u->volume_proxy, stream, &vol, false);
+        pa_volume_proxy_set_volume_key(u->volume_proxy, stream, &vol, false);
     }
 
 done:
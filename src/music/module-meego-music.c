@@ -46,6 +46,8 @@
 #include "algorithm-hook.h"
 #include "optimized.h"
 #include "pa-optimized.h"
+#include "trace.h"
+#include "capture.h"
 
 #include "module-music-api.h"
 
@@ -85,6 +87,9 @@ struct userdata {
 
     meego_algorithm_hook *hook_algorithm;
     meego_algorithm_hook *hook_volume;
+
+    meego_capture *capture;
+    meego_capture_tap *tap_out;
 };
 
 
@@ -211,6 +216,8 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *chunk
     u = i->userdata;
     pa_assert(chunk && u);
 
+    meego_trace_begin("music");
+
     if (u->sink->thread_info.rewind_requested)
         pa_sink_process_rewind(u->sink, 0);
 
@@ -254,6 +261,10 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *chunk
         }
     }
 
+    meego_capture_tap_write(u->tap_out, chunk);
+
+    meego_trace_end("music");
+
     return 0;
 }
 
@@ -543,6 +554,9 @@ int pa__init(pa_module*m) {
     //u->window_size = 160;
     //u->window_size = 960;
     pa_log_debug("window size: %zu frame size: %zu",  u->window_size, pa_frame_size(&ss));
+
+    u->capture = meego_capture_get(m->core);
+    u->tap_out = meego_capture_tap_new(u->capture, "music-out", &ss);
     u->master_sink = master_sink;
     u->sink = NULL;
     u->sink_input = NULL;
@@ -658,6 +672,12 @@ void pa__done(pa_module*m) {
         pa_sink_unref(u->sink);
     }
 
+    if (u->tap_out)
+        meego_capture_tap_free(u->tap_out);
+
+    if (u->capture)
+        meego_capture_unref(u->capture);
+
     if (u->silence_memchunk.memblock)
         pa_memblock_unref(u->silence_memchunk.memblock);
 
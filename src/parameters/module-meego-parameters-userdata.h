@@ -29,6 +29,8 @@
 
 #include <pulsecore/core.h>
 #include <pulsecore/modargs.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
 
 #include <meego/parameter-hook-implementor.h>
 #include <meego/shared-data.h>
@@ -45,9 +47,12 @@ struct userdata {
     struct parameters {
         const char *directory;
         bool cache;
+        bool watch;
         bool use_voice;
-        PA_LLIST_HEAD(struct mode, modes); /* list of all modes */
-        PA_LLIST_HEAD(struct algorithm, algorithms); /* list of all algorithms */
+        pa_hashmap *modes; /* mode name -> struct mode */
+        pa_hashmap *algorithms; /* algorithm name -> struct algorithm */
+        pa_idxset *active; /* algorithms that are enabled or want full updates */
+        struct parameters_loader *loader;
     } parameters;
 
     meego_parameter_hook_implementor_args implementor_args;
@@ -57,6 +62,8 @@ struct userdata {
     pa_hook_slot *mode_changed_slot;
 
     pa_shared_data *shared;
+    pa_shared_data_key_t *mode_key;
+    pa_shared_data_key_t *hwid_key;
 };
 
 #endif
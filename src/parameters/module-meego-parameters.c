@@ -38,6 +38,7 @@ PA_MODULE_AUTHOR("Pekka Ervasti");
 PA_MODULE_DESCRIPTION("Meego parameters module");
 PA_MODULE_USAGE("directory=<parameter directory> "
                 "cache=<boolean> "
+                "watch=<boolean, reload parameters when files change, default true> "
                 "initial_mode=<the mode in which to start> "
                 "use_voice=<true/false use voice module for mode detection, default true>");
 PA_MODULE_VERSION(PACKAGE_VERSION);
@@ -45,6 +46,7 @@ PA_MODULE_VERSION(PACKAGE_VERSION);
 static const char* const valid_modargs[] = {
     "directory",
     "cache",
+    "watch",
     "initial_mode",
     "use_voice",
     NULL,
@@ -111,8 +113,8 @@ static pa_hook_result_t mode_changed_hook_callback(pa_core *c, const char *key,
     pa_assert(key);
     pa_assert(u);
 
-    mode = pa_shared_data_gets(u->shared, key);
-    hwid = pa_shared_data_gets(u->shared, PA_NOKIA_PROP_AUDIO_ACCESSORY_HWID);
+    mode = pa_shared_data_gets_key(u->shared, u->mode_key);
+    hwid = pa_shared_data_gets_key(u->shared, u->hwid_key);
 
     if (mode) {
         mode_hwid = pa_sprintf_malloc("%s%s", mode, hwid ? hwid : "");
@@ -141,6 +143,7 @@ int pa__init(pa_module *m) {
     u->core = m->core;
     u->module = m;
     u->parameters.use_voice = true;
+    u->parameters.watch = true;
 
     u->parameters.directory = pa_xstrdup(pa_modargs_get_value(ma, "directory", DEFAULT_DIRECTORY));
 
@@ -154,6 +157,11 @@ int pa__init(pa_module *m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "watch", &u->parameters.watch) < 0) {
+        pa_log("watch= expects a boolean argument.");
+        goto fail;
+    }
+
     if (!(u->shared = pa_shared_data_get(u->core))) {
         pa_log("Failed to get shared data object.");
         goto fail;
@@ -168,7 +176,9 @@ int pa__init(pa_module *m) {
         u->sink_proplist_changed_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_PROPLIST_CHANGED], PA_HOOK_NORMAL, (pa_hook_cb_t) sink_proplist_changed_hook_callback, u);
         u->sink_input_move_finished_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_FINISH], PA_HOOK_NORMAL, (pa_hook_cb_t) hw_sink_input_move_finish_cb, u);
     } else {
-        u->mode_changed_slot = pa_shared_data_connect(u->shared, PA_NOKIA_PROP_AUDIO_MODE, (pa_hook_cb_t) mode_changed_hook_callback, u);
+        u->mode_key = pa_shared_data_key(u->shared, PA_NOKIA_PROP_AUDIO_MODE);
+        u->hwid_key = pa_shared_data_key(u->shared, PA_NOKIA_PROP_AUDIO_ACCESSORY_HWID);
+        u->mode_changed_slot = pa_shared_data_connect_key(u->shared, u->mode_key, (pa_hook_cb_t) mode_changed_hook_callback, u);
     }
 
     pa_modargs_free(ma);
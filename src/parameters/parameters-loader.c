@@ -0,0 +1,611 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/core-rtclock.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/msgobject.h>
+
+#include "parameters-loader.h"
+
+/* Bursts of file system changes, like a tuning tool rewriting a bunch of
+ * sets, are collected into one scan after things have been quiet this long. */
+#define RESCAN_DELAY_USEC (500 * PA_USEC_PER_MSEC)
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB)
+
+struct parameters_loader {
+    pa_msgobject parent;
+
+    pa_core *core;
+    pa_module *module;
+    char *directory;
+
+    pa_thread *thread;
+    pa_thread_mq thread_mq;
+    pa_rtpoll *rtpoll;
+
+    /* Written by the loader thread, taken by the main thread. */
+    pa_atomic_ptr_t published;
+
+    /* Loader thread only. */
+    int inotify_fd;
+    pa_rtpoll_item *inotify_item;
+    pa_usec_t rescan_time;
+    unsigned scan_generation;
+
+    /* Main thread only. */
+    parameters_snapshot *current;
+    parameters_snapshot *previous;
+    unsigned generation;
+    parameters_loader_cb_t published_cb;
+    void *userdata;
+};
+
+enum {
+    LOADER_MESSAGE_SCAN,
+    LOADER_MESSAGE_PUBLISHED,
+    LOADER_MESSAGE_MAX
+};
+
+PA_DEFINE_PRIVATE_CLASS(parameters_loader, pa_msgobject);
+#define PARAMETERS_LOADER(o) (parameters_loader_cast(o))
+
+static char *readlink_malloc(const char *filename) {
+    int size = 100;
+    int nchars;
+    char *buffer = NULL;
+
+    while (1) {
+        buffer = (char *)realloc(buffer, size);
+        nchars = readlink(filename, buffer, size);
+        if (nchars < 0) {
+            free(buffer);
+            return NULL;
+        }
+        if (nchars < (size - 1)) {
+            buffer[nchars] = '\0';
+            return buffer;
+        }
+        size *= 2;
+    }
+}
+
+static char *set_readlink_abs(const char *path, const char *sym) {
+    char *name;
+    char *sym_value;
+    char *abs_name;
+
+    name = pa_sprintf_malloc("%s/%s", path, sym);
+    sym_value = readlink_malloc(name);
+    pa_xfree(name);
+
+    if (!sym_value)
+        return NULL;
+
+    name = pa_sprintf_malloc("%s/%s", path, sym_value);
+    pa_xfree(sym_value);
+
+    abs_name = canonicalize_file_name(name);
+    pa_xfree(name);
+
+    return abs_name;
+}
+
+static int file_select(const struct dirent *entry) {
+    return entry->d_name[0] != '.';
+}
+
+void *parameters_set_read(const char *file, unsigned *length) {
+    FILE *fp;
+    char *s = NULL;
+    struct stat buf;
+    size_t c = 0;
+
+    if (!stat(file, &buf)) {
+        if ((fp = fopen(file, "r")) != NULL) {
+            s = pa_xmalloc((size_t)(buf.st_size + sizeof(char)));
+            c = fread(s, 1, (size_t)buf.st_size, fp);
+            fclose(fp);
+
+            /* The file may be rewritten while we read it */
+            if (c != (size_t)buf.st_size) {
+                pa_log_warn("Short read from %s", file);
+                pa_xfree(s);
+                *length = 0;
+                return NULL;
+            }
+
+            s[c] = '\0';
+        }
+    }
+
+    *length = c;
+    return s;
+}
+
+char *parameters_set_resolve(const char *directory, const char *mode, const char *algorithm) {
+    char *path;
+    char *setname;
+
+    path = pa_sprintf_malloc("%s/modes/%s", directory, mode);
+    setname = set_readlink_abs(path, algorithm);
+    pa_xfree(path);
+
+    return setname;
+}
+
+pa_hashmap *parameters_mode_scan(const char *directory, const char *mode) {
+    struct dirent **namelist;
+    pa_hashmap *sets = NULL;
+    char *path;
+    char *sym;
+    char *setname;
+    int n;
+
+    path = pa_sprintf_malloc("%s/modes/%s", directory, mode);
+
+    pa_log_debug("Scanning mode from %s", path);
+
+    if ((n = scandir(path, &namelist, file_select, alphasort)) >= 0) {
+        sets = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, pa_xfree, pa_xfree);
+
+        while (n--) {
+            sym = namelist[n]->d_name;
+            pa_log_debug("Checking symlink value %s", sym);
+
+            if ((setname = set_readlink_abs(path, sym)) != NULL)
+                pa_hashmap_put(sets, pa_xstrdup(sym), setname);
+            else
+                pa_log_debug("%s is not a symlink", sym);
+
+            pa_xfree(namelist[n]);
+        }
+        pa_xfree(namelist);
+    }
+
+    pa_xfree(path);
+
+    return sets;
+}
+
+static void set_data_free(parameters_set_data *d) {
+    pa_xfree(d->name);
+    pa_xfree(d->data);
+    pa_xfree(d);
+}
+
+void parameters_snapshot_free(parameters_snapshot *snapshot) {
+    if (!snapshot)
+        return;
+
+    pa_hashmap_free(snapshot->modes);
+    pa_hashmap_free(snapshot->sets);
+    pa_xfree(snapshot);
+}
+
+parameters_snapshot *parameters_snapshot_scan(const char *directory) {
+    parameters_snapshot *snapshot;
+    parameters_set_data *d;
+    struct dirent **namelist;
+    pa_hashmap *sets;
+    const char *setname;
+    void *state;
+    char *path;
+    int n;
+
+    pa_assert(directory);
+
+    path = pa_sprintf_malloc("%s/modes", directory);
+
+    if ((n = scandir(path, &namelist, file_select, alphasort)) < 0) {
+        pa_log_warn("Could not scan modes from %s", path);
+        pa_xfree(path);
+        return NULL;
+    }
+
+    snapshot = pa_xnew0(parameters_snapshot, 1);
+    snapshot->modes = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                                          pa_xfree, (pa_free_cb_t) pa_hashmap_free);
+    snapshot->sets = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                                         NULL, (pa_free_cb_t) set_data_free);
+
+    while (n--) {
+        if ((sets = parameters_mode_scan(directory, namelist[n]->d_name))) {
+            PA_HASHMAP_FOREACH(setname, sets, state) {
+                if (pa_hashmap_get(snapshot->sets, setname))
+                    continue;
+
+                d = pa_xnew0(parameters_set_data, 1);
+                d->name = pa_xstrdup(setname);
+
+                /* Users of a set missing from the snapshot keep their
+                 * previous parameters. */
+                if (!(d->data = parameters_set_read(d->name, &d->length))) {
+                    pa_log_warn("Could not read set %s, skipping it", d->name);
+                    set_data_free(d);
+                    continue;
+                }
+
+                pa_hashmap_put(snapshot->sets, d->name, d);
+            }
+
+            pa_hashmap_put(snapshot->modes, pa_xstrdup(namelist[n]->d_name), sets);
+        }
+        pa_xfree(namelist[n]);
+    }
+    pa_xfree(namelist);
+    pa_xfree(path);
+
+    pa_log_debug("Scanned %u modes with %u sets", pa_hashmap_size(snapshot->modes), pa_hashmap_size(snapshot->sets));
+
+    return snapshot;
+}
+
+static void add_watch(parameters_loader *l, const char *path) {
+    if (inotify_add_watch(l->inotify_fd, path, WATCH_MASK) < 0)
+        pa_log_warn("Failed to watch %s: %s", path, pa_cstrerror(errno));
+}
+
+/* Called from loader thread. Watching the same path again is a no-op, and
+ * watches of removed directories go away by themselves. Without a snapshot
+ * only the top directories are watched, so that a failed scan is retried
+ * once the files are fixed. */
+static void loader_watch(parameters_loader *l, const parameters_snapshot *snapshot) {
+    pa_idxset *dirs;
+    pa_hashmap *sets;
+    const char *mode;
+    const char *setname;
+    char *path;
+    void *state, *state2;
+
+    if (l->inotify_fd < 0)
+        return;
+
+    add_watch(l, l->directory);
+
+    path = pa_sprintf_malloc("%s/modes", l->directory);
+    add_watch(l, path);
+    pa_xfree(path);
+
+    if (!snapshot)
+        return;
+
+    dirs = pa_idxset_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+
+    PA_HASHMAP_FOREACH_KV(mode, sets, snapshot->modes, state) {
+        path = pa_sprintf_malloc("%s/modes/%s", l->directory, mode);
+        add_watch(l, path);
+        pa_xfree(path);
+
+        /* Sets that couldn't be read are watched too. */
+        PA_HASHMAP_FOREACH(setname, sets, state2) {
+            if (!(path = pa_parent_dir(setname)))
+                continue;
+
+            if (pa_idxset_put(dirs, path, NULL) < 0) {
+                pa_xfree(path);
+                continue;
+            }
+
+            add_watch(l, path);
+        }
+    }
+
+    pa_idxset_free(dirs, pa_xfree);
+}
+
+static parameters_snapshot *snapshot_exchange(parameters_loader *l, parameters_snapshot *snapshot) {
+    parameters_snapshot *old;
+
+    do {
+        old = pa_atomic_ptr_load(&l->published);
+    } while (!pa_atomic_ptr_cmpxchg(&l->published, old, snapshot));
+
+    return old;
+}
+
+/* Called from loader thread */
+static void loader_scan(parameters_loader *l) {
+    parameters_snapshot *snapshot;
+
+    snapshot = parameters_snapshot_scan(l->directory);
+
+    loader_watch(l, snapshot);
+
+    if (!snapshot) {
+        pa_log_warn("Parameter scan failed, keeping previous parameters");
+        return;
+    }
+
+    snapshot->generation = l->scan_generation;
+
+    /* A snapshot the main thread hasn't taken yet can never be seen by it
+     * anymore, so it can be freed right here. */
+    parameters_snapshot_free(snapshot_exchange(l, snapshot));
+
+    pa_asyncmsgq_post(l->thread_mq.outq, PA_MSGOBJECT(l), LOADER_MESSAGE_PUBLISHED, NULL, 0, NULL, NULL);
+}
+
+/* Called from loader thread */
+static int loader_read_inotify(parameters_loader *l) {
+    char buf[4096];
+    ssize_t r;
+
+    for (;;) {
+        if ((r = read(l->inotify_fd, buf, sizeof(buf))) > 0)
+            continue;
+
+        if (r < 0 && errno == EINTR)
+            continue;
+
+        if (r < 0 && errno == EAGAIN)
+            break;
+
+        pa_log("Failed to read inotify events: %s", r < 0 ? pa_cstrerror(errno) : "EOF");
+        return -1;
+    }
+
+    /* What exactly changed doesn't matter, the whole tree is scanned again
+     * once the changes have settled. */
+    l->rescan_time = pa_rtclock_now() + RESCAN_DELAY_USEC;
+    pa_rtpoll_set_timer_absolute(l->rtpoll, l->rescan_time);
+
+    return 0;
+}
+
+static int loader_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    parameters_loader *l = PARAMETERS_LOADER(o);
+
+    switch (code) {
+        case LOADER_MESSAGE_SCAN:
+            l->scan_generation = (unsigned) offset;
+            loader_scan(l);
+            return 0;
+
+        case LOADER_MESSAGE_PUBLISHED:
+            /* Main thread */
+            if (l->published_cb)
+                l->published_cb(l, l->userdata);
+            return 0;
+
+        default:
+            pa_log_error("Unknown message code %d", code);
+            return -1;
+    }
+}
+
+static void thread_func(void *userdata) {
+    parameters_loader *l = userdata;
+
+    pa_assert(l);
+
+    pa_log_debug("Parameter loader thread starting up");
+
+    pa_thread_mq_install(&l->thread_mq);
+
+    for (;;) {
+        struct pollfd *pollfd;
+        int ret;
+
+        if ((ret = pa_rtpoll_run(l->rtpoll)) < 0)
+            goto fail;
+
+        if (ret == 0)
+            goto finish;
+
+        if (l->inotify_item) {
+            pollfd = pa_rtpoll_item_get_pollfd(l->inotify_item, NULL);
+
+            if (pollfd->revents & ~POLLIN) {
+                pa_log("inotify fd error.");
+                goto fail;
+            }
+
+            if (pollfd->revents & POLLIN) {
+                pollfd->revents = 0;
+                if (loader_read_inotify(l) < 0)
+                    goto fail;
+            }
+        }
+
+        if (l->rescan_time > 0 && pa_rtclock_now() >= l->rescan_time) {
+            l->rescan_time = 0;
+            pa_rtpoll_set_timer_disabled(l->rtpoll);
+            pa_log_info("Parameter files changed, rescanning");
+            loader_scan(l);
+        }
+    }
+
+fail:
+    /* If this was no regular exit from the loop we have to continue
+     * processing messages until we received PA_MESSAGE_SHUTDOWN */
+    pa_asyncmsgq_post(l->thread_mq.outq, PA_MSGOBJECT(l->core), PA_CORE_MESSAGE_UNLOAD_MODULE, l->module, 0, NULL, NULL);
+    pa_asyncmsgq_wait_for(l->thread_mq.inq, PA_MESSAGE_SHUTDOWN);
+
+finish:
+    pa_log_debug("Parameter loader thread shutting down");
+}
+
+static void loader_done(parameters_loader *l) {
+    if (l->inotify_item)
+        pa_rtpoll_item_free(l->inotify_item);
+
+    if (l->inotify_fd >= 0)
+        pa_close(l->inotify_fd);
+
+    pa_rtpoll_free(l->rtpoll);
+    pa_msgobject_unref(PA_MSGOBJECT(l));
+}
+
+static void loader_free(pa_object *o) {
+    parameters_loader *l = PARAMETERS_LOADER(o);
+
+    pa_xfree(l->directory);
+    pa_xfree(l);
+}
+
+parameters_loader *parameters_loader_new(pa_module *m, const char *directory, bool watch,
+                                         parameters_loader_cb_t published_cb, void *userdata) {
+    parameters_loader *l;
+    struct pollfd *pollfd;
+
+    pa_assert(m);
+    pa_assert(directory);
+
+    l = pa_msgobject_new(parameters_loader);
+    l->parent.parent.free = loader_free;
+    l->parent.process_msg = loader_process_msg;
+    l->core = m->core;
+    l->module = m;
+    l->directory = pa_xstrdup(directory);
+    pa_atomic_ptr_store(&l->published, NULL);
+    l->inotify_fd = -1;
+    l->inotify_item = NULL;
+    l->rescan_time = 0;
+    l->scan_generation = 0;
+    l->current = NULL;
+    l->previous = NULL;
+    l->generation = 0;
+    l->published_cb = published_cb;
+    l->userdata = userdata;
+
+    l->rtpoll = pa_rtpoll_new();
+
+    if (watch) {
+        if ((l->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+            pa_log_warn("inotify_init1() failed, parameter changes are not tracked: %s", pa_cstrerror(errno));
+        else {
+            l->inotify_item = pa_rtpoll_item_new(l->rtpoll, PA_RTPOLL_NEVER, 1);
+            pollfd = pa_rtpoll_item_get_pollfd(l->inotify_item, NULL);
+            pollfd->fd = l->inotify_fd;
+            pollfd->events = POLLIN;
+            pollfd->revents = 0;
+        }
+    }
+
+    if (pa_thread_mq_init(&l->thread_mq, m->core->mainloop, l->rtpoll) < 0) {
+        pa_log("pa_thread_mq_init() failed.");
+        loader_done(l);
+        return NULL;
+    }
+
+    if (!(l->thread = pa_thread_new("parameter-loader", thread_func, l))) {
+        pa_log("Failed to create parameter loader thread.");
+        pa_thread_mq_done(&l->thread_mq);
+        loader_done(l);
+        return NULL;
+    }
+
+    pa_asyncmsgq_post(l->thread_mq.inq, PA_MSGOBJECT(l), LOADER_MESSAGE_SCAN, NULL, l->generation, NULL, NULL);
+
+    return l;
+}
+
+void parameters_loader_free(parameters_loader *l) {
+    pa_assert(l);
+
+    pa_asyncmsgq_send(l->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+    pa_thread_free(l->thread);
+    pa_thread_mq_done(&l->thread_mq);
+
+    parameters_snapshot_free(snapshot_exchange(l, NULL));
+    parameters_snapshot_free(l->current);
+    parameters_snapshot_free(l->previous);
+
+    loader_done(l);
+}
+
+void parameters_loader_rescan(parameters_loader *l) {
+    pa_assert(l);
+
+    parameters_snapshot_free(l->current);
+    parameters_snapshot_free(l->previous);
+    l->current = NULL;
+    l->previous = NULL;
+    l->generation++;
+
+    pa_asyncmsgq_post(l->thread_mq.inq, PA_MSGOBJECT(l), LOADER_MESSAGE_SCAN, NULL, l->generation, NULL, NULL);
+}
+
+bool parameters_loader_update(parameters_loader *l) {
+    parameters_snapshot *snapshot;
+
+    pa_assert(l);
+
+    if (!(snapshot = snapshot_exchange(l, NULL)))
+        return false;
+
+    /* Scans started before the latest rescan request may miss changes */
+    if (snapshot->generation != l->generation) {
+        parameters_snapshot_free(snapshot);
+        return false;
+    }
+
+    parameters_snapshot_free(l->previous);
+    l->previous = l->current;
+    l->current = snapshot;
+
+    pa_log_debug("Using parameter snapshot %u", snapshot->generation);
+
+    return true;
+}
+
+const parameters_snapshot *parameters_loader_get(parameters_loader *l) {
+    pa_assert(l);
+
+    return l->current;
+}
+
+bool parameters_loader_set_changed(parameters_loader *l, const char *name) {
+    parameters_set_data *old, *new;
+
+    pa_assert(l);
+    pa_assert(name);
+
+    if (!l->current || !l->previous)
+        return false;
+
+    if (!(old = pa_hashmap_get(l->previous->sets, name)) || !(new = pa_hashmap_get(l->current->sets, name)))
+        return false;
+
+    if (old->length != new->length)
+        return true;
+
+    return old->length > 0 && memcmp(old->data, new->data, old->length) != 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef _parameters_loader_h_
+#define _parameters_loader_h_
+
+#include <pulsecore/core.h>
+#include <pulsecore/hashmap.h>
+
+/* Contents of one parameter set file. */
+typedef struct parameters_set_data {
+    char *name; /* canonical file name */
+    void *data;
+    unsigned length;
+} parameters_set_data;
+
+/* Everything found under the parameter directory at the time of a scan.
+ * A snapshot is immutable once published. */
+typedef struct parameters_snapshot {
+    unsigned generation;
+    pa_hashmap *modes; /* mode name -> (algorithm name -> set name) */
+    pa_hashmap *sets; /* set name -> parameters_set_data */
+} parameters_snapshot;
+
+typedef struct parameters_loader parameters_loader;
+
+/* Called from the main thread after a scan has been published. */
+typedef void (*parameters_loader_cb_t)(parameters_loader *l, void *userdata);
+
+/* Scan mode directory <directory>/modes/<mode>. Returns a hashmap of
+ * algorithm name -> set name, or NULL if the mode doesn't exist. Free with
+ * pa_hashmap_free(). */
+pa_hashmap *parameters_mode_scan(const char *directory, const char *mode);
+
+/* Resolve the set of algorithm in mode. Free with pa_xfree(). */
+char *parameters_set_resolve(const char *directory, const char *mode, const char *algorithm);
+
+/* Read a set file. Returns NULL with *length 0 if the file can't be read
+ * completely. Free with pa_xfree(). */
+void *parameters_set_read(const char *name, unsigned *length);
+
+/* Scan all modes and read their sets. Sets that can't be read are left
+ * out. Returns NULL if the modes can't be scanned at all. */
+parameters_snapshot *parameters_snapshot_scan(const char *directory);
+void parameters_snapshot_free(parameters_snapshot *snapshot);
+
+/* Start a thread that scans all modes and their sets in the background.
+ * With watch, the directories involved are watched with inotify and
+ * rescanned when something changes in them. */
+parameters_loader *parameters_loader_new(pa_module *m, const char *directory, bool watch,
+                                         parameters_loader_cb_t published_cb, void *userdata);
+void parameters_loader_free(parameters_loader *l);
+
+/* Drop the current snapshot and request a new scan. Until the new scan is
+ * published, parameters_loader_get() returns NULL. */
+void parameters_loader_rescan(parameters_loader *l);
+
+/* Take the most recently published snapshot into use. The replaced snapshot
+ * is kept around for parameters_loader_set_changed(). Returns true if the
+ * current snapshot changed. Main thread only. */
+bool parameters_loader_update(parameters_loader *l);
+
+/* Current snapshot, or NULL if none is available. The snapshot stays valid
+ * until the next parameters_loader_update() or parameters_loader_rescan()
+ * call. Main thread only. */
+const parameters_snapshot *parameters_loader_get(parameters_loader *l);
+
+/* Whether the contents of set name differ between the current snapshot and
+ * the one it replaced. Main thread only. */
+bool parameters_loader_set_changed(parameters_loader *l, const char *name);
+
+#endif
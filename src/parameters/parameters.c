@@ -20,193 +20,115 @@
  * USA.
  */
 
-#define _GNU_SOURCE
-
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
 
-#include <dirent.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <unistd.h>
-#include <stdio.h>
-#include <stdlib.h>
-
-#include <pulsecore/llist.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
 #include <pulsecore/hook-list.h>
 #include <pulsecore/core-util.h>
 
 #include "module-meego-parameters-userdata.h"
 #include "parameters.h"
+#include "parameters-loader.h"
 
 #include <meego/parameter-hook-implementor.h>
 #include <meego/parameter-modifier.h>
 
 #include <meego/proplist-meego.h>
 
+/* Differing byte ranges separated by at most this many equal bytes are
+ * reported as one delta range. */
+#define DELTA_MERGE_GAP (8)
+/* Parameters with more changed ranges than this are sent in full. */
+#define DELTA_MAX_RANGES (32)
+
+/* All lookup tables below are keyed on the name string owned by the
+ * stored object itself, so keys are never duplicated and stay valid
+ * exactly as long as the object is in the table. */
+
 struct set {
     char *name;
-    unsigned hash;
     void *data;
     unsigned length;
-
-    PA_LLIST_FIELDS(struct set);
+    bool changed:1; /* contents changed in the latest reload */
+    bool used:1;
 };
 
 struct algorithm {
     char *name;
-    unsigned hash;
     bool enabled:1;
     bool full_updates:1;
+    bool delta_updates:1;
     bool fired:1;
     pa_hook hook;
     struct set *active_set;
-    PA_LLIST_HEAD(struct set, sets);
+    pa_hashmap *sets; /* set name -> struct set */
 
-    PA_LLIST_FIELDS(struct algorithm);
+    /* Copy of the parameters last delivered, kept for delta updates only */
+    void *shadow;
+    unsigned shadow_length;
 };
 
 struct algorithm_enabler {
     struct algorithm *a;
     struct set *set;
     meego_parameter_modifier *modifier;
-
-    PA_LLIST_FIELDS(struct algorithm_enabler);
 };
 
 struct mode {
     char *name;
-    unsigned hash;
-    PA_LLIST_HEAD(struct algorithm_enabler, algorithm_enablers);
-
-    PA_LLIST_FIELDS(struct mode);
+    pa_hashmap *algorithm_enablers; /* algorithm name -> struct algorithm_enabler */
 };
 
-static char *readlink_malloc(const char *filename) {
-    int size = 100;
-    char *buffer = NULL;
-
-    while (1) {
-        buffer = (char *)realloc(buffer, size);
-        int nchars = readlink(filename, buffer, size);
-        if (nchars < 0) {
-            free(buffer);
-            return NULL;
-        }
-        if (nchars < (size - 1)) {
-            buffer[nchars] = '\0';
-            return buffer;
-        }
-        size *= 2;
-    }
+static struct mode *find_mode_by_name(struct userdata *u, const char *name) {
+    return pa_hashmap_get(u->parameters.modes, name);
 }
 
-static char *set_readlink_abs(const char *path, const char *sym) {
-    char *name;
-    char *sym_value;
-    char *abs_name;
-
-    name = pa_sprintf_malloc("%s/%s", path, sym);
-    sym_value = readlink_malloc(name);
-    pa_xfree(name);
-
-    name = pa_sprintf_malloc("%s/%s", path, sym_value);
-    pa_xfree(sym_value);
-
-    abs_name = canonicalize_file_name(name);
-    pa_xfree(name);
-
-    return abs_name;
+static struct algorithm *find_algorithm_by_name(struct userdata *u, const char *name) {
+    return pa_hashmap_get(u->parameters.algorithms, name);
 }
 
-static struct mode *find_mode_by_name(struct mode **m_head, const char *name) {
-    struct mode *m;
-    unsigned hash = pa_idxset_string_hash_func(name);
-
-    PA_LLIST_FOREACH(m, *m_head) {
-        if (hash == m->hash) {
-            pa_assert(pa_streq(m->name, name));
-            return m;
-        }
-    }
-
-    return NULL;
+static struct set *find_set_by_name(struct algorithm *a, const char *name) {
+    return pa_hashmap_get(a->sets, name);
 }
 
-static struct algorithm *find_algorithm_by_name(struct algorithm **a_head, const char *name) {
-    struct algorithm *a;
-    unsigned hash = pa_idxset_string_hash_func(name);
-
-    PA_LLIST_FOREACH(a, *a_head) {
-        if (hash == a->hash) {
-            pa_assert(pa_streq(a->name, name));
-            return a;
-        }
-    }
-
-    return NULL;
+static struct algorithm_enabler *find_enabler_by_name(struct mode *m, const char *name) {
+    return pa_hashmap_get(m->algorithm_enablers, name);
 }
 
-static struct set *find_set_by_name(struct set **s_head, const char *name) {
-    struct set *s;
-    unsigned hash = pa_idxset_string_hash_func(name);
-
-    PA_LLIST_FOREACH(s, *s_head) {
-        if (hash == s->hash) {
-            pa_assert(pa_streq(s->name, name));
-            return s;
-        }
-    }
-
-    return NULL;
-}
-
-static struct algorithm_enabler *find_enabler_by_name(struct algorithm_enabler **e_head, const char *name) {
-    struct algorithm_enabler *e;
-    unsigned hash = pa_idxset_string_hash_func(name);
-
-    PA_LLIST_FOREACH(e, *e_head) {
-        if (hash == e->a->hash) {
-            pa_assert(pa_streq(e->a->name, name));
-            return e;
-        }
-    }
-
-    return NULL;
+/* Algorithms that are enabled or want full updates are tracked in
+ * u->parameters.active, so that a mode switch only needs to look at
+ * those in addition to the enablers of the new mode. */
+static void algorithm_track(struct userdata *u, struct algorithm *a) {
+    if (a->enabled || a->full_updates)
+        pa_idxset_put(u->parameters.active, a, NULL);
+    else
+        pa_idxset_remove_by_data(u->parameters.active, a, NULL);
 }
 
-static int file_select(const struct dirent *entry) {
-    return entry->d_name[0] != '.';
+static void algorithm_set_enabled(struct userdata *u, struct algorithm *a, bool enabled) {
+    a->enabled = enabled;
+    algorithm_track(u, a);
 }
 
-static void *read_parameters_from_file(const char *file, unsigned *length) {
-    FILE *fp;
-    char *s = NULL;
-    struct stat buf;
-    size_t c = 0;
-
-    if (!stat(file, &buf)) {
-        if ((fp = fopen(file, "r")) != NULL) {
-            s = pa_xmalloc((size_t)(buf.st_size + sizeof(char)));
-            c = fread(s, 1, (size_t)buf.st_size, fp);
-            fclose(fp);
-
-            pa_assert((size_t)buf.st_size ==  c);
+static void set_load(struct userdata *u, struct set *s) {
+    const parameters_snapshot *snapshot;
+    parameters_set_data *d = NULL;
 
-            if (c == (size_t)buf.st_size)
-                s[c] = '\0';
-        }
-    }
-
-    *length = c;
-    return s;
-}
-
-static void set_load(struct set *s) {
     pa_log_debug("Loading set %s ", s->name);
     pa_assert(!s->data);
-    s->data = read_parameters_from_file(s->name, &s->length);
+
+    if ((snapshot = parameters_loader_get(u->parameters.loader)))
+        d = pa_hashmap_get(snapshot->sets, s->name);
+
+    if (d) {
+        /* Keep the terminating null byte read_parameters added */
+        s->data = d->data ? pa_xmemdup(d->data, d->length + 1) : NULL;
+        s->length = d->length;
+    } else
+        s->data = parameters_set_read(s->name, &s->length);
 }
 
 static void set_unload(struct set *s) {
@@ -222,22 +144,34 @@ static struct set *set_new(struct userdata *u, struct algorithm *a, const char *
 
     s = pa_xnew(struct set, 1);
     s->name = pa_xstrdup(name);
-    s->hash = pa_idxset_string_hash_func(name);
     s->data = NULL;
     s->length = 0;
+    s->changed = false;
+    s->used = false;
 
     if (u->parameters.cache)
-        set_load(s);
+        set_load(u, s);
 
     pa_log_debug("Adding set: %s to algorithm: %s", s->name, a->name);
-    PA_LLIST_PREPEND(struct set, a->sets, s);
+    pa_assert_se(pa_hashmap_put(a->sets, s->name, s) == 0);
+
+    return s;
+}
+
+static struct set *algorithm_get_set(struct userdata *u, struct algorithm *a, const char *name) {
+    struct set *s;
+
+    if ((s = find_set_by_name(a, name)) == NULL)
+        s = set_new(u, a, name);
+    else
+        pa_log_debug("%s set: %s already loaded", a->name, s->name);
 
     return s;
 }
 
 static void set_free(struct algorithm *a, struct set *s) {
     pa_log_debug("Removing set: %s from algorithm: %s", s->name, a->name);
-    PA_LLIST_REMOVE(struct set, a->sets, s);
+    pa_assert_se(pa_hashmap_remove(a->sets, s->name) == s);
 
     if (s == a->active_set)
         a->active_set = NULL;
@@ -247,26 +181,118 @@ static void set_free(struct algorithm *a, struct set *s) {
     pa_xfree(s);
 }
 
-static struct algorithm *algorithm_new(pa_core *c, struct algorithm **a_head, const char *name) {
+static struct algorithm *algorithm_new(struct userdata *u, const char *name) {
     struct algorithm *a;
 
+    pa_assert(u);
     pa_assert(name);
 
     a = pa_xnew(struct algorithm, 1);
     a->name = pa_xstrdup(name);
-    a->hash = pa_idxset_string_hash_func(name);
-    a->enabled = true;
     a->full_updates = false;
-    pa_hook_init(&a->hook, c);
+    a->delta_updates = false;
+    a->fired = false;
+    a->shadow = NULL;
+    a->shadow_length = 0;
+    pa_hook_init(&a->hook, u->core);
     a->active_set = NULL;
-    PA_LLIST_HEAD_INIT(struct set, a->sets);
+    a->sets = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
 
     pa_log_debug("Adding new algorithm: %s", a->name);
-    PA_LLIST_PREPEND(struct algorithm, *a_head, a);
+    pa_assert_se(pa_hashmap_put(u->parameters.algorithms, a->name, a) == 0);
+    algorithm_set_enabled(u, a, true);
 
     return a;
 }
 
+static void algorithm_set_shadow(struct algorithm *a, const void *parameters, unsigned length) {
+    pa_xfree(a->shadow);
+    a->shadow = NULL;
+    a->shadow_length = 0;
+
+    if (a->delta_updates && parameters) {
+        a->shadow = pa_xmemdup(parameters, length);
+        a->shadow_length = length;
+    }
+}
+
+/* Collect the byte ranges in which new_parameters differ from
+ * old_parameters. Returns the number of ranges written to deltas, or -1 if
+ * there are more than DELTA_MAX_RANGES of them. */
+static int parameters_diff(const uint8_t *old_parameters, const uint8_t *new_parameters, unsigned length,
+                           meego_parameter_delta *deltas) {
+    unsigned i = 0, start, end;
+    int n = 0;
+
+    while (i < length) {
+        if (old_parameters[i] == new_parameters[i]) {
+            i++;
+            continue;
+        }
+
+        start = i;
+        end = i + 1;
+
+        for (i = end; i < length; i++) {
+            if (old_parameters[i] != new_parameters[i])
+                end = i + 1;
+            else if (i - end >= DELTA_MERGE_GAP)
+                break;
+        }
+
+        if (n == DELTA_MAX_RANGES)
+            return -1;
+
+        deltas[n].offset = start;
+        deltas[n].length = end - start;
+        n++;
+
+        i = end;
+    }
+
+    return n;
+}
+
+/* Deliver new parameters to an algorithm. Delta update requestors only get
+ * the changed byte ranges, or nothing at all when the parameters equal the
+ * ones delivered previously. */
+static pa_hook_result_t algorithm_send_parameters(struct userdata *u, struct algorithm *a,
+                                                  const void *parameters, unsigned length) {
+    meego_parameter_update_args ua;
+    meego_parameter_delta deltas[DELTA_MAX_RANGES];
+    int n = -1;
+
+    pa_assert(u);
+    pa_assert(a);
+
+    ua.mode = u->mode;
+    ua.status = MEEGO_PARAM_UPDATE;
+    ua.parameters = parameters;
+    ua.length = length;
+    ua.deltas = NULL;
+    ua.n_deltas = 0;
+
+    if (a->delta_updates && a->enabled && a->shadow && parameters && a->shadow_length == length)
+        n = parameters_diff(a->shadow, parameters, length, deltas);
+
+    if (n == 0) {
+        pa_log_debug("Parameters of %s unchanged, not updating", a->name);
+        return PA_HOOK_OK;
+    }
+
+    if (n > 0) {
+        pa_log_debug("Sending %d changed ranges to %s", n, a->name);
+        ua.status = MEEGO_PARAM_DELTA;
+        ua.deltas = deltas;
+        ua.n_deltas = (unsigned) n;
+    }
+
+    algorithm_set_enabled(u, a, true);
+    algorithm_set_shadow(a, parameters, length);
+
+    return pa_hook_fire(&a->hook, &ua);
+}
+
 static pa_hook_result_t algorithm_enable(struct userdata *u, struct algorithm *a) {
     meego_parameter_update_args ua;
 
@@ -278,7 +304,9 @@ static pa_hook_result_t algorithm_enable(struct userdata *u, struct algorithm *a
     ua.status = MEEGO_PARAM_ENABLE;
     ua.parameters = NULL;
     ua.length = 0;
-    a->enabled = true;
+    ua.deltas = NULL;
+    ua.n_deltas = 0;
+    algorithm_set_enabled(u, a, true);
 
     pa_log_debug("Enabling %s (%s)", a->name, a->active_set->name);
 
@@ -295,26 +323,35 @@ static pa_hook_result_t algorithm_disable(struct userdata *u, struct algorithm *
     ua.status = MEEGO_PARAM_DISABLE;
     ua.parameters = NULL;
     ua.length = 0;
-    a->enabled = false;
+    ua.deltas = NULL;
+    ua.n_deltas = 0;
+    algorithm_set_enabled(u, a, false);
 
     pa_log_debug("Disabling %s (%s)", a->name, (a->active_set ? a->active_set->name : "not initialized"));
 
     return pa_hook_fire(&a->hook, &ua);
 }
 
-static void algorithm_free(struct userdata *u, struct algorithm **a_head, struct algorithm *a) {
+static void algorithm_free_sets(struct algorithm *a) {
     struct set *s;
 
+    while ((s = pa_hashmap_first(a->sets)))
+        set_free(a, s);
+}
+
+static void algorithm_free(struct userdata *u, struct algorithm *a) {
     pa_assert(a);
 
     pa_log_debug("Removing algorithm: %s", a->name);
-    PA_LLIST_REMOVE(struct algorithm, *a_head, a);
+    pa_assert_se(pa_hashmap_remove(u->parameters.algorithms, a->name) == a);
 
     algorithm_disable(u, a);
+    pa_idxset_remove_by_data(u->parameters.active, a, NULL);
 
-    while ((s = a->sets))
-        set_free(a, s);
+    algorithm_free_sets(a);
+    pa_hashmap_free(a->sets);
 
+    pa_xfree(a->shadow);
     pa_xfree(a->name);
     pa_hook_done(&a->hook);
     pa_xfree(a);
@@ -330,6 +367,8 @@ static void mode_update(struct userdata *u) {
         ua.status = MEEGO_PARAM_MODE_CHANGE;
         ua.parameters = NULL;
         ua.length = 0;
+        ua.deltas = NULL;
+        ua.n_deltas = 0;
 
         pa_hook_fire(&u->mode_hook, &ua);
     }
@@ -344,8 +383,11 @@ static void algorithm_mode_update(struct userdata *u, struct algorithm *a) {
 
     ua.mode = u->mode;
     ua.status = MEEGO_PARAM_MODE_CHANGE;
+    ua.deltas = NULL;
+    ua.n_deltas = 0;
 
-    if (a->enabled && a->active_set) {
+    /* Delta update requestors already hold the active parameters */
+    if (a->enabled && a->active_set && !a->delta_updates) {
         ua.parameters = a->active_set->data;
         ua.length = a->active_set->length;
     } else {
@@ -362,15 +404,14 @@ static void algorithm_mode_update(struct userdata *u, struct algorithm *a) {
 
 /* Update an algorithm using a modifier, if possible.
  *
- * Currently, the algorithm is always updated when using a modifier (as opposed
- * to the active_set checks done with regular file system parameters). Thus,
- * it's possible that two different modifiers are used for consecutive modes
- * and they return the exact same data and the algorithm will still be updated.
- * Such optimizations are however not currently needed.
+ * The algorithm is always updated when using a modifier (as opposed to the
+ * active_set checks done with regular file system parameters), unless it
+ * requested delta updates and the modifier returns the exact same data as
+ * was delivered previously.
  **/
 static bool algorithm_modified_update(struct userdata *u, struct algorithm *a, struct algorithm_enabler *e) {
-    meego_parameter_update_args ua;
     void *parameters = NULL;
+    unsigned length = 0;
     void *base_parameters = NULL;
     unsigned len_base_parameters = 0;
     bool updated = false;
@@ -387,7 +428,7 @@ static bool algorithm_modified_update(struct userdata *u, struct algorithm *a, s
 
     if (e->set) {
         if (!u->parameters.cache)
-            set_load(e->set);
+            set_load(u, e->set);
         base_parameters = e->set->data;
         len_base_parameters = e->set->length;
     }
@@ -401,17 +442,13 @@ static bool algorithm_modified_update(struct userdata *u, struct algorithm *a, s
      * modifier (i.e. no parameters from the file system). Thus, modifiers must
      * also be able to handle NULL base parameters (at least by failing gracefully). */
     updated = modifier->get_parameters(base_parameters, len_base_parameters,
-                                       &parameters, &ua.length,
+                                       &parameters, &length,
                                        modifier->userdata);
 
     if (updated) {
-        ua.mode = u->mode;
-        ua.status = MEEGO_PARAM_UPDATE;
-        ua.parameters = parameters;
-        pa_assert(ua.parameters && ua.length > 0);
-        a->enabled = true;
+        pa_assert(parameters && length > 0);
         a->active_set = NULL;
-        pa_hook_fire(&a->hook, &ua);
+        algorithm_send_parameters(u, a, parameters, length);
         pa_log_debug("Update from modifier successful");
     } else
         pa_log_warn("Update from modifier failed");
@@ -423,7 +460,6 @@ static bool algorithm_modified_update(struct userdata *u, struct algorithm *a, s
 }
 
 static pa_hook_result_t algorithm_update(struct userdata *u, struct algorithm *a, struct set *s) {
-    meego_parameter_update_args ua;
     pa_hook_result_t r;
 
     a->active_set = s;
@@ -434,17 +470,16 @@ static pa_hook_result_t algorithm_update(struct userdata *u, struct algorithm *a
     }
 
     if (!u->parameters.cache)
-       set_load(s);
+       set_load(u, s);
 
-    ua.mode = u->mode;
-    ua.status = MEEGO_PARAM_UPDATE;
-    ua.parameters = s->data;
-    ua.length = s->length;
-    a->enabled = true;
+    if (!s->data) {
+        pa_log_warn("Failed to read %s, not updating %s", s->name, a->name);
+        return PA_HOOK_OK;
+    }
 
     pa_log_debug("Updating %s with %s", a->name, s->name);
 
-    r = pa_hook_fire(&a->hook, &ua);
+    r = algorithm_send_parameters(u, a, s->data, s->length);
 
     if (!u->parameters.cache)
         set_unload(s);
@@ -455,147 +490,269 @@ static pa_hook_result_t algorithm_update(struct userdata *u, struct algorithm *a
 int algorithm_reload(struct userdata *u, const char *alg) {
     struct mode *m;
     struct algorithm *a;
-    struct set *s;
     struct algorithm_enabler *e;
-    char *path;
-    const char *setname;
+    char *setname;
+    void *state;
 
     pa_assert(u);
     pa_assert(alg);
 
     pa_log_debug("Reloading %s", alg);
 
-    if ((a = find_algorithm_by_name(&u->parameters.algorithms, alg)) == NULL) {
+    if ((a = find_algorithm_by_name(u, alg)) == NULL) {
         pa_log_warn("Can not reload %s, not found", alg);
         return -1;
     }
 
-    while ((s = a->sets))
-        set_free(a, s);
+    /* Sets are read straight from the file system until the loader has
+     * caught up with the changes. */
+    parameters_loader_rescan(u->parameters.loader);
 
-    PA_LLIST_FOREACH(m, u->parameters.modes) {
-        if ((e = find_enabler_by_name(&m->algorithm_enablers, alg)) != NULL) {
-            PA_LLIST_REMOVE(struct algorithm_enabler, m->algorithm_enablers, e);
+    algorithm_free_sets(a);
 
-            path = pa_sprintf_malloc("%s/modes/%s", u->parameters.directory, m->name);
-            if ((setname = set_readlink_abs(path, alg)) != NULL) {
-                e = pa_xnew(struct algorithm_enabler, 1);
-                e->a = a;
+    PA_HASHMAP_FOREACH(m, u->parameters.modes, state) {
+        if ((e = find_enabler_by_name(m, alg)) == NULL)
+            continue;
 
-                if ((e->set = find_set_by_name(&a->sets, setname)) == NULL)
-                    e->set = set_new(u, a, setname);
-                else
-                    pa_log_debug("%s set: %s already loaded", a->name, e->set->name);
+        if ((setname = parameters_set_resolve(u->parameters.directory, m->name, alg)) != NULL) {
+            e->set = algorithm_get_set(u, a, setname);
 
-                if (m->hash == u->hash)
-                    algorithm_update(u, a, e->set);
+            if (u->mode && pa_streq(m->name, u->mode))
+                algorithm_update(u, a, e->set);
 
-                PA_LLIST_PREPEND(struct algorithm_enabler, m->algorithm_enablers, e);
-            } else {
-                pa_log_warn("%s reload failed in mode %s", alg, m->name);
+            pa_xfree(setname);
+        } else {
+            pa_log_warn("%s reload failed in mode %s", alg, m->name);
+            e->set = NULL;
+            if (!e->modifier) {
+                pa_hashmap_remove(m->algorithm_enablers, alg);
+                pa_xfree(e);
             }
-            pa_xfree(path);
         }
     }
 
     return 0;
 }
 
-static struct mode *mode_new(struct mode **m_head, const char *name) {
+static struct mode *mode_new(struct userdata *u, const char *name) {
     struct mode *m;
 
     m = pa_xnew0(struct mode, 1);
-    PA_LLIST_INIT(struct mode, m);
     m->name = pa_xstrdup(name);
-    m->hash = pa_idxset_string_hash_func(name);
-    PA_LLIST_HEAD_INIT(struct algorithm_enabler, m->algorithm_enablers);
+    m->algorithm_enablers = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
 
     pa_log_debug("Adding new mode: %s", m->name);
-    PA_LLIST_PREPEND(struct mode, *m_head, m);
+    pa_assert_se(pa_hashmap_put(u->parameters.modes, m->name, m) == 0);
 
     return m;
 }
 
-static void mode_free(struct userdata *u, struct mode **m_head, struct mode *m) {
+static struct algorithm_enabler *enabler_new(struct mode *m, struct algorithm *a) {
+    struct algorithm_enabler *e;
+
+    e = pa_xnew0(struct algorithm_enabler, 1);
+    e->a = a;
+    pa_assert_se(pa_hashmap_put(m->algorithm_enablers, a->name, e) == 0);
+
+    return e;
+}
+
+static void mode_free(struct userdata *u, struct mode *m) {
     struct algorithm_enabler *e;
 
     pa_log_debug("Removing mode: %s", m->name);
-    PA_LLIST_REMOVE(struct mode, *m_head, m);
+    pa_assert_se(pa_hashmap_remove(u->parameters.modes, m->name) == m);
 
-    while ((e = m->algorithm_enablers)) {
-        if (pa_streq(m->name, u->mode))
+    while ((e = pa_hashmap_steal_first(m->algorithm_enablers))) {
+        if (u->mode && pa_streq(m->name, u->mode))
             algorithm_disable(u, e->a);
 
         pa_log_debug("Removing enabler: %s from mode: %s", e->a->name, m->name);
-        PA_LLIST_REMOVE(struct algorithm_enabler, m->algorithm_enablers, e);
         pa_xfree(e);
     }
 
+    pa_hashmap_free(m->algorithm_enablers);
     pa_xfree(m->name);
     pa_xfree(m);
 }
 
 static struct mode *add_mode(struct userdata *u, const char *mode) {
-    struct dirent **namelist;
-    int n;
+    const parameters_snapshot *snapshot;
+    pa_hashmap *sets;
+    pa_hashmap *scanned = NULL;
     struct mode *m;
     struct algorithm *a;
     struct algorithm_enabler *e;
-    char *path;
-    char *sym;
-    char *setname;
+    const char *sym;
+    const char *setname;
+    void *state;
+
+    /* Use the preloaded snapshot when there is one. The file system is only
+     * accessed before the first scan has completed, or when the mode was
+     * added after the last scan. */
+    sets = NULL;
+    if ((snapshot = parameters_loader_get(u->parameters.loader)))
+        sets = pa_hashmap_get(snapshot->modes, mode);
+    if (!sets)
+        sets = scanned = parameters_mode_scan(u->parameters.directory, mode);
+
+    if (!sets)
+        return NULL;
+
+    m = mode_new(u, mode);
+
+    PA_HASHMAP_FOREACH_KV(sym, setname, sets, state) {
+        if ((a = find_algorithm_by_name(u, sym)) == NULL)
+            a = algorithm_new(u, sym);
+
+        e = enabler_new(m, a);
+        e->set = algorithm_get_set(u, a, setname);
+
+        pa_log_debug("Enabling %s in %s mode", a->name, mode);
+    }
+
+    if (scanned)
+        pa_hashmap_free(scanned);
+
+    return m;
+}
 
-    m = mode_new(&u->parameters.modes, mode);
+/* Make the enablers of mode m match the snapshot. */
+static void mode_reload(struct userdata *u, const parameters_snapshot *snapshot, struct mode *m) {
+    pa_hashmap *enablers;
+    pa_hashmap *sets;
+    struct algorithm *a;
+    struct algorithm_enabler *e;
+    const char *alg;
+    const char *setname;
+    void *state;
 
-    path = pa_sprintf_malloc("%s/modes/%s", u->parameters.directory, mode);
+    sets = pa_hashmap_get(snapshot->modes, m->name);
 
-    pa_log_debug("Scanning mode from %s", path);
+    enablers = m->algorithm_enablers;
+    m->algorithm_enablers = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
 
-    if ((n = scandir(path, &namelist, file_select, alphasort)) >= 0) {
+    while ((e = pa_hashmap_steal_first(enablers))) {
+        setname = sets ? pa_hashmap_get(sets, e->a->name) : NULL;
+        e->set = setname ? algorithm_get_set(u, e->a, setname) : NULL;
 
-        while (n--) {
-            sym = namelist[n]->d_name;
-            pa_log_debug("Checking symlink value %s", sym);
+        if (e->set || e->modifier)
+            pa_assert_se(pa_hashmap_put(m->algorithm_enablers, e->a->name, e) == 0);
+        else {
+            pa_log_debug("Removing enabler: %s from mode: %s", e->a->name, m->name);
+            pa_xfree(e);
+        }
+    }
 
-            if ((setname = set_readlink_abs(path, sym)) != NULL) {
-                if ((a = find_algorithm_by_name(&u->parameters.algorithms, sym)) == NULL)
-                    a = algorithm_new(u->core, &u->parameters.algorithms, sym);
+    pa_hashmap_free(enablers);
 
-                e = pa_xnew0(struct algorithm_enabler, 1);
-                e->a = a;
+    if (!sets)
+        return;
 
-                if ((e->set = find_set_by_name(&a->sets, setname)) == NULL)
-                    e->set = set_new(u, a, setname);
-                else
-                    pa_log_debug("%s set: %s already loaded", a->name, e->set->name);
+    PA_HASHMAP_FOREACH_KV(alg, setname, sets, state) {
+        if (find_enabler_by_name(m, alg))
+            continue;
 
-                PA_LLIST_PREPEND(struct algorithm_enabler, m->algorithm_enablers, e);
-                pa_log_debug("Enabling %s in %s mode", a->name, mode);
+        if ((a = find_algorithm_by_name(u, alg)) == NULL)
+            a = algorithm_new(u, alg);
 
-                pa_xfree(setname);
-            } else {
-                pa_log_debug("%s is not a symlink", sym);
+        e = enabler_new(m, a);
+        e->set = algorithm_get_set(u, a, setname);
+        pa_log_debug("Enabling %s in %s mode", a->name, m->name);
+    }
+}
+
+/* Bring all known modes up to date with a newly published snapshot and
+ * update the algorithms of the active mode whose parameters changed.
+ * Everything is switched over within this one main loop callback, so
+ * algorithms never see a half updated set of parameters. */
+static void modes_reload(struct userdata *u) {
+    const parameters_snapshot *snapshot;
+    struct mode *m;
+    struct algorithm *a;
+    struct algorithm_enabler *e;
+    struct set *s;
+    pa_hashmap *sets;
+    void *state, *state2;
+    uint32_t idx;
+
+    pa_assert_se(snapshot = parameters_loader_get(u->parameters.loader));
+
+    PA_HASHMAP_FOREACH(m, u->parameters.modes, state) {
+        mode_reload(u, snapshot, m);
+
+        PA_HASHMAP_FOREACH(e, m->algorithm_enablers, state2)
+            if (e->set)
+                e->set->used = true;
+    }
+
+    /* Refresh cached set contents and forget sets no mode refers to */
+    PA_HASHMAP_FOREACH(a, u->parameters.algorithms, state) {
+        sets = a->sets;
+        a->sets = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+
+        while ((s = pa_hashmap_steal_first(sets))) {
+            pa_assert_se(pa_hashmap_put(a->sets, s->name, s) == 0);
+
+            if (!s->used) {
+                set_free(a, s);
+                continue;
+            }
+
+            s->used = false;
+            s->changed = parameters_loader_set_changed(u->parameters.loader, s->name);
+
+            if (s->changed && u->parameters.cache) {
+                set_unload(s);
+                set_load(u, s);
             }
-            pa_xfree(namelist[n]);
         }
-        pa_xfree(namelist);
-    } else {
-        mode_free(u, &u->parameters.modes, m);
-        m = NULL;
+
+        pa_hashmap_free(sets);
     }
 
-    pa_xfree(path);
+    if (!u->mode || (m = find_mode_by_name(u, u->mode)) == NULL)
+        return;
 
-    return m;
+    pa_log_debug("Applying reloaded parameters to mode %s", m->name);
+
+    PA_HASHMAP_FOREACH(e, m->algorithm_enablers, state) {
+        a = e->a;
+
+        if (!a->hook.slots) {
+            a->active_set = e->set;
+            continue;
+        }
+
+        if (e->modifier) {
+            if (e->set && e->set->changed && !algorithm_modified_update(u, a, e))
+                algorithm_update(u, a, e->set);
+        } else if (e->set != a->active_set || e->set->changed)
+            algorithm_update(u, a, e->set);
+    }
+
+    PA_IDXSET_FOREACH(a, u->parameters.active, idx) {
+        if (a->enabled && !find_enabler_by_name(m, a->name))
+            algorithm_disable(u, a);
+    }
+}
+
+static void snapshot_published_cb(parameters_loader *l, struct userdata *u) {
+    pa_assert(u);
+
+    if (parameters_loader_update(l))
+        modes_reload(u);
 }
 
 int update_mode(struct userdata *u, const char *mode) {
-    struct mode *m = find_mode_by_name(&u->parameters.modes, mode);
+    struct mode *m = find_mode_by_name(u, mode);
 
     if (!m)
         return -1;
 
-    mode_free(u, &u->parameters.modes, m);
+    parameters_loader_rescan(u->parameters.loader);
+
+    mode_free(u, m);
 
     if ((m = add_mode(u, mode)) == NULL)
         return -1;
@@ -622,17 +779,24 @@ static pa_hook_result_t update_requests(pa_core *c, meego_parameter_connection_a
         return PA_HOOK_OK;
     }
 
-    if ((a = find_algorithm_by_name(&u->parameters.algorithms, args->name)) == NULL)
-        a = algorithm_new(c, &u->parameters.algorithms, args->name);
+    if ((a = find_algorithm_by_name(u, args->name)) == NULL)
+        a = algorithm_new(u, args->name);
 
     a->full_updates = args->full_updates;
+    algorithm_track(u, a);
+
+    /* Deltas are only sent if every requestor of the algorithm understands
+     * them. The new requestor has no parameters yet, so the next update is
+     * always a full one. */
+    a->delta_updates = args->delta_updates && (!a->hook.slots || a->delta_updates);
+    algorithm_set_shadow(a, NULL, 0);
 
     pa_hook_connect(&a->hook, args->prio, args->cb, args->userdata);
 
     pa_log_debug("Update hook connected for %s", args->name);
 
-    if (u->mode && (m = find_mode_by_name(&u->parameters.modes, u->mode)))
-        e = find_enabler_by_name(&m->algorithm_enablers, args->name);
+    if (u->mode && (m = find_mode_by_name(u, u->mode)))
+        e = find_enabler_by_name(m, args->name);
 
     if (e) {
         if (!algorithm_modified_update(u, a, e))
@@ -653,7 +817,7 @@ static pa_hook_result_t stop_requests(pa_core *c, meego_parameter_connection_arg
 
     if (args->name == NULL)
         slot = u->mode_hook.slots;
-    else if ((a = find_algorithm_by_name(&u->parameters.algorithms, args->name)) != NULL)
+    else if ((a = find_algorithm_by_name(u, args->name)) != NULL)
         slot = a->hook.slots;
 
     while (slot) {
@@ -683,22 +847,18 @@ static pa_hook_result_t register_modifier(pa_core *c, meego_parameter_modifier *
     pa_assert(modifier->mode_name);
     pa_assert(modifier->algorithm_name);
 
-    if ((m = find_mode_by_name(&u->parameters.modes, modifier->mode_name)) == NULL) {
+    if ((m = find_mode_by_name(u, modifier->mode_name)) == NULL) {
         if ((m = add_mode(u, modifier->mode_name)) == NULL) {
             pa_log_error("Could not add mode %s", modifier->mode_name);
             return PA_HOOK_OK;
         }
     }
 
-    if ((a = find_algorithm_by_name(&u->parameters.algorithms, modifier->algorithm_name)) == NULL)
-        a = algorithm_new(c, &u->parameters.algorithms, modifier->algorithm_name);
+    if ((a = find_algorithm_by_name(u, modifier->algorithm_name)) == NULL)
+        a = algorithm_new(u, modifier->algorithm_name);
 
-    if ((e = find_enabler_by_name(&m->algorithm_enablers, modifier->algorithm_name)) == NULL) {
-        e = pa_xnew0(struct algorithm_enabler, 1);
-        e->a = a;
-        e->set = NULL;
-        PA_LLIST_PREPEND(struct algorithm_enabler, m->algorithm_enablers, e);
-    }
+    if ((e = find_enabler_by_name(m, modifier->algorithm_name)) == NULL)
+        e = enabler_new(m, a);
 
     /* Only one modifier allowed for each (mode, algorithm) pair (more wouldn't make sense) */
     if (e->modifier) {
@@ -727,8 +887,8 @@ static pa_hook_result_t unregister_modifier(pa_core *c, meego_parameter_modifier
     pa_assert(modifier);
     pa_assert(u);
 
-    if ((m = find_mode_by_name(&u->parameters.modes, modifier->mode_name)))
-        e = find_enabler_by_name(&m->algorithm_enablers, modifier->algorithm_name);
+    if ((m = find_mode_by_name(u, modifier->mode_name)))
+        e = find_enabler_by_name(m, modifier->algorithm_name);
 
     if (!e || !e->modifier) {
         pa_log_warn("No modifier exists for algorithm %s, mode %s", modifier->algorithm_name, modifier->mode_name);
@@ -746,7 +906,7 @@ static pa_hook_result_t unregister_modifier(pa_core *c, meego_parameter_modifier
 
     /* Remove the enabler if it was solely using the modifier (i.e. no params from file) */
     if (!e->set) {
-        PA_LLIST_REMOVE(struct algorithm_enabler, m->algorithm_enablers, e);
+        pa_hashmap_remove(m->algorithm_enablers, modifier->algorithm_name);
         pa_xfree(e);
     }
 
@@ -756,8 +916,13 @@ static pa_hook_result_t unregister_modifier(pa_core *c, meego_parameter_modifier
 }
 
 int initme(struct userdata *u, const char *initial_mode) {
-    PA_LLIST_HEAD_INIT(struct mode, u->parameters.modes);
-    PA_LLIST_HEAD_INIT(struct algorithm, u->parameters.algorithms);
+    u->parameters.modes = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+    u->parameters.algorithms = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+    u->parameters.active = pa_idxset_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+
+    if (!(u->parameters.loader = parameters_loader_new(u->module, u->parameters.directory, u->parameters.watch,
+                                                       (parameters_loader_cb_t) snapshot_published_cb, u)))
+        return -1;
 
     u->implementor_args.update_request_cb = (pa_hook_cb_t)update_requests;
     u->implementor_args.stop_request_cb = (pa_hook_cb_t)stop_requests;
@@ -784,14 +949,32 @@ void unloadme(struct userdata *u) {
 
     meego_parameter_discontinue_requests(&u->implementor_args);
 
+    if (u->parameters.loader) {
+        parameters_loader_free(u->parameters.loader);
+        u->parameters.loader = NULL;
+    }
+
     if (u->parameters.directory)
         pa_xfree((void*)u->parameters.directory);
 
-    while ((m = u->parameters.modes))
-        mode_free(u, &u->parameters.modes, m);
+    if (u->parameters.modes) {
+        while ((m = pa_hashmap_first(u->parameters.modes)))
+            mode_free(u, m);
+        pa_hashmap_free(u->parameters.modes);
+        u->parameters.modes = NULL;
+    }
 
-    while ((a = u->parameters.algorithms))
-        algorithm_free(u, &u->parameters.algorithms, a);
+    if (u->parameters.algorithms) {
+        while ((a = pa_hashmap_first(u->parameters.algorithms)))
+            algorithm_free(u, a);
+        pa_hashmap_free(u->parameters.algorithms);
+        u->parameters.algorithms = NULL;
+    }
+
+    if (u->parameters.active) {
+        pa_idxset_free(u->parameters.active, NULL);
+        u->parameters.active = NULL;
+    }
 }
 
 int switch_mode(struct userdata *u, const char *mode) {
@@ -799,11 +982,13 @@ int switch_mode(struct userdata *u, const char *mode) {
     struct algorithm *a;
     struct algorithm_enabler *e;
     unsigned hash = pa_idxset_string_hash_func(mode);
+    void *state;
+    uint32_t idx;
 
     if (hash == u->hash)
         return 0;
 
-    if ((m = find_mode_by_name(&u->parameters.modes, mode)) == NULL)
+    if ((m = find_mode_by_name(u, mode)) == NULL)
         m = add_mode(u, mode);
 
     if (!m) {
@@ -820,7 +1005,7 @@ int switch_mode(struct userdata *u, const char *mode) {
 
     pa_log_debug("Checking mode: %s", mode);
 
-    PA_LLIST_FOREACH(e, m->algorithm_enablers) {
+    PA_HASHMAP_FOREACH(e, m->algorithm_enablers, state) {
         a = e->a;
 
         pa_assert(e->set || e->modifier);
@@ -854,7 +1039,10 @@ int switch_mode(struct userdata *u, const char *mode) {
         a->fired = true;
     }
 
-    PA_LLIST_FOREACH(a, u->parameters.algorithms) {
+    /* Every fired algorithm ended up enabled, so walking the active set
+     * both resets the fired flags and finds the algorithms the new mode
+     * leaves behind, without touching unrelated algorithms. */
+    PA_IDXSET_FOREACH(a, u->parameters.active, idx) {
         if (a->fired == false && a->enabled == true)
             algorithm_disable(u, a);
         else if (a->fired == false && a->full_updates)
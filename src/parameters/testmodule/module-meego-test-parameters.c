@@ -42,6 +42,8 @@ struct algorithm {
     char *parameters;
     char *modified_parameters;
     meego_parameter_status_t status;
+    unsigned n_deltas;
+    meego_parameter_delta first_delta;
 };
 
 struct userdata {
@@ -72,6 +74,8 @@ static inline const char *status_to_string(meego_parameter_status_t status) {
             return "MEEGO_PARAM_UPDATE";
         case MEEGO_PARAM_MODE_CHANGE:
             return "MEEGO_PARAM_MODE_CHANGE";
+        case MEEGO_PARAM_DELTA:
+            return "MEEGO_PARAM_DELTA";
         default:
             pa_assert_not_reached();
     }
@@ -83,6 +87,10 @@ static pa_hook_result_t parameters_changed_cb(pa_core *c, meego_parameter_update
     pa_assert(alg);
 
     alg->status = ua->status;
+    alg->n_deltas = ua->n_deltas;
+
+    if (ua->n_deltas > 0)
+        alg->first_delta = ua->deltas[0];
 
     algorithm_reset(alg);
 
@@ -201,6 +209,32 @@ static void run_basic_tests(struct userdata *u) {
     disable_algs(u);
 }
 
+static void run_delta_tests(struct userdata *u) {
+
+    disable_algs(u);
+
+    meego_parameter_request_delta_updates("alg_a", (pa_hook_cb_t)parameters_changed_cb, PA_HOOK_NORMAL, false, &u->alg_a);
+
+    /* The first update after enabling is always a full one */
+    switch_mode(u, "mode_a");
+    verify(&u->alg_a, "mode_a", "set_a1_parameters", MEEGO_PARAM_UPDATE);
+    pa_assert(u->alg_a.n_deltas == 0);
+
+    /* set_a1_parameters and set_a2_parameters only differ in one byte */
+    switch_mode(u, "mode_b");
+    verify(&u->alg_a, "mode_b", "set_a2_parameters", MEEGO_PARAM_DELTA);
+    pa_assert(u->alg_a.n_deltas == 1);
+    pa_assert(u->alg_a.first_delta.offset == 5);
+    pa_assert(u->alg_a.first_delta.length == 1);
+
+    switch_mode(u, "mode_d");
+    verify(&u->alg_a, "mode_d", NULL, MEEGO_PARAM_DISABLE);
+
+    meego_parameter_stop_updates("alg_a", (pa_hook_cb_t)parameters_changed_cb, &u->alg_a);
+
+    disable_algs(u);
+}
+
 static bool get_parameters_cb(const void *base_parameters, unsigned len_base_parameters,
                             void **parameters, unsigned *len_parameters, void *userdata) {
 
@@ -327,6 +361,7 @@ int pa__init(pa_module *m) {
 
     run_basic_tests(u);
     run_modifier_tests(u);
+    run_delta_tests(u);
 
     pa_module_unload_request(m, true);
     return 0;
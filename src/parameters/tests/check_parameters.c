@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Maemo MMF Audio <mmf-audio@projects.maemo.org>
+ *          or Jyri Sarha <jyri.sarha@nokia.com>
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <check.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
+
+#include "parameters-loader.h"
+
+/* <dir>/modes/mode has three algorithms: "good" links to a readable set,
+ * "short" to a directory that can't be read as a set and "missing" to a
+ * set that doesn't exist. */
+#define DIR_TEMPLATE "/tmp/check_parameters.XXXXXX"
+
+static char dir[sizeof(DIR_TEMPLATE)];
+
+static void write_file(const char *path, const char *contents) {
+    FILE *f;
+
+    fail_unless((f = fopen(path, "w")) != NULL, "Can't create %s", path);
+    fputs(contents, f);
+    fclose(f);
+}
+
+static char *path_of(const char *name) {
+    return pa_sprintf_malloc("%s/%s", dir, name);
+}
+
+static void setup(void) {
+    strcpy(dir, DIR_TEMPLATE);
+    fail_unless(mkdtemp(dir) != NULL, NULL);
+
+    fail_unless(mkdir(path_of("sets"), 0700) == 0, NULL);
+    fail_unless(mkdir(path_of("sets/short.set"), 0700) == 0, NULL);
+    write_file(path_of("sets/short.set/file"), "x");
+    write_file(path_of("sets/good.set"), "abc");
+
+    fail_unless(mkdir(path_of("modes"), 0700) == 0, NULL);
+    fail_unless(mkdir(path_of("modes/mode"), 0700) == 0, NULL);
+    fail_unless(symlink("../../sets/good.set", path_of("modes/mode/good")) == 0, NULL);
+    fail_unless(symlink("../../sets/short.set", path_of("modes/mode/short")) == 0, NULL);
+    fail_unless(symlink("../../sets/missing.set", path_of("modes/mode/missing")) == 0, NULL);
+}
+
+static void teardown(void) {
+    char *cmd;
+
+    cmd = pa_sprintf_malloc("rm -rf %s", dir);
+    if (system(cmd) != 0)
+        fprintf(stderr, "Failed to remove %s\n", dir);
+    pa_xfree(cmd);
+}
+
+START_TEST (set_read_good)
+{
+    unsigned length = 0;
+    char *data;
+
+    data = parameters_set_read(path_of("sets/good.set"), &length);
+
+    fail_unless(data != NULL, NULL);
+    fail_unless(length == 3, "Expected length 3 - got %u", length);
+    fail_unless(strcmp(data, "abc") == 0, NULL);
+    pa_xfree(data);
+}
+END_TEST
+
+START_TEST (set_read_short)
+{
+    unsigned length = 123;
+
+    /* stat() gives a size, but nothing can be read from a directory */
+    fail_unless(parameters_set_read(path_of("sets/short.set"), &length) == NULL, NULL);
+    fail_unless(length == 0, "Expected length 0 - got %u", length);
+}
+END_TEST
+
+START_TEST (set_read_missing)
+{
+    unsigned length = 123;
+
+    fail_unless(parameters_set_read(path_of("sets/missing.set"), &length) == NULL, NULL);
+    fail_unless(length == 0, "Expected length 0 - got %u", length);
+}
+END_TEST
+
+START_TEST (snapshot_skips_bad_sets)
+{
+    parameters_snapshot *snapshot;
+    parameters_set_data *d;
+    pa_hashmap *sets;
+    char *good, *bad;
+
+    fail_unless((snapshot = parameters_snapshot_scan(dir)) != NULL, NULL);
+    fail_unless((sets = pa_hashmap_get(snapshot->modes, "mode")) != NULL, NULL);
+
+    /* Bad sets don't drop the mode or the good set */
+    fail_unless(pa_hashmap_get(sets, "good") != NULL, NULL);
+    fail_unless(pa_hashmap_get(sets, "missing") == NULL, NULL);
+
+    good = canonicalize_file_name(path_of("sets/good.set"));
+    bad = canonicalize_file_name(path_of("sets/short.set"));
+
+    fail_unless(pa_hashmap_size(snapshot->sets) == 1, NULL);
+    fail_unless((d = pa_hashmap_get(snapshot->sets, good)) != NULL, NULL);
+    fail_unless(d->length == 3, NULL);
+    fail_unless(memcmp(d->data, "abc", 3) == 0, NULL);
+    fail_unless(pa_hashmap_get(snapshot->sets, bad) == NULL, NULL);
+
+    free(good);
+    free(bad);
+    parameters_snapshot_free(snapshot);
+}
+END_TEST
+
+START_TEST (snapshot_without_modes)
+{
+    char *cmd;
+
+    cmd = pa_sprintf_malloc("rm -rf %s/modes", dir);
+    fail_unless(system(cmd) == 0, NULL);
+    pa_xfree(cmd);
+
+    fail_unless(parameters_snapshot_scan(dir) == NULL, NULL);
+}
+END_TEST
+
+Suite *parameters_suite() {
+    Suite *s = suite_create("Parameters");
+
+    TCase *tc_core = tcase_create("Parameters");
+
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+
+    /* add test cases */
+    tcase_add_test(tc_core, set_read_good);
+    tcase_add_test(tc_core, set_read_short);
+    tcase_add_test(tc_core, set_read_missing);
+    tcase_add_test(tc_core, snapshot_skips_bad_sets);
+    tcase_add_test(tc_core, snapshot_without_modes);
+
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void) {
+    int number_failed;
+    Suite *s = parameters_suite();
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
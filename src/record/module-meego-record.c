@@ -42,6 +42,8 @@
 #include "pa-optimized.h"
 #include "memory.h"
 #include "algorithm-hook.h"
+#include "trace.h"
+#include "capture.h"
 
 #include "module-record-api.h"
 
@@ -85,6 +87,9 @@ struct userdata {
     meego_algorithm_hook_api *algorithm;
     meego_algorithm_hook *hook_algorithm;
     pa_memblockq *memblockq;
+
+    meego_capture *capture;
+    meego_capture_tap *tap_in;
 };
 
 /*************************
@@ -172,12 +177,17 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *new_ch
     pa_assert_se(u = o->userdata);
     pa_assert(new_chunk);
 
+    meego_capture_tap_write(u->tap_in, new_chunk);
+
     if (pa_memblockq_push(u->memblockq, new_chunk) < 0) {
         pa_log_error("Failed to push %zu byte chunk into memblockq (len %zu).",
                 new_chunk->length, pa_memblockq_get_length(u->memblockq));
         return;
     }
 
+    meego_trace_begin("record");
+    meego_trace_counter("record-queue", (int) pa_memblockq_get_length(u->memblockq));
+
     while (util_memblockq_to_chunk(u->core->mempool, u->memblockq, &chunk, u->maxblocksize)) {
 
         if (PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
@@ -203,6 +213,8 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *new_ch
         pa_memblock_unref(chunk.memblock);
 
     }
+
+    meego_trace_end("record");
 }
 
 /* Called from I/O thread context */
@@ -438,11 +450,15 @@ int pa__init(pa_module*m) {
     u->maxblocksize = maxblocksize;
 
     u->memblockq = pa_memblockq_new("record memblockq", 0, maxblocksize*8, 0, &ss, 0, 0, 0, NULL);
+
     if (!u->memblockq) {
         pa_log_error("couldn't alloc memblockq");
         goto fail;
     }
 
+    u->capture = meego_capture_get(m->core);
+    u->tap_in = meego_capture_tap_new(u->capture, "record-in", &ss);
+
     /* SOURCE */
 
     pa_source_new_data_init(&source_data);
@@ -556,5 +572,11 @@ void pa__done(pa_module*m) {
         u->memblockq = NULL;
     }
 
+    if (u->tap_in)
+        meego_capture_tap_free(u->tap_in);
+
+    if (u->capture)
+        meego_capture_unref(u->capture);
+
     pa_xfree(u);
 }
@@ -25,22 +25,130 @@
 #endif
 
 #include <pulsecore/macro.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/mutex.h>
 #include <pulse/xmalloc.h>
 #include "alsa-utils.h"
 #include "ctrl-element.h"
 
 
+/* Volume writes can block on slow codec control busses, so they are done
+ * in a worker thread. Only the latest requested step is written, earlier
+ * pending requests are dropped. After ctrl_element_new() the mixer is only
+ * used from the worker thread. */
 struct ctrl_element {
     snd_mixer_t *mixer;
 
-    /* We'll store the element name and query the element pointer from the
-     * mixer every time we set the element volume. This is how it's done in
-     * PulseAudio, I guess in case the element "disappears", so let's just
-     * follow the same convention. */
+    /* Element is looked up by name once and cached. If the element is
+     * removed from the mixer, the cached pointer is dropped and the element
+     * is looked up again on next write. */
     char *element_name;
-
+    snd_mixer_elem_t *element;
+    int written_step;           /* -1 if unknown */
+
+    pa_thread *thread;
+    pa_mutex *mutex;
+    pa_cond *cond;
+    /* Protected by mutex */
+    int pending_step;           /* -1 if no pending write */
+    bool quit;
 };
 
+static int element_cb(snd_mixer_elem_t *element, unsigned int mask) {
+    ctrl_element *ctrl = snd_mixer_elem_get_callback_private(element);
+
+    pa_assert(ctrl);
+
+    if (mask == SND_CTL_EVENT_MASK_REMOVE) {
+        pa_log_debug("Element %s removed.", ctrl->element_name);
+        ctrl->element = NULL;
+        ctrl->written_step = -1;
+    }
+
+    return 0;
+}
+
+static snd_mixer_elem_t *element_get(ctrl_element *ctrl) {
+    pa_assert(ctrl);
+
+    /* Process pending mixer events so that removed element is noticed. */
+    snd_mixer_handle_events(ctrl->mixer);
+
+    if (ctrl->element)
+        return ctrl->element;
+
+    if (!(ctrl->element = mixer_get_element(ctrl->mixer, ctrl->element_name)))
+        return NULL;
+
+    snd_mixer_elem_set_callback(ctrl->element, element_cb);
+    snd_mixer_elem_set_callback_private(ctrl->element, ctrl);
+    ctrl->written_step = -1;
+
+    return ctrl->element;
+}
+
+static void element_write(ctrl_element *ctrl, int step) {
+    snd_mixer_elem_t *element;
+
+    if (!(element = element_get(ctrl))) {
+        pa_log_error("Element %s has disappeared.", ctrl->element_name);
+        return;
+    }
+
+    if (step == ctrl->written_step)
+        return;
+
+    if ((snd_mixer_selem_set_playback_volume(element, SND_MIXER_SCHN_MONO, step) < 0)) {
+        pa_log_error("Failed to set the volume step %d to the sidetone control element", step);
+        ctrl->written_step = -1;
+        return;
+    }
+
+    ctrl->written_step = step;
+}
+
+static void thread_func(void *userdata) {
+    ctrl_element *ctrl = userdata;
+    int step;
+    bool quit;
+
+    pa_assert(ctrl);
+
+    pa_log_debug("Sidetone control element thread starting up");
+
+    pa_mutex_lock(ctrl->mutex);
+
+    for (;;) {
+        while (ctrl->pending_step < 0 && !ctrl->quit)
+            pa_cond_wait(ctrl->cond, ctrl->mutex);
+
+        step = ctrl->pending_step;
+        ctrl->pending_step = -1;
+        quit = ctrl->quit;
+
+        pa_mutex_unlock(ctrl->mutex);
+
+        /* Pending write is done also when quitting, so that final mute
+         * reaches the hardware. */
+        if (step >= 0)
+            element_write(ctrl, step);
+
+        if (quit)
+            break;
+
+        pa_mutex_lock(ctrl->mutex);
+    }
+
+    pa_log_debug("Sidetone control element thread shutting down");
+}
+
+static void post_step(ctrl_element *ctrl, int step) {
+    pa_mutex_lock(ctrl->mutex);
+    ctrl->pending_step = step;
+    pa_cond_signal(ctrl->cond, false);
+    pa_mutex_unlock(ctrl->mutex);
+}
+
 ctrl_element *ctrl_element_new(snd_mixer_t *mixer, const char* name) {
     pa_assert(mixer);
     pa_assert(name);
@@ -51,8 +159,10 @@ ctrl_element *ctrl_element_new(snd_mixer_t *mixer, const char* name) {
     ctrl = pa_xnew0(ctrl_element, 1);
     ctrl->mixer = mixer;
     ctrl->element_name = pa_xstrdup(name);
+    ctrl->written_step = -1;
+    ctrl->pending_step = -1;
 
-    element = mixer_get_element(mixer, name);
+    element = element_get(ctrl);
     if(!element) {
         pa_log_error("Unable to open mixer element \"%s\"", name);
         goto fail;
@@ -64,10 +174,28 @@ ctrl_element *ctrl_element_new(snd_mixer_t *mixer, const char* name) {
         goto fail;
     }
 
+    ctrl->mutex = pa_mutex_new(false, false);
+    ctrl->cond = pa_cond_new();
+
+    if (!(ctrl->thread = pa_thread_new("sidetone-ctrl", thread_func, ctrl))) {
+        pa_log_error("Failed to create sidetone control element thread");
+        goto fail;
+    }
+
     return ctrl;
 
 fail:
 
+    if (ctrl->element)
+        snd_mixer_elem_set_callback(ctrl->element, NULL);
+
+    if (ctrl->cond)
+        pa_cond_free(ctrl->cond);
+
+    if (ctrl->mutex)
+        pa_mutex_free(ctrl->mutex);
+
+    pa_xfree(ctrl->element_name);
     pa_xfree(ctrl);
 
     return NULL;
@@ -75,6 +203,19 @@ fail:
 
 void ctrl_element_free(ctrl_element *ctrl) {
     pa_assert(ctrl);
+
+    pa_mutex_lock(ctrl->mutex);
+    ctrl->quit = true;
+    pa_cond_signal(ctrl->cond, false);
+    pa_mutex_unlock(ctrl->mutex);
+
+    pa_thread_free(ctrl->thread);
+
+    if (ctrl->element)
+        snd_mixer_elem_set_callback(ctrl->element, NULL);
+
+    pa_cond_free(ctrl->cond);
+    pa_mutex_free(ctrl->mutex);
     pa_xfree(ctrl->element_name);
     pa_xfree(ctrl);
 }
@@ -82,18 +223,7 @@ void ctrl_element_free(ctrl_element *ctrl) {
 int ctrl_element_mute(ctrl_element *ctrl) {
     pa_assert(ctrl);
 
-    snd_mixer_elem_t *element = NULL;
-
-    element = mixer_get_element(ctrl->mixer, ctrl->element_name);
-    if(!element) {
-        pa_log_error("Element %s has disappeared.", ctrl->element_name);
-        return -1;
-    }
-
-    if((snd_mixer_selem_set_playback_volume(element, SND_MIXER_SCHN_MONO, 0) < 0)) {
-        pa_log_error("Failed to mute sidetone element");
-        return -1;
-    }
+    post_step(ctrl, 0);
 
     return 0;
 }
@@ -102,19 +232,12 @@ int ctrl_element_mute(ctrl_element *ctrl) {
 int set_ctrl_element_volume(ctrl_element *ctrl,int step) {
     pa_assert(ctrl);
 
-    snd_mixer_elem_t *element = NULL;
-
-    element = mixer_get_element(ctrl->mixer, ctrl->element_name);
-    if(!element) {
-        pa_log_error("Element %s has disappeared.", ctrl->element_name);
+    if (step < 0) {
+        pa_log_error("Invalid sidetone volume step %d", step);
         return -1;
     }
 
-    if((snd_mixer_selem_set_playback_volume(element, SND_MIXER_SCHN_MONO, step) < 0)) {
-        pa_log_error("Failed to set the volume step to the sidetone control element");
-        return -1;
-    }
+    post_step(ctrl, step);
 
     return 0;
 }
-
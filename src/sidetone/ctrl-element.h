@@ -29,8 +29,10 @@ typedef struct ctrl_element ctrl_element;
 
 ctrl_element *ctrl_element_new(snd_mixer_t *mixer, const char* name);
 
+/* Pending volume write is completed before returning. */
 void ctrl_element_free(ctrl_element *ctrl);
 
+/* Volume is written asynchronously, failures to write are only logged. */
 int ctrl_element_mute(ctrl_element *ctrl);
 
 int set_ctrl_element_volume(ctrl_element *ctrl, int step);
@@ -101,9 +101,68 @@ int parse_volume_steps(struct mv_volume_steps *steps, const char *step_string) {
     steps->n_steps = count;
     steps->current_step = 0;
 
+    build_volume_step_thresholds(steps);
+
     return count;
 }
 
+/* true if volume is at least as close to step k as to step k - 1, with
+ * volume rounded to millibels */
+static bool volume_selects_step(const struct mv_volume_steps *steps, int k, pa_volume_t volume) {
+    int volume_mb;
+
+    if (volume == PA_VOLUME_MUTED)
+        return false;
+
+    volume_mb = (int) (pa_sw_volume_to_dB(volume) * 100);
+
+    return 2 * volume_mb >= steps->step[k - 1] + steps->step[k];
+}
+
+void build_volume_step_thresholds(struct mv_volume_steps *steps) {
+    int k;
+
+    pa_assert(steps);
+
+    steps->threshold[0] = PA_VOLUME_MUTED;
+
+    for (k = 1; k < steps->n_steps; k++) {
+        uint32_t low = PA_VOLUME_MUTED;
+        uint32_t high = PA_VOLUME_MAX + 1U;
+        uint32_t mid;
+
+        while (low < high) {
+            mid = low + ((high - low) / 2);
+            if (volume_selects_step(steps, k, mid))
+                high = mid;
+            else
+                low = mid + 1;
+        }
+
+        steps->threshold[k] = low;
+    }
+}
+
+int find_volume_step(const struct mv_volume_steps *steps, pa_volume_t volume) {
+    int low = 1;
+    int high;
+    int mid;
+
+    pa_assert(steps);
+
+    high = steps->n_steps;
+
+    while (low < high) {
+        mid = low + ((high - low) / 2);
+        if (steps->threshold[mid] <= volume)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low - 1;
+}
+
 
 /* parse sidetone configuration file parameters */
 sidetone_args* sidetone_args_new(const char *args) {
@@ -48,5 +48,12 @@ void sidetone_args_free(sidetone_args *args);
 
 int parse_volume_steps(struct mv_volume_steps *steps, const char *step_string);
 
+/* fill step thresholds, called by parse_volume_steps() */
+void build_volume_step_thresholds(struct mv_volume_steps *steps);
+
+/* return position of the step closest to volume in millibels,
+ * steps must be in ascending order */
+int find_volume_step(const struct mv_volume_steps *steps, pa_volume_t volume);
+
 #endif
 
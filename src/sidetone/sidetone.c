@@ -32,6 +32,7 @@
 #include <pulsecore/modargs.h>
 
 #include "call-state-tracker.h"
+#include "subscription-dispatcher.h"
 
 #include "ctrl-element.h"
 #include "alsa-util-old.h"
@@ -64,7 +65,8 @@ struct sidetone {
     /* right now not in use but would be needed in future  */
     pa_mutex *mutex;
     /* subscription for getting current volume*/
-    pa_subscription *sink_subscription;
+    pa_subscription_dispatcher *subscription_dispatcher;
+    pa_subscription_dispatcher_slot *sink_subscription;
     /* sink we are interested in*/
     pa_sink *master_sink;
     /* store the current volume , to compare next time */
@@ -80,7 +82,6 @@ struct sidetone {
 static int sidetone_volume_get_step(struct sidetone *st) {
     pa_cvolume *cvol;
     pa_volume_t volume;
-    int volume_mb;
     int i = 0;
 
     pa_assert(st);
@@ -103,20 +104,8 @@ static int sidetone_volume_get_step(struct sidetone *st) {
         return 0;
     }
 
-    volume_mb = (int) (pa_sw_volume_to_dB(volume) * 100);
-    pa_log_debug("volume %d millibels ", volume_mb);
-
-    /* Search for the first step that's >= volume_mb.
-     * Assume that the steps are in ascending order. */
-    for (i = 0; (i < st->total_steps->n_steps) && (st->total_steps->step[i] < volume_mb); i++)
-        ;
-
-    if (i == st->total_steps->n_steps)
-        i = st->total_steps->n_steps - 1;
-
-    /* If we're in between steps, choose the closer one. With equal distances, choose the higher step. */
-    if (i > 0 && (st->total_steps->step[i] - volume_mb > volume_mb - st->total_steps->step[i - 1]))
-        i--;
+    /* Choose the closest step. With equal distances, choose the higher step. */
+    i = find_volume_step(st->total_steps, volume);
 
     st->sidetone_step = st->total_steps->index[i];
 
@@ -128,7 +117,7 @@ static int sidetone_volume_get_step(struct sidetone *st) {
 /* get the current volume , convert it into millibels , find out the corrosponding volume step , map this
 volume step to sidetone control element volume step. set the sidetone volume using control element volume
 step */
-static void sink_input_subscribe_sidetone_cb(pa_core *c, pa_subscription_event_type_t t, uint32_t idx, sidetone *st) {
+static void sink_subscribe_sidetone_cb(pa_core *c, pa_subscription_event_type_t t, uint32_t idx, sidetone *st) {
     int sidetone_step = -1;
     int ret = 0;
     int old_sidetone_step;
@@ -138,7 +127,7 @@ static void sink_input_subscribe_sidetone_cb(pa_core *c, pa_subscription_event_t
 
     pa_log_debug("subscription event is called  ");
 
-    if (PA_SUBSCRIPTION_EVENT_SINK_INPUT != (t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK)) {
+    if (PA_SUBSCRIPTION_EVENT_SINK != (t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK)) {
         pa_log_debug("subscription event not found");
         return;
     }
@@ -202,7 +191,6 @@ sidetone *sidetone_new(pa_core *core, const char* argument) {
     sidetone *st = NULL;
     sidetone_args *st_args = NULL;
     pa_sink *sink = NULL;
-    int i = 0;
 
     pa_assert(core);
     pa_assert(argument);
@@ -214,12 +202,7 @@ sidetone *sidetone_new(pa_core *core, const char* argument) {
     st->volume_current = pa_xnew0(struct pa_cvolume, 1);;
 
     st->total_steps = pa_xnew0(struct mv_volume_steps, 1);
-    st->total_steps->n_steps = st_args->steps->n_steps;
-    st->total_steps->current_step = st_args->steps->current_step;
-    for (i = 0; i < st->total_steps->n_steps; i++) {
-        st->total_steps->step[i] = st_args->steps->step[i];
-        st->total_steps->index[i] = st_args->steps->index[i];
-    }
+    *st->total_steps = *st_args->steps;
 
     st->mutex = pa_mutex_new(false, false);
 
@@ -245,8 +228,15 @@ sidetone *sidetone_new(pa_core *core, const char* argument) {
                                            (pa_hook_cb_t)sink_unlink_cb, st);
 
 
-    /* subscription made for fetching the current main volume */
-    st->sink_subscription = pa_subscription_new(core, PA_SUBSCRIPTION_MASK_SINK_INPUT, (pa_subscription_cb_t) sink_input_subscribe_sidetone_cb, st);
+    /* subscription made for fetching the current main volume, master sink
+     * real volume changes are posted as change events of the sink */
+    st->subscription_dispatcher = pa_subscription_dispatcher_get(core);
+    st->sink_subscription = pa_subscription_dispatcher_connect(st->subscription_dispatcher,
+                                                               PA_SUBSCRIPTION_EVENT_SINK,
+                                                               sink->index,
+                                                               PA_SUBSCRIPTION_DISPATCHER_CHANGE,
+                                                               (pa_subscription_cb_t) sink_subscribe_sidetone_cb,
+                                                               st);
 
     st->dead = false;
 
@@ -272,6 +262,7 @@ void sidetone_free(sidetone *st) {
 
     if (st->ctrl_element) {
       ctrl_element_mute(st->ctrl_element);
+      ctrl_element_free(st->ctrl_element);
       st->ctrl_element = NULL;
     }
 
@@ -291,10 +282,15 @@ void sidetone_free(sidetone *st) {
     }
 
     if (st->sink_subscription) {
-        pa_subscription_free(st->sink_subscription);
+        pa_subscription_dispatcher_slot_free(st->sink_subscription);
         st->sink_subscription = NULL;
     }
 
+    if (st->subscription_dispatcher) {
+        pa_subscription_dispatcher_unref(st->subscription_dispatcher);
+        st->subscription_dispatcher = NULL;
+    }
+
     if (st->sink_unlink_slot) {
         pa_hook_slot_free(st->sink_unlink_slot);
         st->sink_unlink_slot = NULL;
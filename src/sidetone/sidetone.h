@@ -30,6 +30,8 @@
 struct mv_volume_steps {
     int step[MAX_STEPS];
     int index[MAX_STEPS];
+    /* lowest volume that selects the step, see find_volume_step() */
+    pa_volume_t threshold[MAX_STEPS];
     int n_steps;
     int current_step;
 };
@@ -123,6 +123,22 @@ START_TEST (parse_steps_malformed2)
 }
 END_TEST
 
+START_TEST (find_step)
+{
+    const char *STRING = "7:-2899,6:-1799,5:-1598,4:-1399,3:-1198";
+
+    struct mv_volume_steps steps;
+
+    fail_unless(parse_volume_steps(&steps, STRING) == 5, NULL);
+
+    fail_unless(find_volume_step(&steps, PA_VOLUME_MUTED) == 0, NULL);
+    fail_unless(find_volume_step(&steps, pa_sw_volume_from_dB(-30.0)) == 0, NULL);
+    fail_unless(find_volume_step(&steps, pa_sw_volume_from_dB(-17.0)) == 1, NULL);
+    fail_unless(find_volume_step(&steps, pa_sw_volume_from_dB(-15.0)) == 2, NULL);
+    fail_unless(find_volume_step(&steps, pa_sw_volume_from_dB(-14.0)) == 3, NULL);
+    fail_unless(find_volume_step(&steps, PA_VOLUME_NORM) == 4, NULL);
+}
+END_TEST
 
 
 Suite *sidetone_suite() {
@@ -137,6 +153,7 @@ Suite *sidetone_suite() {
     tcase_add_test(tc_core, parse_steps_empty);
     tcase_add_test(tc_core, parse_steps_malformed1);
     tcase_add_test(tc_core, parse_steps_malformed2);
+    tcase_add_test(tc_core, find_step);
 
     suite_add_tcase(s, tc_core);
 
@@ -58,6 +58,7 @@
 #endif
 
 #include "volume-proxy.h"
+#include "subscription-dispatcher.h"
 #include "parameter-hook.h"
 
 PA_MODULE_AUTHOR("Lennart Poettering");
@@ -76,6 +77,7 @@ PA_MODULE_USAGE(
         "use_voice=<true/false use voice module for mode detection");
 
 #define SAVE_INTERVAL (10 * PA_USEC_PER_SEC)
+#define SAVE_DEBOUNCE (2 * PA_USEC_PER_SEC)
 #define IDENTIFICATION_PROPERTY "module-stream-restore.id"
 
 #define DEFAULT_FALLBACK_FILE PA_DEFAULT_CONFIG_DIR"/stream-restore.table"
@@ -99,10 +101,13 @@ static const char* const valid_modargs[] = {
 
 struct ext_route_volume {
     char *name;
+    char *route_key; /* "name:route" for current route */
+    pa_volume_proxy_key_t *proxy_key;
     pa_cvolume volume;
     pa_cvolume min_volume;
     pa_cvolume default_volume;
     bool reset_min_volume;
+    bool dirty; /* volume not yet written to route database */
 
     /* when "slave" route volume enabled stream is changed, master is set to
      * same volume, and when setting master, also slaves are updated. */
@@ -122,9 +127,17 @@ struct ext_sink_volume {
 struct userdata {
     pa_core *core;
     pa_module *module;
-    pa_subscription *subscription;
+    pa_subscription_dispatcher *subscription_dispatcher;
+    pa_subscription_dispatcher_slot *sink_input_slot;
+    pa_subscription_dispatcher_slot *source_output_slot;
+    pa_defer_event *streams_changed_event;
+    pa_idxset *changed_sink_inputs;     /* Indices of sink inputs with unstored changes */
+    pa_idxset *changed_source_outputs;  /* Indices of source outputs with unstored changes */
     pa_time_event *save_time_event;
+    pa_usec_t save_deadline;    /* latest time for pending save, see save_schedule() */
     pa_database* database;
+    pa_hashmap *entries;        /* Entry name -> struct entry, decoded copy of database */
+    pa_idxset *dirty_entries;   /* Names of entries changed or removed since last save */
 
     bool restore_device:1;
     bool restore_volume:1;
@@ -137,6 +150,8 @@ struct userdata {
     pa_dbus_protocol *dbus_protocol;
     pa_hashmap *dbus_entries;
     uint32_t next_index; /* For generating object paths for entries. */
+    const char **dbus_entry_paths; /* Cached object paths of dbus_entries, see get_entries(). */
+    DBusMessage *get_all_reply;    /* Cached GetAll reply without header fields, see handle_get_all(). */
 #endif
 
     /* extension */
@@ -145,20 +160,35 @@ struct userdata {
     pa_hook_slot *sink_proplist_changed_slot;
     pa_hook_slot *sink_input_move_finished_slot;
     pa_database *route_database;
+    pa_hashmap *route_entries;  /* Route key -> struct ext_route_entry, copy of route database */
     char *route;
 
     pa_volume_proxy *volume_proxy;
     pa_hook_slot *volume_proxy_hook_slot;
 
     PA_LLIST_HEAD(struct ext_route_volume, route_volumes);
+    pa_hashmap *route_volume_index; /* Stream name -> struct ext_route_volume */
 
     /* sink volumes */
-    pa_subscription *sink_subscription;
+    pa_subscription_dispatcher_slot *sink_volume_slot;
     struct ext_sink_volume *use_sink_volume;
     PA_LLIST_HEAD(struct ext_sink_volume, sink_volumes);
+    pa_hashmap *sink_volume_index;  /* Mode -> struct ext_sink_volume */
+
+    /* Live streams by stream group name, see stream_index_update() */
+    pa_hashmap *stream_groups;          /* Group name -> struct stream_group */
+    pa_hashmap *sink_input_groups;      /* pa_sink_input -> struct stream_group */
+    pa_hashmap *source_output_groups;   /* pa_source_output -> struct stream_group */
+};
+
+struct stream_group {
+    char *name;
+    pa_idxset *sink_inputs;
+    pa_idxset *source_outputs;
 };
 
-#define ENTRY_VERSION 5
+#define ENTRY_VERSION 6
+#define TAGSTRUCT_ENTRY_VERSION 5
 
 struct entry {
     bool muted_valid, volume_valid, device_valid, card_valid;
@@ -169,6 +199,27 @@ struct entry {
     char* card;
 };
 
+#define ENTRY_FLAG_VOLUME_VALID (1 << 0)
+#define ENTRY_FLAG_MUTED_VALID  (1 << 1)
+#define ENTRY_FLAG_MUTED        (1 << 2)
+#define ENTRY_FLAG_DEVICE_VALID (1 << 3)
+#define ENTRY_FLAG_CARD_VALID   (1 << 4)
+#define ENTRY_FLAG_HAS_DEVICE   (1 << 5)
+#define ENTRY_FLAG_HAS_CARD     (1 << 6)
+
+/* On-disk entry record. Header is followed by volume_channels volume
+ * values, map_channels channel positions as bytes, and device and card
+ * names without terminating NUL. Version byte never collides with the
+ * first byte of a tagstruct-encoded entry. */
+struct compact_entry {
+    uint8_t version;
+    uint8_t flags;
+    uint8_t map_channels;
+    uint8_t volume_channels;
+    uint16_t device_length;
+    uint16_t card_length;
+} PA_GCC_PACKED;
+
 #define EXT_ROUTE_ENTRY_VERSION 4
 
 struct ext_route_entry {
@@ -188,10 +239,18 @@ enum {
 static struct entry* entry_new(void);
 static void entry_free(struct entry *e);
 static struct entry *entry_read(struct userdata *u, const char *name);
+static const struct entry *entry_get(struct userdata *u, const char *name);
 static bool entry_write(struct userdata *u, const char *name, const struct entry *e, bool replace);
+static bool entry_remove(struct userdata *u, const char *name);
 static struct entry* entry_copy(const struct entry *e);
 static void entry_apply(struct userdata *u, const char *name, struct entry *e);
 static void trigger_save(struct userdata *u);
+static void entries_flush(struct userdata *u);
+static void save_schedule(struct userdata *u);
+static void save_now(struct userdata *u);
+static struct stream_group *stream_group_get(struct userdata *u, const char *name);
+static void stream_index_init(struct userdata *u);
+static void stream_index_done(struct userdata *u);
 
 
 /* route extension defines */
@@ -210,6 +269,9 @@ static void trigger_save(struct userdata *u);
 #define VOICE_MASTER_SINK_INPUT_NAME "Voice module master sink input"
 
 static void subscribe_callback(pa_core *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata);
+static void streams_subscribe(struct userdata *u);
+static void streams_unsubscribe(struct userdata *u);
+static void streams_changed_clear(struct userdata *u);
 static bool entries_equal(const struct entry *a, const struct entry *b);
 /* route extension functions */
 static void ext_sink_set_volume(pa_sink *s, const pa_cvolume *vol);
@@ -225,8 +287,10 @@ static void ext_proxy_volume(struct userdata *u, const char*name, const pa_cvolu
 static void ext_proxy_volume_all(struct userdata *u);
 static pa_hook_result_t ext_volume_proxy_cb(pa_volume_proxy *p, pa_volume_proxy_entry *e, struct userdata *u);
 static char* ext_route_key(const char *name, const char *route);
+static void ext_update_route_keys(struct userdata *u);
 static void ext_free_route_volumes(struct userdata *u);
-static struct ext_route_entry* ext_read_route_entry(struct userdata *u, const char *name, const char *route);
+static const struct ext_route_entry* ext_read_route_entry(struct userdata *u, struct ext_route_volume *r);
+static void ext_route_entries_load(struct userdata *u);
 static bool ext_entry_has_volume_changed(struct entry *a, struct entry *b);
 static void ext_apply_route_volume(struct userdata *u, struct ext_route_volume *r, bool apply);
 static void ext_apply_route_volumes(struct userdata *u, bool apply);
@@ -239,7 +303,9 @@ static pa_hook_result_t ext_parameters_changed_cb(pa_core *c, meego_parameter_up
 static void ext_sink_volume_subscribe_cb(pa_core *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata);
 static int ext_fill_route_db(struct userdata *u, const char *filename);
 static int ext_fill_sink_db(struct userdata *u, const char *filename);
-static void ext_route_entry_write(struct userdata *u, struct ext_route_volume *r, const char *route);
+static void ext_route_entry_write(struct userdata *u, struct ext_route_volume *r);
+static unsigned ext_route_volumes_flush(struct userdata *u);
+static pa_hook_result_t ext_sink_state_changed_hook_callback(pa_core *c, pa_sink *s, struct userdata *u);
 /* route extension functions end */
 
 #ifdef HAVE_DBUS
@@ -429,6 +495,35 @@ static void dbus_entry_free(struct dbus_entry *de) {
     pa_xfree(de);
 }
 
+/* Drop cached replies that list entries. */
+static void dbus_entries_changed(struct userdata *u) {
+    pa_assert(u);
+
+    pa_xfree(u->dbus_entry_paths);
+    u->dbus_entry_paths = NULL;
+
+    if (u->get_all_reply) {
+        dbus_message_unref(u->get_all_reply);
+        u->get_all_reply = NULL;
+    }
+}
+
+static void dbus_entries_put(struct userdata *u, struct dbus_entry *de) {
+    pa_assert(u);
+    pa_assert(de);
+
+    pa_assert_se(pa_hashmap_put(u->dbus_entries, de->entry_name, de) == 0);
+    dbus_entries_changed(u);
+}
+
+static void dbus_entries_remove(struct userdata *u, const char *name) {
+    pa_assert(u);
+    pa_assert(name);
+
+    if (pa_hashmap_remove_and_free(u->dbus_entries, name) >= 0)
+        dbus_entries_changed(u);
+}
+
 /* Reads an array [(UInt32, UInt32)] from the iterator. The struct items are
  * are a channel position and a volume value, respectively. The result is
  * stored in the map and vol arguments. The iterator must point to a "a(uu)"
@@ -502,7 +597,7 @@ static int get_volume_arg(DBusConnection *conn, DBusMessage *msg, DBusMessageIte
     return 0;
 }
 
-static void append_volume(DBusMessageIter *iter, struct entry *e) {
+static void append_volume(DBusMessageIter *iter, const struct entry *e) {
     DBusMessageIter array_iter;
     DBusMessageIter struct_iter;
     unsigned i;
@@ -529,7 +624,7 @@ static void append_volume(DBusMessageIter *iter, struct entry *e) {
     pa_assert_se(dbus_message_iter_close_container(iter, &array_iter));
 }
 
-static void append_volume_variant(DBusMessageIter *iter, struct entry *e) {
+static void append_volume_variant(DBusMessageIter *iter, const struct entry *e) {
     DBusMessageIter variant_iter;
 
     pa_assert(iter);
@@ -619,9 +714,9 @@ static void handle_get_interface_revision(DBusConnection *conn, DBusMessage *msg
     pa_dbus_send_basic_variant_reply(conn, msg, DBUS_TYPE_UINT32, &interface_revision);
 }
 
-/* The caller frees the array, but not the strings. */
+/* The array is cached and valid until entries are added or removed, the
+ * caller must not free it. */
 static const char **get_entries(struct userdata *u, unsigned *n) {
-    const char **entries;
     unsigned i = 0;
     void *state = NULL;
     struct dbus_entry *de;
@@ -634,12 +729,15 @@ static const char **get_entries(struct userdata *u, unsigned *n) {
     if (*n == 0)
         return NULL;
 
-    entries = pa_xnew(const char *, *n);
+    if (u->dbus_entry_paths)
+        return u->dbus_entry_paths;
+
+    u->dbus_entry_paths = pa_xnew(const char *, *n);
 
     PA_HASHMAP_FOREACH(de, u->dbus_entries, state)
-        entries[i++] = de->object_path;
+        u->dbus_entry_paths[i++] = de->object_path;
 
-    return entries;
+    return u->dbus_entry_paths;
 }
 
 static void handle_get_entries(DBusConnection *conn, DBusMessage *msg, void *userdata) {
@@ -654,10 +752,10 @@ static void handle_get_entries(DBusConnection *conn, DBusMessage *msg, void *use
     entries = get_entries(u, &n);
 
     pa_dbus_send_basic_array_variant_reply(conn, msg, DBUS_TYPE_OBJECT_PATH, entries, n);
-
-    pa_xfree(entries);
 }
 
+/* Reply body is serialised once into a template message and copied for
+ * each request, until entries are added or removed. */
 static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdata) {
     struct userdata *u = userdata;
     DBusMessage *reply = NULL;
@@ -671,24 +769,30 @@ static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdat
     pa_assert(msg);
     pa_assert(u);
 
-    interface_revision = DBUS_INTERFACE_REVISION;
-    entries = get_entries(u, &n_entries);
+    if (!u->get_all_reply) {
+        interface_revision = DBUS_INTERFACE_REVISION;
+        entries = get_entries(u, &n_entries);
 
-    pa_assert_se((reply = dbus_message_new_method_return(msg)));
+        pa_assert_se((u->get_all_reply = dbus_message_new(DBUS_MESSAGE_TYPE_METHOD_RETURN)));
 
-    dbus_message_iter_init_append(reply, &msg_iter);
-    pa_assert_se(dbus_message_iter_open_container(&msg_iter, DBUS_TYPE_ARRAY, "{sv}", &dict_iter));
+        dbus_message_iter_init_append(u->get_all_reply, &msg_iter);
+        pa_assert_se(dbus_message_iter_open_container(&msg_iter, DBUS_TYPE_ARRAY, "{sv}", &dict_iter));
 
-    pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_INTERFACE_REVISION].property_name, DBUS_TYPE_UINT32, &interface_revision);
-    pa_dbus_append_basic_array_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_ENTRIES].property_name, DBUS_TYPE_OBJECT_PATH, entries, n_entries);
+        pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_INTERFACE_REVISION].property_name, DBUS_TYPE_UINT32, &interface_revision);
+        pa_dbus_append_basic_array_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_ENTRIES].property_name, DBUS_TYPE_OBJECT_PATH, entries, n_entries);
 
-    pa_assert_se(dbus_message_iter_close_container(&msg_iter, &dict_iter));
+        pa_assert_se(dbus_message_iter_close_container(&msg_iter, &dict_iter));
+    }
+
+    pa_assert_se((reply = dbus_message_copy(u->get_all_reply)));
+    pa_assert_se(dbus_message_set_reply_serial(reply, dbus_message_get_serial(msg)));
+    if (dbus_message_get_sender(msg))
+        pa_assert_se(dbus_message_set_destination(reply, dbus_message_get_sender(msg)));
+    dbus_message_set_no_reply(reply, TRUE);
 
     pa_assert_se(dbus_connection_send(conn, reply, NULL));
 
     dbus_message_unref(reply);
-
-    pa_xfree(entries);
 }
 
 static void handle_add_entry(DBusConnection *conn, DBusMessage *msg, void *userdata) {
@@ -758,7 +862,7 @@ static void handle_add_entry(DBusConnection *conn, DBusMessage *msg, void *userd
 
     } else {
         dbus_entry = dbus_entry_new(u, name);
-        pa_assert_se(pa_hashmap_put(u->dbus_entries, dbus_entry->entry_name, dbus_entry) == 0);
+        dbus_entries_put(u, dbus_entry);
 
         e = entry_new();
         e->muted_valid = true;
@@ -828,20 +932,18 @@ static void handle_entry_get_name(DBusConnection *conn, DBusMessage *msg, void *
 
 static void handle_entry_get_device(DBusConnection *conn, DBusMessage *msg, void *userdata) {
     struct dbus_entry *de = userdata;
-    struct entry *e;
+    const struct entry *e;
     const char *device;
 
     pa_assert(conn);
     pa_assert(msg);
     pa_assert(de);
 
-    pa_assert_se(e = entry_read(de->userdata, de->entry_name));
+    pa_assert_se(e = entry_get(de->userdata, de->entry_name));
 
     device = e->device_valid ? e->device : "";
 
     pa_dbus_send_basic_variant_reply(conn, msg, DBUS_TYPE_STRING, &device);
-
-    entry_free(e);
 }
 
 static void handle_entry_set_device(DBusConnection *conn, DBusMessage *msg, DBusMessageIter *iter, void *userdata) {
@@ -882,13 +984,13 @@ static void handle_entry_get_volume(DBusConnection *conn, DBusMessage *msg, void
     struct dbus_entry *de = userdata;
     DBusMessage *reply;
     DBusMessageIter msg_iter;
-    struct entry *e;
+    const struct entry *e;
 
     pa_assert(conn);
     pa_assert(msg);
     pa_assert(de);
 
-    pa_assert_se(e = entry_read(de->userdata, de->entry_name));
+    pa_assert_se(e = entry_get(de->userdata, de->entry_name));
 
     pa_assert_se(reply = dbus_message_new_method_return(msg));
 
@@ -897,7 +999,7 @@ static void handle_entry_get_volume(DBusConnection *conn, DBusMessage *msg, void
 
     pa_assert_se(dbus_connection_send(conn, reply, NULL));
 
-    entry_free(e);
+    dbus_message_unref(reply);
 }
 
 static void handle_entry_set_volume(DBusConnection *conn, DBusMessage *msg, DBusMessageIter *iter, void *userdata) {
@@ -956,20 +1058,18 @@ static void handle_entry_set_volume(DBusConnection *conn, DBusMessage *msg, DBus
 
 static void handle_entry_get_mute(DBusConnection *conn, DBusMessage *msg, void *userdata) {
     struct dbus_entry *de = userdata;
-    struct entry *e;
+    const struct entry *e;
     dbus_bool_t mute;
 
     pa_assert(conn);
     pa_assert(msg);
     pa_assert(de);
 
-    pa_assert_se(e = entry_read(de->userdata, de->entry_name));
+    pa_assert_se(e = entry_get(de->userdata, de->entry_name));
 
     mute = e->muted_valid ? e->muted : FALSE;
 
     pa_dbus_send_basic_variant_reply(conn, msg, DBUS_TYPE_BOOLEAN, &mute);
-
-    entry_free(e);
 }
 
 static void handle_entry_set_mute(DBusConnection *conn, DBusMessage *msg, DBusMessageIter *iter, void *userdata) {
@@ -1007,7 +1107,7 @@ static void handle_entry_set_mute(DBusConnection *conn, DBusMessage *msg, DBusMe
 
 static void handle_entry_get_all(DBusConnection *conn, DBusMessage *msg, void *userdata) {
     struct dbus_entry *de = userdata;
-    struct entry *e;
+    const struct entry *e;
     DBusMessage *reply = NULL;
     DBusMessageIter msg_iter;
     DBusMessageIter dict_iter;
@@ -1019,7 +1119,7 @@ static void handle_entry_get_all(DBusConnection *conn, DBusMessage *msg, void *u
     pa_assert(msg);
     pa_assert(de);
 
-    pa_assert_se(e = entry_read(de->userdata, de->entry_name));
+    pa_assert_se(e = entry_get(de->userdata, de->entry_name));
 
     device = e->device_valid ? e->device : "";
     mute = e->muted_valid ? e->muted : FALSE;
@@ -1047,27 +1147,21 @@ static void handle_entry_get_all(DBusConnection *conn, DBusMessage *msg, void *u
     pa_assert_se(dbus_connection_send(conn, reply, NULL));
 
     dbus_message_unref(reply);
-
-    entry_free(e);
 }
 
 static void handle_entry_remove(DBusConnection *conn, DBusMessage *msg, void *userdata) {
     struct dbus_entry *de = userdata;
-    pa_datum key;
 
     pa_assert(conn);
     pa_assert(msg);
     pa_assert(de);
 
-    key.data = de->entry_name;
-    key.size = strlen(de->entry_name);
-
-    pa_assert_se(pa_database_unset(de->userdata->database, &key) == 0);
+    pa_assert_se(entry_remove(de->userdata, de->entry_name));
 
     send_entry_removed_signal(de);
     trigger_save(de->userdata);
 
-    pa_assert_se(pa_hashmap_remove_and_free(de->userdata->dbus_entries, de->entry_name) >= 0);
+    dbus_entries_remove(de->userdata, de->entry_name);
 
     pa_dbus_send_empty_reply(conn, msg);
 }
@@ -1097,24 +1191,18 @@ static void ext_sink_set_volume(pa_sink *s, const pa_cvolume *vol) {
 }
 
 static struct ext_sink_volume* ext_have_sink_volume(struct userdata *u, const char *mode) {
-    struct ext_sink_volume *v = NULL;
+    struct ext_sink_volume *v;
 
     pa_assert(u);
     pa_assert(mode);
 
-    for (v = u->sink_volumes; v; v = v->next) {
-        if (pa_streq(mode, v->mode)) {
-            if (!v->sink)
-                v->sink = pa_namereg_get(u->core, v->sink_name, PA_NAMEREG_SINK);
+    if (!(v = pa_hashmap_get(u->sink_volume_index, mode)))
+        return NULL;
 
-            if (v->sink)
-                return v;
-            else
-                return NULL;
-        }
-    }
+    if (!v->sink)
+        v->sink = pa_namereg_get(u->core, v->sink_name, PA_NAMEREG_SINK);
 
-    return NULL;
+    return v->sink ? v : NULL;
 }
 
 static void ext_free_sink_volumes(struct userdata *u) {
@@ -1122,6 +1210,8 @@ static void ext_free_sink_volumes(struct userdata *u) {
 
     pa_assert(u);
 
+    pa_hashmap_remove_all(u->sink_volume_index);
+
     while ((v = u->sink_volumes)) {
         PA_LLIST_REMOVE(struct ext_sink_volume, u->sink_volumes, v);
         pa_xfree(v->mode);
@@ -1133,24 +1223,20 @@ static void ext_free_sink_volumes(struct userdata *u) {
 /* return struct ext_route_volume* when entry with given
  * name exists, otherwise return NULL */
 static struct ext_route_volume* ext_get_route_volume_by_name(struct userdata *u, const char *name) {
-    struct ext_route_volume *ret = NULL;
-    struct ext_route_volume *r;
-
-    PA_LLIST_FOREACH(r, u->route_volumes) {
-        if (pa_streq(name, r->name)) {
-            ret = r;
-            break;
-        }
-    }
+    pa_assert(u);
+    pa_assert(name);
 
-    return ret;
+    return pa_hashmap_get(u->route_volume_index, name);
 }
 
 static void ext_set_route_volume(struct ext_route_volume *r, const pa_cvolume *volume) {
     pa_assert(r);
     pa_assert(pa_cvolume_valid(volume));
 
-    r->volume = *volume;
+    if (!pa_cvolume_equal(&r->volume, volume)) {
+        r->volume = *volume;
+        r->dirty = true;
+    }
 }
 
 static void ext_set_route_volume_by_name(struct userdata *u, const char *name, const pa_cvolume *volume) {
@@ -1179,6 +1265,7 @@ static void ext_set_route_volumes(struct userdata *u, const pa_cvolume *volume)
 }
 
 static void ext_set_stream(struct userdata *u, const char *name, const pa_volume_t volume, const int muted) {
+    struct stream_group *g;
     pa_sink_input *si;
     uint32_t idx;
     pa_channel_map from;
@@ -1190,21 +1277,13 @@ static void ext_set_stream(struct userdata *u, const char *name, const pa_volume
     pa_cvolume_init(&vol);
     pa_channel_map_init_mono(&from);
 
-    for (si = pa_idxset_first(u->core->sink_inputs, &idx); si; si = pa_idxset_next(u->core->sink_inputs, &idx)) {
-        char *n;
+    if (!(g = stream_group_get(u, name)))
+        return;
 
+    PA_IDXSET_FOREACH(si, g->sink_inputs, idx) {
         if (!si->sink) /* for eg. moving */
             continue;
 
-        if (!(n = pa_proplist_get_stream_group(si->proplist, "sink-input", IDENTIFICATION_PROPERTY)))
-            continue;
-
-        if (!pa_streq(name, n)) {
-            pa_xfree(n);
-            continue;
-        }
-        pa_xfree(n);
-
         if (si->volume_writable) {
             pa_log_info("Restoring volume for sink input %s. c %d vol %d", name, from.channels, volume);
             pa_cvolume_set(&vol, 1, volume);
@@ -1246,8 +1325,10 @@ static void ext_proxy_volume_all(struct userdata *u) {
     pa_assert(u->volume_proxy);
 
     /* proxy all route volumes */
-    PA_LLIST_FOREACH(r, u->route_volumes)
-        ext_proxy_volume(u, r->name, &r->volume);
+    PA_LLIST_FOREACH(r, u->route_volumes) {
+        pa_assert(pa_cvolume_valid(&r->volume));
+        pa_volume_proxy_set_volume_key(u->volume_proxy, r->proxy_key, &r->volume, true);
+    }
 }
 
 static pa_hook_result_t ext_volume_proxy_cb(pa_volume_proxy *p, pa_volume_proxy_entry *e, struct userdata *u) {
@@ -1259,7 +1340,7 @@ static pa_hook_result_t ext_volume_proxy_cb(pa_volume_proxy *p, pa_volume_proxy_
 
         if (!pa_cvolume_equal(&r->volume, &e->volume)) {
             pa_log_debug("route volume %s modified in changing hook.", e->name);
-            r->volume = e->volume;
+            ext_set_route_volume(r, &e->volume);
         }
 
         if (u->use_sink_volume) {
@@ -1285,66 +1366,81 @@ static char* ext_route_key(const char *name, const char *route) {
     return pa_sprintf_malloc("%s:%s", name, route);
 }
 
+/* Precompute route database keys when route changes. */
+static void ext_update_route_keys(struct userdata *u) {
+    struct ext_route_volume *r;
+
+    pa_assert(u);
+    pa_assert(u->route);
+
+    PA_LLIST_FOREACH(r, u->route_volumes) {
+        pa_xfree(r->route_key);
+        r->route_key = ext_route_key(r->name, u->route);
+    }
+}
+
 static void ext_free_route_volumes(struct userdata *u) {
     struct ext_route_volume *r;
 
     pa_assert(u);
 
+    pa_hashmap_remove_all(u->route_volume_index);
+
     while ((r = u->route_volumes)) {
         PA_LLIST_REMOVE(struct ext_route_volume, u->route_volumes, r);
         pa_xfree(r->name);
+        pa_xfree(r->route_key);
         pa_xfree(r);
     }
 }
 
-static struct ext_route_entry* ext_read_route_entry(struct userdata *u, const char *name, const char *route) {
-    pa_datum key, data;
-    char *route_key;
-    struct ext_route_entry *e;
-
+static const struct ext_route_entry* ext_read_route_entry(struct userdata *u, struct ext_route_volume *r) {
     pa_assert(u);
-    pa_assert(name);
-    pa_assert(route);
-
-    route_key = ext_route_key(name, route);
-    key.data = (char*) route_key;
-    key.size = strlen(route_key);
+    pa_assert(r);
+    pa_assert(r->route_key);
 
-    pa_zero(data);
+    return pa_hashmap_get(u->route_entries, r->route_key);
+}
 
-    pa_database_get(u->route_database, &key, &data);
+/* Load whole route database to route entries cache in one pass. */
+static void ext_route_entries_load(struct userdata *u) {
+    pa_datum key, data;
+    bool done;
 
-    if (!data.data)
-        goto fail;
+    pa_assert(u);
+    pa_assert(u->route_database);
 
-    if (data.size != sizeof(struct ext_route_entry)) {
-        /* This is probably just a database upgrade, hence let's not
-         * consider this more than a debug message */
-        pa_log_debug("Database contains entry for route %s of wrong size %lu != %lu. Probably due to uprade, ignoring.", route, (unsigned long) data.size, (unsigned long) sizeof(struct ext_route_entry));
-        goto fail;
-    }
+    done = !pa_database_first(u->route_database, &key, &data);
 
-    e = (struct ext_route_entry*) data.data;
+    while (!done) {
+        pa_datum next_key;
+        struct ext_route_entry *e = data.data;
+        char *route_key;
+
+        route_key = pa_xstrndup(key.data, key.size);
+
+        if (data.size != sizeof(struct ext_route_entry)) {
+            /* This is probably just a database upgrade, hence let's not
+             * consider this more than a debug message */
+            pa_log_debug("Database contains entry for %s of wrong size %lu != %lu. Probably due to uprade, ignoring.", route_key, (unsigned long) data.size, (unsigned long) sizeof(struct ext_route_entry));
+            pa_xfree(route_key);
+        } else if (e->version != EXT_ROUTE_ENTRY_VERSION) {
+            pa_log_debug("Version of database entry for %s doesn't match our version. Probably due to upgrade, ignoring.", route_key);
+            pa_xfree(route_key);
+        } else if (!pa_cvolume_valid(&e->volume)) {
+            pa_log_warn("Invalid volume stored in database for %s", route_key);
+            pa_xfree(route_key);
+        } else
+            pa_hashmap_put(u->route_entries, route_key, pa_xmemdup(e, sizeof(*e)));
 
-    if (e->version != EXT_ROUTE_ENTRY_VERSION) {
-        pa_log_debug("Version of database entry for route %s doesn't match our version. Probably due to upgrade, ignoring.", route);
-        goto fail;
-    }
+        pa_datum_free(&data);
 
-    if (!pa_cvolume_valid(&e->volume)) {
-        pa_log_warn("Invalid volume stored in database for route %s :: %s", name, route);
-        goto fail;
+        done = !pa_database_next(u->route_database, &key, &next_key, &data);
+        pa_datum_free(&key);
+        key = next_key;
     }
 
-    pa_xfree(route_key);
-
-    return e;
-
-fail:
-
-    pa_xfree(route_key);
-    pa_xfree(data.data);
-    return NULL;
+    pa_log_debug("Loaded %u route entries.", pa_hashmap_size(u->route_entries));
 }
 
 static bool ext_entry_has_volume_changed(struct entry *a, struct entry *b) {
@@ -1410,7 +1506,7 @@ static void ext_apply_route_volumes(struct userdata *u, bool apply) {
 }
 
 static void ext_update_volumes(struct userdata *u) {
-    struct ext_route_entry* e;
+    const struct ext_route_entry* e;
     struct ext_route_volume *r;
     char t[256];
 
@@ -1422,26 +1518,32 @@ static void ext_update_volumes(struct userdata *u) {
     if ((u->use_sink_volume = ext_have_sink_volume(u, u->route)) != NULL) {
         pa_log_debug("Using sink-volume for mode %s.", u->route);
 
-        if (u->subscription) {
-            pa_subscription_free(u->subscription);
-            u->subscription = NULL;
+        if (u->sink_input_slot) {
+            streams_unsubscribe(u);
+            streams_changed_clear(u);
         }
-        if (!u->sink_subscription)
-            u->sink_subscription = pa_subscription_new(u->core,
-                                                       PA_SUBSCRIPTION_MASK_SINK,
-                                                       ext_sink_volume_subscribe_cb,
-                                                       u);
+        /* Sink may differ from the previous sink-volume mode. */
+        if (u->sink_volume_slot)
+            pa_subscription_dispatcher_slot_free(u->sink_volume_slot);
+        u->sink_volume_slot = pa_subscription_dispatcher_connect(u->subscription_dispatcher,
+                                                                 PA_SUBSCRIPTION_EVENT_SINK,
+                                                                 u->use_sink_volume->sink->index,
+                                                                 PA_SUBSCRIPTION_DISPATCHER_CHANGE,
+                                                                 ext_sink_volume_subscribe_cb,
+                                                                 u);
 
         if (u->route_volumes) {
             r = u->route_volumes;
-            e = ext_read_route_entry(u, r->name, u->route);
-            if (e) {
+            e = ext_read_route_entry(u, r);
+            if (e)
                 r->volume = e->volume;
-                pa_xfree(e);
-            } else {
+            else
                 r->volume = r->default_volume;
-            }
             ext_set_route_volumes(u, &r->volume);
+            /* all route volumes follow the sink, store them for this route */
+            PA_LLIST_FOREACH(r, u->route_volumes)
+                r->dirty = true;
+            r = u->route_volumes;
             ext_set_streams(u, PA_VOLUME_NORM, -1);
             pa_log_debug("Restoring volume to sink %s: %s", u->use_sink_volume->sink->name,
                                                             pa_cvolume_snprint(t, sizeof(t), &r->volume));
@@ -1454,15 +1556,12 @@ static void ext_update_volumes(struct userdata *u) {
         return;
 
     } else {
-        if (u->sink_subscription) {
-            pa_subscription_free(u->sink_subscription);
-            u->sink_subscription = NULL;
+        if (u->sink_volume_slot) {
+            pa_subscription_dispatcher_slot_free(u->sink_volume_slot);
+            u->sink_volume_slot = NULL;
         }
-        if (!u->subscription)
-            u->subscription = pa_subscription_new(u->core,
-                                                  PA_SUBSCRIPTION_MASK_SINK_INPUT|PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT,
-                                                  subscribe_callback,
-                                                  u);
+        if (!u->sink_input_slot)
+            streams_subscribe(u);
     }
 
     /* ideally, scale stream-restore rules, by d dB: this is not
@@ -1474,7 +1573,9 @@ static void ext_update_volumes(struct userdata *u) {
     /* instead, let's restore our configured streams */
 
     for (r = u->route_volumes; r; r = r->next) {
-        e = ext_read_route_entry(u, r->name, u->route);
+        e = ext_read_route_entry(u, r);
+
+        r->dirty = true;
 
         if (!e) {
             r->volume = r->default_volume;
@@ -1488,9 +1589,9 @@ static void ext_update_volumes(struct userdata *u) {
                     r->volume = r->default_volume;
                 } else {
                     r->volume = e->volume;
+                    r->dirty = false;
                 }
             }
-            pa_xfree(e);
         }
 
         pa_log_debug("Restored stream %s route %s volume=%s", r->name, u->route, pa_cvolume_snprint(t, sizeof(t), &r->volume));
@@ -1511,10 +1612,15 @@ static void ext_check_mode(const char *mode, struct userdata *u) {
     if (u->route && pa_streq(mode, u->route))
         return;
 
+    /* pending route volumes belong to the route we are leaving */
+    if (ext_route_volumes_flush(u) > 0)
+        save_schedule(u);
+
     if (u->route)
         pa_xfree(u->route);
 
     u->route = pa_xstrdup(mode);
+    ext_update_route_keys(u);
 
     ext_update_volumes(u);
 }
@@ -1663,6 +1769,7 @@ static int ext_fill_route_db(struct userdata *u, const char *filename) {
             PA_LLIST_INIT(struct ext_route_volume, r);
 
             r->name = pa_xstrdup(ln);
+            r->proxy_key = pa_volume_proxy_key(u->volume_proxy, r->name);
             pa_cvolume_set(&r->volume, 1, pa_sw_volume_from_dB(db));
             r->default_volume = r->volume;
 
@@ -1675,8 +1782,11 @@ static int ext_fill_route_db(struct userdata *u, const char *filename) {
                 }
             }
 
-            /* append new route volume entry to list */
+            /* append new route volume entry to list, latest entry
+             * for a stream name shadows earlier ones */
             PA_LLIST_PREPEND(struct ext_route_volume, u->route_volumes, r);
+            pa_hashmap_remove(u->route_volume_index, r->name);
+            pa_hashmap_put(u->route_volume_index, r->name, r);
         }
     }
 
@@ -1748,6 +1858,8 @@ static int ext_fill_sink_db(struct userdata *u, const char *filename) {
         v->sink = pa_namereg_get(u->core, sink_name, PA_NAMEREG_SINK);
 
         PA_LLIST_PREPEND(struct ext_sink_volume, u->sink_volumes, v);
+        pa_hashmap_remove(u->sink_volume_index, v->mode);
+        pa_hashmap_put(u->sink_volume_index, v->mode, v);
 
         pa_log_debug("sink-volume, mode \"%s\" controls sink \"%s\"", mode, sink_name);
     }
@@ -1766,29 +1878,26 @@ finish:
     return ret;
 }
 
-static void ext_route_entry_write(struct userdata *u, struct ext_route_volume *r, const char *route) {
-    struct ext_route_entry entry;
+static void ext_route_entry_write(struct userdata *u, struct ext_route_volume *r) {
+    struct ext_route_entry entry, *cached;
     pa_datum key, data;
-    char *route_key;
     char t[256];
 
     pa_assert(u);
     pa_assert(r);
-    pa_assert(route);
+    pa_assert(r->route_key);
 
     if (!pa_cvolume_valid(&r->volume)) {
         pa_log("volume not valid for %s", r->name);
         return;
     }
 
-    route_key = ext_route_key(r->name, route);
-
     memset(&entry, 0, sizeof(entry));
     entry.version = EXT_ROUTE_ENTRY_VERSION;
     entry.volume = r->volume;
 
-    key.data = (void*) route_key;
-    key.size = (int) strlen(route_key);
+    key.data = (void*) r->route_key;
+    key.size = (int) strlen(r->route_key);
 
     data.data = (void*) &entry;
     data.size = (int) sizeof(entry);
@@ -1797,7 +1906,46 @@ static void ext_route_entry_write(struct userdata *u, struct ext_route_volume *r
 
     pa_log_debug("Save stream %s route %s volume=%s", u->route, r->name, pa_cvolume_snprint(t, sizeof(t), &r->volume));
 
-    pa_xfree(route_key);
+    if ((cached = pa_hashmap_get(u->route_entries, r->route_key)))
+        *cached = entry;
+    else
+        pa_hashmap_put(u->route_entries, pa_xstrdup(r->route_key), pa_xmemdup(&entry, sizeof(entry)));
+}
+
+/* Write route volumes changed since the last flush for the current route.
+ * Returns the number of entries written. */
+static unsigned ext_route_volumes_flush(struct userdata *u) {
+    struct ext_route_volume *r;
+    unsigned n = 0;
+
+    pa_assert(u);
+
+    if (!u->restore_route_volume || !u->route || !u->route_database)
+        return 0;
+
+    PA_LLIST_FOREACH(r, u->route_volumes) {
+        if (!r->dirty)
+            continue;
+
+        ext_route_entry_write(u, r);
+        r->dirty = false;
+        n++;
+    }
+
+    return n;
+}
+
+/* Device is about to idle, don't leave changes waiting for the timer. */
+static pa_hook_result_t ext_sink_state_changed_hook_callback(pa_core *c, pa_sink *s, struct userdata *u) {
+    pa_assert(s);
+    pa_assert(u);
+
+    if (s->state == PA_SINK_SUSPENDED && u->save_time_event) {
+        pa_log_debug("Sink %s suspended, saving pending changes.", s->name);
+        save_now(u);
+    }
+
+    return PA_HOOK_OK;
 }
 
 /* route extension functions end */
@@ -1811,15 +1959,53 @@ static void save_time_callback(pa_mainloop_api*a, pa_time_event* e, const struct
     pa_assert(u);
 
     pa_assert(e == u->save_time_event);
-    u->core->mainloop->time_free(u->save_time_event);
-    u->save_time_event = NULL;
 
-    pa_database_sync(u->database);
-    pa_database_sync(u->route_database);
+    save_now(u);
+}
+
+/* Write all pending changes and sync databases right away. */
+static void save_now(struct userdata *u) {
+    pa_assert(u);
+
+    if (u->save_time_event) {
+        u->core->mainloop->time_free(u->save_time_event);
+        u->save_time_event = NULL;
+    }
+
+    ext_route_volumes_flush(u);
+
+    if (u->database) {
+        entries_flush(u);
+        pa_database_sync(u->database);
+    }
+
+    if (u->route_database)
+        pa_database_sync(u->route_database);
 
     pa_log_info("Synced.");
 }
 
+/* Bursts of changes (volume key presses) are coalesced into one save:
+ * save when changes have settled for SAVE_DEBOUNCE, but no later than
+ * SAVE_INTERVAL after the first unsaved change. */
+static void save_schedule(struct userdata *u) {
+    pa_usec_t now, next;
+
+    pa_assert(u);
+
+    now = pa_rtclock_now();
+
+    if (!u->save_time_event)
+        u->save_deadline = now + SAVE_INTERVAL;
+
+    next = PA_MIN(now + SAVE_DEBOUNCE, u->save_deadline);
+
+    if (u->save_time_event)
+        pa_core_rttime_restart(u->core, u->save_time_event, next);
+    else
+        u->save_time_event = pa_core_rttime_new(u->core, next, save_time_callback, u);
+}
+
 static struct entry* entry_new(void) {
     struct entry *r = pa_xnew0(struct entry, 1);
     return r;
@@ -1833,43 +2019,90 @@ static void entry_free(struct entry* e) {
     pa_xfree(e);
 }
 
-static bool entry_write(struct userdata *u, const char *name, const struct entry *e, bool replace) {
-    pa_tagstruct *t;
+static void entry_set_dirty(struct userdata *u, const char *name) {
+    pa_assert(u);
+    pa_assert(name);
+
+    if (!pa_idxset_get_by_data(u->dirty_entries, name, NULL))
+        pa_idxset_put(u->dirty_entries, pa_xstrdup(name), NULL);
+}
+
+/* Encode entry as struct compact_entry record. Returns NULL if names
+ * don't fit the record. */
+static void *entry_encode(const struct entry *e, size_t *size) {
+    struct compact_entry h;
+    size_t device_length, card_length;
+    uint8_t *data, *p;
+    unsigned i;
+
+    pa_assert(e);
+    pa_assert(size);
+    pa_assert(e->channel_map.channels <= PA_CHANNELS_MAX);
+    pa_assert(e->volume.channels <= PA_CHANNELS_MAX);
+
+    device_length = e->device ? strlen(e->device) : 0;
+    card_length = e->card ? strlen(e->card) : 0;
+
+    if (device_length > UINT16_MAX || card_length > UINT16_MAX)
+        return NULL;
+
+    pa_zero(h);
+    h.version = ENTRY_VERSION;
+    h.flags = (e->volume_valid ? ENTRY_FLAG_VOLUME_VALID : 0) |
+              (e->muted_valid ? ENTRY_FLAG_MUTED_VALID : 0) |
+              (e->muted ? ENTRY_FLAG_MUTED : 0) |
+              (e->device_valid ? ENTRY_FLAG_DEVICE_VALID : 0) |
+              (e->card_valid ? ENTRY_FLAG_CARD_VALID : 0) |
+              (e->device ? ENTRY_FLAG_HAS_DEVICE : 0) |
+              (e->card ? ENTRY_FLAG_HAS_CARD : 0);
+    h.map_channels = e->channel_map.channels;
+    h.volume_channels = e->volume.channels;
+    h.device_length = (uint16_t) device_length;
+    h.card_length = (uint16_t) card_length;
+
+    *size = sizeof(h) + h.volume_channels * sizeof(pa_volume_t) + h.map_channels + device_length + card_length;
+    p = data = pa_xmalloc(*size);
+
+    memcpy(p, &h, sizeof(h));
+    p += sizeof(h);
+    memcpy(p, e->volume.values, h.volume_channels * sizeof(pa_volume_t));
+    p += h.volume_channels * sizeof(pa_volume_t);
+    for (i = 0; i < h.map_channels; i++)
+        *p++ = (uint8_t) e->channel_map.map[i];
+    if (device_length > 0)
+        memcpy(p, e->device, device_length);
+    p += device_length;
+    if (card_length > 0)
+        memcpy(p, e->card, card_length);
+
+    return data;
+}
+
+static void database_entry_write(struct userdata *u, const char *name, const struct entry *e) {
     pa_datum key, data;
-    bool r;
 
     pa_assert(u);
     pa_assert(name);
     pa_assert(e);
 
-    t = pa_tagstruct_new();
-    pa_tagstruct_putu8(t, ENTRY_VERSION);
-    pa_tagstruct_put_boolean(t, e->volume_valid);
-    pa_tagstruct_put_channel_map(t, &e->channel_map);
-    pa_tagstruct_put_cvolume(t, &e->volume);
-    pa_tagstruct_put_boolean(t, e->muted_valid);
-    pa_tagstruct_put_boolean(t, e->muted);
-    pa_tagstruct_put_boolean(t, e->device_valid);
-    pa_tagstruct_puts(t, e->device);
-    pa_tagstruct_put_boolean(t, e->card_valid);
-    pa_tagstruct_puts(t, e->card);
+    if (!(data.data = entry_encode(e, &data.size))) {
+        pa_log_warn("Entry %s doesn't fit database record.", name);
+        return;
+    }
 
     key.data = (char *) name;
     key.size = strlen(name);
 
-    data.data = (void*)pa_tagstruct_data(t, &data.size);
+    if (pa_database_set(u->database, &key, &data, true) < 0)
+        pa_log_warn("Failed to save entry %s.", name);
 
-    r = (pa_database_set(u->database, &key, &data, replace) == 0);
-
-    pa_tagstruct_free(t);
-
-    return r;
+    pa_xfree(data.data);
 }
 
 #ifdef ENABLE_LEGACY_DATABASE_ENTRY_FORMAT
 
 #define LEGACY_ENTRY_VERSION 3
-static struct entry *legacy_entry_read(struct userdata *u, const char *name) {
+static struct entry *legacy_entry_decode(const char *name, const pa_datum *data) {
     struct legacy_entry {
         uint8_t version;
         bool muted_valid:1, volume_valid:1, device_valid:1, card_valid:1;
@@ -1880,62 +2113,52 @@ static struct entry *legacy_entry_read(struct userdata *u, const char *name) {
         char card[PA_NAME_MAX];
     } PA_GCC_PACKED;
 
-    pa_datum key;
-    pa_datum data;
     struct legacy_entry *le;
     struct entry *e;
 
-    pa_assert(u);
     pa_assert(name);
+    pa_assert(data);
 
-    key.data = (char *) name;
-    key.size = strlen(name);
-
-    pa_zero(data);
-
-    if (!pa_database_get(u->database, &key, &data))
-        goto fail;
-
-    if (data.size != sizeof(struct legacy_entry)) {
+    if (data->size != sizeof(struct legacy_entry)) {
         pa_log_debug("Size does not match.");
-        goto fail;
+        return NULL;
     }
 
-    le = (struct legacy_entry *) data.data;
+    le = (struct legacy_entry *) data->data;
 
     if (le->version != LEGACY_ENTRY_VERSION) {
         pa_log_debug("Version mismatch.");
-        goto fail;
+        return NULL;
     }
 
     if (!memchr(le->device, 0, sizeof(le->device))) {
         pa_log_warn("Device has missing NUL byte.");
-        goto fail;
+        return NULL;
     }
 
     if (!memchr(le->card, 0, sizeof(le->card))) {
         pa_log_warn("Card has missing NUL byte.");
-        goto fail;
+        return NULL;
     }
 
     if (le->device_valid && !pa_namereg_is_valid_name(le->device)) {
         pa_log_warn("Invalid device name stored in database for legacy stream");
-        goto fail;
+        return NULL;
     }
 
     if (le->card_valid && !pa_namereg_is_valid_name(le->card)) {
         pa_log_warn("Invalid card name stored in database for legacy stream");
-        goto fail;
+        return NULL;
     }
 
     if (le->volume_valid && !pa_channel_map_valid(&le->channel_map)) {
         pa_log_warn("Invalid channel map stored in database for legacy stream");
-        goto fail;
+        return NULL;
     }
 
     if (le->volume_valid && (!pa_cvolume_valid(&le->volume) || !pa_cvolume_compatible_with_channel_map(&le->volume, &le->channel_map))) {
         pa_log_warn("Invalid volume stored in database for legacy stream");
-        goto fail;
+        return NULL;
     }
 
     e = entry_new();
@@ -1949,78 +2172,128 @@ static struct entry *legacy_entry_read(struct userdata *u, const char *name) {
     e->card_valid = le->card_valid;
     e->card = pa_xstrdup(le->card);
     return e;
-
-fail:
-    pa_datum_free(&data);
-
-    return NULL;
 }
 #endif
 
-static struct entry *entry_read(struct userdata *u, const char *name) {
-    pa_datum key, data;
-    struct entry *e = NULL;
-    pa_tagstruct *t = NULL;
-    uint8_t version;
-    const char *device, *card;
-
-    pa_assert(u);
+static bool entry_valid(const char *name, const struct entry *e) {
     pa_assert(name);
-
-    key.data = (char*) name;
-    key.size = strlen(name);
-
-    pa_zero(data);
-
-    if (!pa_database_get(u->database, &key, &data))
-        goto fail;
-
-    t = pa_tagstruct_new_fixed(data.data, data.size);
-    e = entry_new();
-
-    if (pa_tagstruct_getu8(t, &version) < 0 ||
-        version > ENTRY_VERSION ||
-        pa_tagstruct_get_boolean(t, &e->volume_valid) < 0 ||
-        pa_tagstruct_get_channel_map(t, &e->channel_map) < 0 ||
-        pa_tagstruct_get_cvolume(t, &e->volume) < 0 ||
-        pa_tagstruct_get_boolean(t, &e->muted_valid) < 0 ||
-        pa_tagstruct_get_boolean(t, &e->muted) < 0 ||
-        pa_tagstruct_get_boolean(t, &e->device_valid) < 0 ||
-        pa_tagstruct_gets(t, &device) < 0 ||
-        pa_tagstruct_get_boolean(t, &e->card_valid) < 0 ||
-        pa_tagstruct_gets(t, &card) < 0) {
-
-        goto fail;
-    }
-
-    e->device = pa_xstrdup(device);
-    e->card = pa_xstrdup(card);
-
-    if (!pa_tagstruct_eof(t))
-        goto fail;
+    pa_assert(e);
 
     if (e->device_valid && (!e->device || !pa_namereg_is_valid_name(e->device))) {
         pa_log_warn("Invalid device name stored in database for stream %s", name);
-        goto fail;
+        return false;
     }
 
     if (e->card_valid && (!e->card || !pa_namereg_is_valid_name(e->card))) {
         pa_log_warn("Invalid card name stored in database for stream %s", name);
-        goto fail;
+        return false;
     }
 
     if (e->volume_valid && !pa_channel_map_valid(&e->channel_map)) {
         pa_log_warn("Invalid channel map stored in database for stream %s", name);
-        goto fail;
+        return false;
     }
 
     if (e->volume_valid && (!pa_cvolume_valid(&e->volume) || !pa_cvolume_compatible_with_channel_map(&e->volume, &e->channel_map))) {
         pa_log_warn("Invalid volume stored in database for stream %s", name);
-        goto fail;
+        return false;
+    }
+
+    return true;
+}
+
+static struct entry *entry_decode(const char *name, const pa_datum *data) {
+    struct compact_entry h;
+    struct entry *e;
+    const uint8_t *p;
+    unsigned i;
+
+    pa_assert(name);
+    pa_assert(data);
+
+    if (data->size < sizeof(h))
+        return NULL;
+
+    memcpy(&h, data->data, sizeof(h));
+
+    if (h.version != ENTRY_VERSION ||
+        h.map_channels > PA_CHANNELS_MAX ||
+        h.volume_channels > PA_CHANNELS_MAX ||
+        data->size != sizeof(h) + h.volume_channels * sizeof(pa_volume_t) + h.map_channels + h.device_length + h.card_length)
+        return NULL;
+
+    e = entry_new();
+    e->volume_valid = !!(h.flags & ENTRY_FLAG_VOLUME_VALID);
+    e->muted_valid = !!(h.flags & ENTRY_FLAG_MUTED_VALID);
+    e->muted = !!(h.flags & ENTRY_FLAG_MUTED);
+    e->device_valid = !!(h.flags & ENTRY_FLAG_DEVICE_VALID);
+    e->card_valid = !!(h.flags & ENTRY_FLAG_CARD_VALID);
+
+    p = (const uint8_t *) data->data + sizeof(h);
+
+    e->volume.channels = h.volume_channels;
+    memcpy(e->volume.values, p, h.volume_channels * sizeof(pa_volume_t));
+    p += h.volume_channels * sizeof(pa_volume_t);
+
+    pa_channel_map_init(&e->channel_map);
+    e->channel_map.channels = h.map_channels;
+    for (i = 0; i < h.map_channels; i++)
+        e->channel_map.map[i] = p[i] < PA_CHANNEL_POSITION_MAX ? (pa_channel_position_t) p[i] : PA_CHANNEL_POSITION_INVALID;
+    p += h.map_channels;
+
+    if (h.flags & ENTRY_FLAG_HAS_DEVICE)
+        e->device = pa_xstrndup((const char *) p, h.device_length);
+    p += h.device_length;
+
+    if (h.flags & ENTRY_FLAG_HAS_CARD)
+        e->card = pa_xstrndup((const char *) p, h.card_length);
+
+    if (!entry_valid(name, e)) {
+        entry_free(e);
+        return NULL;
     }
 
+    return e;
+}
+
+/* Entries written before the compact record format, read for migration. */
+static struct entry *tagstruct_entry_decode(const char *name, const pa_datum *data) {
+    struct entry *e = NULL;
+    pa_tagstruct *t = NULL;
+    uint8_t version;
+    const char *device, *card;
+
+    pa_assert(name);
+    pa_assert(data);
+
+    t = pa_tagstruct_new_fixed(data->data, data->size);
+    e = entry_new();
+
+    if (pa_tagstruct_getu8(t, &version) < 0 ||
+        version > TAGSTRUCT_ENTRY_VERSION ||
+        pa_tagstruct_get_boolean(t, &e->volume_valid) < 0 ||
+        pa_tagstruct_get_channel_map(t, &e->channel_map) < 0 ||
+        pa_tagstruct_get_cvolume(t, &e->volume) < 0 ||
+        pa_tagstruct_get_boolean(t, &e->muted_valid) < 0 ||
+        pa_tagstruct_get_boolean(t, &e->muted) < 0 ||
+        pa_tagstruct_get_boolean(t, &e->device_valid) < 0 ||
+        pa_tagstruct_gets(t, &device) < 0 ||
+        pa_tagstruct_get_boolean(t, &e->card_valid) < 0 ||
+        pa_tagstruct_gets(t, &card) < 0) {
+
+        goto fail;
+    }
+
+    e->device = pa_xstrdup(device);
+    e->card = pa_xstrdup(card);
+
+    if (!pa_tagstruct_eof(t))
+        goto fail;
+
+    if (!entry_valid(name, e))
+        goto fail;
+
     pa_tagstruct_free(t);
-    pa_datum_free(&data);
 
     return e;
 
@@ -2030,10 +2303,148 @@ fail:
     if (t)
         pa_tagstruct_free(t);
 
-    pa_datum_free(&data);
     return NULL;
 }
 
+/* Load all entries from database to entries cache. Invalid entries are
+ * marked dirty, so that they are removed from database on next save, and
+ * entries in older formats likewise so that they are saved in current
+ * format. */
+static void entries_load(struct userdata *u) {
+    pa_datum key, data;
+    bool done;
+
+    pa_assert(u);
+    pa_assert(u->database);
+
+    done = !pa_database_first(u->database, &key, &data);
+
+    while (!done) {
+        pa_datum next_key;
+        char *name;
+        struct entry *e;
+
+        name = pa_xstrndup(key.data, key.size);
+
+        if ((e = entry_decode(name, &data))) {
+            pa_hashmap_put(u->entries, name, e);
+            name = NULL;
+        } else if ((e = tagstruct_entry_decode(name, &data))) {
+            pa_log_debug("Upgrading a tagstruct entry to the current format: %s", name);
+            pa_hashmap_put(u->entries, name, e);
+            entry_set_dirty(u, name);
+            name = NULL;
+        }
+#ifdef ENABLE_LEGACY_DATABASE_ENTRY_FORMAT
+        else if ((e = legacy_entry_decode(name, &data))) {
+            pa_log_debug("Upgrading a legacy entry to the current format: %s", name);
+            pa_hashmap_put(u->entries, name, e);
+            entry_set_dirty(u, name);
+            name = NULL;
+        }
+#endif
+        else {
+            pa_log_debug("Removing an invalid entry: %s", name);
+            entry_set_dirty(u, name);
+        }
+
+        pa_xfree(name);
+        pa_datum_free(&data);
+
+        done = !pa_database_next(u->database, &key, &next_key, &data);
+        pa_datum_free(&key);
+        key = next_key;
+    }
+
+    pa_log_debug("Loaded %u entries.", pa_hashmap_size(u->entries));
+
+    if (!pa_idxset_isempty(u->dirty_entries))
+        trigger_save(u);
+}
+
+/* Write changed entries to database and remove entries that are gone. */
+static void entries_flush(struct userdata *u) {
+    char *name;
+    const struct entry *e;
+    pa_datum key;
+
+    pa_assert(u);
+
+    while ((name = pa_idxset_steal_first(u->dirty_entries, NULL))) {
+        if ((e = pa_hashmap_get(u->entries, name)))
+            database_entry_write(u, name, e);
+        else {
+            key.data = name;
+            key.size = strlen(name);
+
+            pa_database_unset(u->database, &key);
+        }
+
+        pa_xfree(name);
+    }
+}
+
+/* Cached entry, valid until entry is written or removed. */
+static const struct entry *entry_get(struct userdata *u, const char *name) {
+    pa_assert(u);
+    pa_assert(name);
+
+    return pa_hashmap_get(u->entries, name);
+}
+
+/* Copy of cached entry, free with entry_free(). */
+static struct entry *entry_read(struct userdata *u, const char *name) {
+    const struct entry *e;
+
+    if (!(e = entry_get(u, name)))
+        return NULL;
+
+    return entry_copy(e);
+}
+
+static bool entry_write(struct userdata *u, const char *name, const struct entry *e, bool replace) {
+    pa_assert(u);
+    pa_assert(name);
+    pa_assert(e);
+
+    if (pa_hashmap_get(u->entries, name)) {
+        if (!replace)
+            return false;
+
+        pa_hashmap_remove_and_free(u->entries, name);
+    }
+
+    pa_hashmap_put(u->entries, pa_xstrdup(name), entry_copy(e));
+    entry_set_dirty(u, name);
+
+    return true;
+}
+
+static bool entry_remove(struct userdata *u, const char *name) {
+    pa_assert(u);
+    pa_assert(name);
+
+    if (pa_hashmap_remove_and_free(u->entries, name) < 0)
+        return false;
+
+    entry_set_dirty(u, name);
+
+    return true;
+}
+
+static void entries_clear(struct userdata *u) {
+    const char *name;
+    struct entry *e;
+    void *state;
+
+    pa_assert(u);
+
+    PA_HASHMAP_FOREACH_KV(name, e, u->entries, state)
+        entry_set_dirty(u, name);
+
+    pa_hashmap_remove_all(u->entries);
+}
+
 static struct entry* entry_copy(const struct entry *e) {
     struct entry* r;
 
@@ -2048,7 +2459,6 @@ static struct entry* entry_copy(const struct entry *e) {
 static void trigger_save(struct userdata *u) {
     pa_native_connection *c;
     uint32_t idx;
-    struct ext_route_volume *r;
 
     PA_IDXSET_FOREACH(c, u->subscribed, idx) {
         pa_tagstruct *t;
@@ -2063,20 +2473,7 @@ static void trigger_save(struct userdata *u) {
         pa_pstream_send_tagstruct(pa_native_connection_get_pstream(c), t);
     }
 
-    if (!u->restore_route_volume)
-        goto end;
-
-    if (!u->route)
-        goto end;
-
-    for (r = u->route_volumes; r; r = r->next)
-        ext_route_entry_write(u, r, u->route);
-
-end:
-    if (u->save_time_event)
-        return;
-
-    u->save_time_event = pa_core_rttime_new(u->core, pa_rtclock_now() + SAVE_INTERVAL, save_time_callback, u);
+    save_schedule(u);
 }
 
 static bool entries_equal(const struct entry *a, const struct entry *b) {
@@ -2105,9 +2502,10 @@ static bool entries_equal(const struct entry *a, const struct entry *b) {
     return true;
 }
 
-static void subscribe_callback(pa_core *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata) {
+static void store_stream(pa_core *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata) {
     struct userdata *u = userdata;
-    struct entry *entry, *old = NULL;
+    struct entry *entry;
+    const struct entry *old = NULL;
     char *name = NULL;
 
     /* These are only used when D-Bus is enabled, but in order to reduce ifdef
@@ -2148,7 +2546,7 @@ static void subscribe_callback(pa_core *c, pa_subscription_event_type_t t, uint3
         if (!(name = pa_proplist_get_stream_group(sink_input->proplist, "sink-input", IDENTIFICATION_PROPERTY)))
             return;
 
-        if ((old = entry_read(u, name))) {
+        if ((old = entry_get(u, name))) {
             entry = entry_copy(old);
             created_new_entry = false;
         } else
@@ -2208,7 +2606,7 @@ static void subscribe_callback(pa_core *c, pa_subscription_event_type_t t, uint3
         if (!(name = pa_proplist_get_stream_group(source_output->proplist, "source-output", IDENTIFICATION_PROPERTY)))
             return;
 
-        if ((old = entry_read(u, name))) {
+        if ((old = entry_get(u, name))) {
             entry = entry_copy(old);
             created_new_entry = false;
         } else
@@ -2257,16 +2655,10 @@ static void subscribe_callback(pa_core *c, pa_subscription_event_type_t t, uint3
 
     pa_assert(entry);
 
-    if (old) {
-
-        if (entries_equal(old, entry)) {
-            entry_free(old);
-            entry_free(entry);
-            pa_xfree(name);
-            return;
-        }
-
-        entry_free(old);
+    if (old && entries_equal(old, entry)) {
+        entry_free(entry);
+        pa_xfree(name);
+        return;
     }
 
     pa_log_info("Storing volume/mute/device for stream %s.", name);
@@ -2284,7 +2676,7 @@ static void subscribe_callback(pa_core *c, pa_subscription_event_type_t t, uint3
 #ifdef HAVE_DBUS
     if (!(de = pa_hashmap_get(u->dbus_entries, name))) {
         de = dbus_entry_new(u, name);
-        pa_assert_se(pa_hashmap_put(u->dbus_entries, de->entry_name, de) == 0);
+        dbus_entries_put(u, de);
         send_new_entry_signal(de);
     } else {
         if (device_updated)
@@ -2308,9 +2700,93 @@ static void subscribe_callback(pa_core *c, pa_subscription_event_type_t t, uint3
     pa_xfree(name);
 }
 
+/* Volume ramps cause a burst of change events for a stream. Changed
+ * streams are collected and stored once per main loop iteration, so only
+ * the latest state of each stream is compared, stored and signalled. */
+static void subscribe_callback(pa_core *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(c);
+    pa_assert(u);
+
+    if (t == (PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_NEW) ||
+        t == (PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE))
+        pa_idxset_put(u->changed_sink_inputs, PA_UINT32_TO_PTR(idx), NULL);
+    else if (t == (PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT|PA_SUBSCRIPTION_EVENT_NEW) ||
+             t == (PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT|PA_SUBSCRIPTION_EVENT_CHANGE))
+        pa_idxset_put(u->changed_source_outputs, PA_UINT32_TO_PTR(idx), NULL);
+    else
+        return;
+
+    u->core->mainloop->defer_enable(u->streams_changed_event, 1);
+}
+
+static void streams_subscribe(struct userdata *u) {
+    pa_assert(u);
+
+    u->sink_input_slot = pa_subscription_dispatcher_connect(u->subscription_dispatcher,
+                                                            PA_SUBSCRIPTION_EVENT_SINK_INPUT,
+                                                            PA_INVALID_INDEX,
+                                                            PA_SUBSCRIPTION_DISPATCHER_NEW | PA_SUBSCRIPTION_DISPATCHER_CHANGE,
+                                                            subscribe_callback,
+                                                            u);
+    u->source_output_slot = pa_subscription_dispatcher_connect(u->subscription_dispatcher,
+                                                               PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT,
+                                                               PA_INVALID_INDEX,
+                                                               PA_SUBSCRIPTION_DISPATCHER_NEW | PA_SUBSCRIPTION_DISPATCHER_CHANGE,
+                                                               subscribe_callback,
+                                                               u);
+}
+
+static void streams_unsubscribe(struct userdata *u) {
+    pa_assert(u);
+
+    if (u->sink_input_slot) {
+        pa_subscription_dispatcher_slot_free(u->sink_input_slot);
+        u->sink_input_slot = NULL;
+    }
+
+    if (u->source_output_slot) {
+        pa_subscription_dispatcher_slot_free(u->source_output_slot);
+        u->source_output_slot = NULL;
+    }
+}
+
+static void streams_changed_defer_cb(pa_mainloop_api *a, pa_defer_event *e, void *userdata) {
+    struct userdata *u = userdata;
+    uint32_t idx;
+
+    pa_assert(a);
+    pa_assert(u);
+
+    a->defer_enable(e, 0);
+
+    /* Index 0 is stored as NULL, so test for emptiness instead of the
+     * stolen pointer. */
+    while (!pa_idxset_isempty(u->changed_sink_inputs)) {
+        idx = PA_PTR_TO_UINT32(pa_idxset_steal_first(u->changed_sink_inputs, NULL));
+        store_stream(u->core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE, idx, u);
+    }
+
+    while (!pa_idxset_isempty(u->changed_source_outputs)) {
+        idx = PA_PTR_TO_UINT32(pa_idxset_steal_first(u->changed_source_outputs, NULL));
+        store_stream(u->core, PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT|PA_SUBSCRIPTION_EVENT_CHANGE, idx, u);
+    }
+}
+
+/* Forget changes not yet stored, when stream changes are no longer
+ * followed. */
+static void streams_changed_clear(struct userdata *u) {
+    pa_assert(u);
+
+    pa_idxset_remove_all(u->changed_sink_inputs, NULL);
+    pa_idxset_remove_all(u->changed_source_outputs, NULL);
+    u->core->mainloop->defer_enable(u->streams_changed_event, 0);
+}
+
 static pa_hook_result_t sink_input_new_hook_callback(pa_core *c, pa_sink_input_new_data *new_data, struct userdata *u) {
     char *name;
-    struct entry *e;
+    const struct entry *e;
 
     pa_assert(c);
     pa_assert(new_data);
@@ -2324,7 +2800,7 @@ static pa_hook_result_t sink_input_new_hook_callback(pa_core *c, pa_sink_input_n
         pa_log_debug("Not restoring device for stream %s, because already set to '%s'.", name, new_data->sink->name);
     else if (new_data->origin_sink)
         pa_log_debug("Not restoring device for stream %s, because it connects a filter to the master sink.", name);
-    else if ((e = entry_read(u, name))) {
+    else if ((e = entry_get(u, name))) {
         pa_sink *s = NULL;
 
         if (e->device_valid) {
@@ -2347,8 +2823,6 @@ static pa_hook_result_t sink_input_new_hook_callback(pa_core *c, pa_sink_input_n
                 if (pa_sink_input_new_data_set_sink(new_data, s, true, false))
                     pa_log_info("Restoring device for stream %s.", name);
 	    }
-
-        entry_free(e);
     }
 
     pa_xfree(name);
@@ -2358,7 +2832,7 @@ static pa_hook_result_t sink_input_new_hook_callback(pa_core *c, pa_sink_input_n
 
 static pa_hook_result_t sink_input_fixate_hook_callback(pa_core *c, pa_sink_input_new_data *new_data, struct userdata *u) {
     char *name;
-    struct entry *e;
+    const struct entry *e;
 
     pa_assert(c);
     pa_assert(new_data);
@@ -2373,7 +2847,7 @@ static pa_hook_result_t sink_input_fixate_hook_callback(pa_core *c, pa_sink_inpu
         return PA_HOOK_OK;
     }
 
-    if ((e = entry_read(u, name))) {
+    if ((e = entry_get(u, name))) {
 
         if (u->restore_volume && e->volume_valid) {
             if (!new_data->volume_writable)
@@ -2383,14 +2857,15 @@ static pa_hook_result_t sink_input_fixate_hook_callback(pa_core *c, pa_sink_inpu
             else {
                 pa_cvolume v;
 
+                v = e->volume;
+
                 /* If we are in sink-volume mode and our route role streams appear, we set them to
                  * PA_VOLUME_NORM */
                 if (u->use_sink_volume && (ext_get_route_volume_by_name(u, name) != NULL))
-                    pa_cvolume_set(&e->volume, e->volume.channels, PA_VOLUME_NORM);
+                    pa_cvolume_set(&v, v.channels, PA_VOLUME_NORM);
 
                 pa_log_info("Restoring volume for sink input %s.", name);
 
-                v = e->volume;
                 pa_cvolume_remap(&v, &e->channel_map, &new_data->channel_map);
                 pa_sink_input_new_data_set_volume(new_data, &v);
 
@@ -2408,8 +2883,6 @@ static pa_hook_result_t sink_input_fixate_hook_callback(pa_core *c, pa_sink_inpu
             } else
                 pa_log_debug("Not restoring mute state for sink input %s, because already set.", name);
         }
-
-        entry_free(e);
     }
 
     pa_xfree(name);
@@ -2419,7 +2892,7 @@ static pa_hook_result_t sink_input_fixate_hook_callback(pa_core *c, pa_sink_inpu
 
 static pa_hook_result_t source_output_new_hook_callback(pa_core *c, pa_source_output_new_data *new_data, struct userdata *u) {
     char *name;
-    struct entry *e;
+    const struct entry *e;
 
     pa_assert(c);
     pa_assert(new_data);
@@ -2436,7 +2909,7 @@ static pa_hook_result_t source_output_new_hook_callback(pa_core *c, pa_source_ou
         pa_log_debug("Not restoring device for stream %s, because already set", name);
     else if (new_data->destination_source)
         pa_log_debug("Not restoring device for stream %s, because it connects a filter to the master source.", name);
-    else if ((e = entry_read(u, name))) {
+    else if ((e = entry_get(u, name))) {
         pa_source *s = NULL;
 
         if (e->device_valid) {
@@ -2460,8 +2933,6 @@ static pa_hook_result_t source_output_new_hook_callback(pa_core *c, pa_source_ou
                 pa_source_output_new_data_set_source(new_data, s, true, false);
 	    }
         }
-
-        entry_free(e);
     }
 
     pa_xfree(name);
@@ -2471,7 +2942,7 @@ static pa_hook_result_t source_output_new_hook_callback(pa_core *c, pa_source_ou
 
 static pa_hook_result_t source_output_fixate_hook_callback(pa_core *c, pa_source_output_new_data *new_data, struct userdata *u) {
     char *name;
-    struct entry *e;
+    const struct entry *e;
 
     pa_assert(c);
     pa_assert(new_data);
@@ -2486,7 +2957,7 @@ static pa_hook_result_t source_output_fixate_hook_callback(pa_core *c, pa_source
         return PA_HOOK_OK;
     }
 
-    if ((e = entry_read(u, name))) {
+    if ((e = entry_get(u, name))) {
 
         if (u->restore_volume && e->volume_valid) {
             if (!new_data->volume_writable)
@@ -2516,8 +2987,6 @@ static pa_hook_result_t source_output_fixate_hook_callback(pa_core *c, pa_source
             } else
                 pa_log_debug("Not restoring mute state for source output %s, because already set.", name);
         }
-
-        entry_free(e);
     }
 
     pa_xfree(name);
@@ -2600,7 +3069,136 @@ finish:
     return ret;
 }
 
+static void stream_group_free(struct stream_group *g) {
+    pa_assert(g);
+
+    pa_idxset_free(g->sink_inputs, NULL);
+    pa_idxset_free(g->source_outputs, NULL);
+    pa_xfree(g->name);
+    pa_xfree(g);
+}
+
+static struct stream_group *stream_group_get(struct userdata *u, const char *name) {
+    pa_assert(u);
+    pa_assert(name);
+
+    return pa_hashmap_get(u->stream_groups, name);
+}
+
+/* Move stream to the group called name, or only drop it from its current
+ * group if name is NULL. Groups without streams are freed. */
+static void stream_index_update(struct userdata *u, void *stream, bool sink_input, const char *name) {
+    pa_hashmap *streams;
+    struct stream_group *g;
+
+    pa_assert(u);
+    pa_assert(stream);
+
+    streams = sink_input ? u->sink_input_groups : u->source_output_groups;
+
+    if ((g = pa_hashmap_get(streams, stream))) {
+        if (name && pa_streq(g->name, name))
+            return;
+
+        pa_hashmap_remove(streams, stream);
+        pa_idxset_remove_by_data(sink_input ? g->sink_inputs : g->source_outputs, stream, NULL);
+
+        if (pa_idxset_isempty(g->sink_inputs) && pa_idxset_isempty(g->source_outputs))
+            pa_hashmap_remove_and_free(u->stream_groups, g->name);
+    }
+
+    if (!name)
+        return;
+
+    if (!(g = stream_group_get(u, name))) {
+        g = pa_xnew0(struct stream_group, 1);
+        g->name = pa_xstrdup(name);
+        g->sink_inputs = pa_idxset_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+        g->source_outputs = pa_idxset_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+        pa_hashmap_put(u->stream_groups, g->name, g);
+    }
+
+    pa_idxset_put(sink_input ? g->sink_inputs : g->source_outputs, stream, NULL);
+    pa_hashmap_put(streams, stream, g);
+}
+
+static void sink_input_index_update(struct userdata *u, pa_sink_input *si) {
+    char *name;
+
+    name = pa_proplist_get_stream_group(si->proplist, "sink-input", IDENTIFICATION_PROPERTY);
+    stream_index_update(u, si, true, name);
+    pa_xfree(name);
+}
+
+static void source_output_index_update(struct userdata *u, pa_source_output *so) {
+    char *name;
+
+    name = pa_proplist_get_stream_group(so->proplist, "source-output", IDENTIFICATION_PROPERTY);
+    stream_index_update(u, so, false, name);
+    pa_xfree(name);
+}
+
+static pa_hook_result_t sink_input_put_hook_callback(pa_core *c, pa_sink_input *si, struct userdata *u) {
+    sink_input_index_update(u, si);
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_input_unlink_hook_callback(pa_core *c, pa_sink_input *si, struct userdata *u) {
+    stream_index_update(u, si, true, NULL);
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t source_output_put_hook_callback(pa_core *c, pa_source_output *so, struct userdata *u) {
+    source_output_index_update(u, so);
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t source_output_unlink_hook_callback(pa_core *c, pa_source_output *so, struct userdata *u) {
+    stream_index_update(u, so, false, NULL);
+    return PA_HOOK_OK;
+}
+
+static void stream_index_init(struct userdata *u) {
+    pa_sink_input *si;
+    pa_source_output *so;
+    uint32_t idx;
+
+    pa_assert(u);
+
+    u->stream_groups = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                                           NULL, (pa_free_cb_t) stream_group_free);
+    u->sink_input_groups = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+    u->source_output_groups = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+
+    pa_module_hook_connect(u->module, &u->core->hooks[PA_CORE_HOOK_SINK_INPUT_PUT], PA_HOOK_EARLY, (pa_hook_cb_t) sink_input_put_hook_callback, u);
+    pa_module_hook_connect(u->module, &u->core->hooks[PA_CORE_HOOK_SINK_INPUT_UNLINK], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_unlink_hook_callback, u);
+    pa_module_hook_connect(u->module, &u->core->hooks[PA_CORE_HOOK_SINK_INPUT_PROPLIST_CHANGED], PA_HOOK_EARLY, (pa_hook_cb_t) sink_input_put_hook_callback, u);
+    pa_module_hook_connect(u->module, &u->core->hooks[PA_CORE_HOOK_SOURCE_OUTPUT_PUT], PA_HOOK_EARLY, (pa_hook_cb_t) source_output_put_hook_callback, u);
+    pa_module_hook_connect(u->module, &u->core->hooks[PA_CORE_HOOK_SOURCE_OUTPUT_UNLINK], PA_HOOK_LATE, (pa_hook_cb_t) source_output_unlink_hook_callback, u);
+    pa_module_hook_connect(u->module, &u->core->hooks[PA_CORE_HOOK_SOURCE_OUTPUT_PROPLIST_CHANGED], PA_HOOK_EARLY, (pa_hook_cb_t) source_output_put_hook_callback, u);
+
+    PA_IDXSET_FOREACH(si, u->core->sink_inputs, idx)
+        sink_input_index_update(u, si);
+
+    PA_IDXSET_FOREACH(so, u->core->source_outputs, idx)
+        source_output_index_update(u, so);
+}
+
+static void stream_index_done(struct userdata *u) {
+    pa_assert(u);
+
+    if (u->sink_input_groups)
+        pa_hashmap_free(u->sink_input_groups);
+
+    if (u->source_output_groups)
+        pa_hashmap_free(u->source_output_groups);
+
+    if (u->stream_groups)
+        pa_hashmap_free(u->stream_groups);
+}
+
 static void entry_apply(struct userdata *u, const char *name, struct entry *e) {
+    struct stream_group *g;
     pa_sink_input *si;
     pa_source_output *so;
     uint32_t idx;
@@ -2609,18 +3207,11 @@ static void entry_apply(struct userdata *u, const char *name, struct entry *e) {
     pa_assert(name);
     pa_assert(e);
 
-    PA_IDXSET_FOREACH(si, u->core->sink_inputs, idx) {
-        char *n;
-        pa_sink *s;
-
-        if (!(n = pa_proplist_get_stream_group(si->proplist, "sink-input", IDENTIFICATION_PROPERTY)))
-            continue;
+    if (!(g = stream_group_get(u, name)))
+        return;
 
-        if (!pa_streq(name, n)) {
-            pa_xfree(n);
-            continue;
-        }
-        pa_xfree(n);
+    PA_IDXSET_FOREACH(si, g->sink_inputs, idx) {
+        pa_sink *s;
 
         if (u->restore_volume && e->volume_valid && si->volume_writable) {
             pa_cvolume v;
@@ -2653,19 +3244,9 @@ static void entry_apply(struct userdata *u, const char *name, struct entry *e) {
         }
     }
 
-    PA_IDXSET_FOREACH(so, u->core->source_outputs, idx) {
-        char *n;
+    PA_IDXSET_FOREACH(so, g->source_outputs, idx) {
         pa_source *s;
 
-        if (!(n = pa_proplist_get_stream_group(so->proplist, "source-output", IDENTIFICATION_PROPERTY)))
-            continue;
-
-        if (!pa_streq(name, n)) {
-            pa_xfree(n);
-            continue;
-        }
-        pa_xfree(n);
-
         if (u->restore_volume && e->volume_valid && so->volume_writable) {
             pa_cvolume v;
 
@@ -2699,36 +3280,19 @@ static void entry_apply(struct userdata *u, const char *name, struct entry *e) {
 
 #ifdef DEBUG_VOLUME
 PA_GCC_UNUSED static void stream_restore_dump_database(struct userdata *u) {
-    pa_datum key;
-    bool done;
-
-    done = !pa_database_first(u->database, &key, NULL);
-
-    while (!done) {
-        pa_datum next_key;
-        struct entry *e;
-        char *name;
-
-        done = !pa_database_next(u->database, &key, &next_key, NULL);
-
-        name = pa_xstrndup(key.data, key.size);
-        pa_datum_free(&key);
-
-        if ((e = entry_read(u, name))) {
-            char t[256];
-            pa_log("name=%s", name);
-            pa_log("device=%s %s", e->device, pa_yes_no(e->device_valid));
-            pa_log("channel_map=%s", pa_channel_map_snprint(t, sizeof(t), &e->channel_map));
-            pa_log("volume=%s %s",
-                   pa_cvolume_snprint_verbose(t, sizeof(t), &e->volume, &e->channel_map, true),
-                   pa_yes_no(e->volume_valid));
-            pa_log("mute=%s %s", pa_yes_no(e->muted), pa_yes_no(e->volume_valid));
-            entry_free(e);
-        }
-
-        pa_xfree(name);
+    const char *name;
+    struct entry *e;
+    void *state;
 
-        key = next_key;
+    PA_HASHMAP_FOREACH_KV(name, e, u->entries, state) {
+        char t[256];
+        pa_log("name=%s", name);
+        pa_log("device=%s %s", e->device, pa_yes_no(e->device_valid));
+        pa_log("channel_map=%s", pa_channel_map_snprint(t, sizeof(t), &e->channel_map));
+        pa_log("volume=%s %s",
+               pa_cvolume_snprint_verbose(t, sizeof(t), &e->volume, &e->channel_map, true),
+               pa_yes_no(e->volume_valid));
+        pa_log("mute=%s %s", pa_yes_no(e->muted), pa_yes_no(e->volume_valid));
     }
 }
 #endif
@@ -2764,40 +3328,22 @@ static int extension_cb(pa_native_protocol *p, pa_module *m, pa_native_connectio
         }
 
         case SUBCOMMAND_READ: {
-            pa_datum key;
-            bool done;
+            const char *name;
+            struct entry *e;
+            void *state;
 
             if (!pa_tagstruct_eof(t))
                 goto fail;
 
-            done = !pa_database_first(u->database, &key, NULL);
-
-            while (!done) {
-                pa_datum next_key;
-                struct entry *e;
-                char *name;
-
-                done = !pa_database_next(u->database, &key, &next_key, NULL);
-
-                name = pa_xstrndup(key.data, key.size);
-                pa_datum_free(&key);
-
-                if ((e = entry_read(u, name))) {
-                    pa_cvolume r;
-                    pa_channel_map cm;
-
-                    pa_tagstruct_puts(reply, name);
-                    pa_tagstruct_put_channel_map(reply, e->volume_valid ? &e->channel_map : pa_channel_map_init(&cm));
-                    pa_tagstruct_put_cvolume(reply, e->volume_valid ? &e->volume : pa_cvolume_init(&r));
-                    pa_tagstruct_puts(reply, e->device_valid ? e->device : NULL);
-                    pa_tagstruct_put_boolean(reply, e->muted_valid ? e->muted : false);
+            PA_HASHMAP_FOREACH_KV(name, e, u->entries, state) {
+                pa_cvolume r;
+                pa_channel_map cm;
 
-                    entry_free(e);
-                }
-
-                pa_xfree(name);
-
-                key = next_key;
+                pa_tagstruct_puts(reply, name);
+                pa_tagstruct_put_channel_map(reply, e->volume_valid ? &e->channel_map : pa_channel_map_init(&cm));
+                pa_tagstruct_put_cvolume(reply, e->volume_valid ? &e->volume : pa_cvolume_init(&r));
+                pa_tagstruct_puts(reply, e->device_valid ? e->device : NULL);
+                pa_tagstruct_put_boolean(reply, e->muted_valid ? e->muted : false);
             }
 
             break;
@@ -2823,10 +3369,10 @@ static int extension_cb(pa_native_protocol *p, pa_module *m, pa_native_connectio
 
                 PA_HASHMAP_FOREACH(de, u->dbus_entries, state) {
                     send_entry_removed_signal(de);
-                    pa_hashmap_remove_and_free(u->dbus_entries, de->entry_name);
+                    dbus_entries_remove(u, de->entry_name);
                 }
 #endif
-                pa_database_clear(u->database);
+                entries_clear(u);
             }
 
             while (!pa_tagstruct_eof(t)) {
@@ -2910,7 +3456,7 @@ static int extension_cb(pa_native_protocol *p, pa_module *m, pa_native_connectio
 
                     } else {
                         de = dbus_entry_new(u, name);
-                        pa_assert_se(pa_hashmap_put(u->dbus_entries, de->entry_name, de) == 0);
+                        dbus_entries_put(u, de);
                         send_new_entry_signal(de);
                     }
 #endif
@@ -2943,7 +3489,6 @@ static int extension_cb(pa_native_protocol *p, pa_module *m, pa_native_connectio
 
             while (!pa_tagstruct_eof(t)) {
                 const char *name;
-                pa_datum key;
 #ifdef HAVE_DBUS
                 struct dbus_entry *de;
 #endif
@@ -2954,14 +3499,11 @@ static int extension_cb(pa_native_protocol *p, pa_module *m, pa_native_connectio
 #ifdef HAVE_DBUS
                 if ((de = pa_hashmap_get(u->dbus_entries, name))) {
                     send_entry_removed_signal(de);
-                    pa_hashmap_remove_and_free(u->dbus_entries, name);
+                    dbus_entries_remove(u, name);
                 }
 #endif
 
-                key.data = (char*) name;
-                key.size = strlen(name);
-
-                pa_database_unset(u->database, &key);
+                entry_remove(u, name);
             }
 
             trigger_save(u);
@@ -3008,101 +3550,6 @@ static pa_hook_result_t connection_unlink_hook_cb(pa_native_protocol *p, pa_nati
     return PA_HOOK_OK;
 }
 
-static void clean_up_db(struct userdata *u) {
-    struct clean_up_item {
-        PA_LLIST_FIELDS(struct clean_up_item);
-        char *entry_name;
-        struct entry *entry;
-    };
-
-    PA_LLIST_HEAD(struct clean_up_item, to_be_removed);
-#ifdef ENABLE_LEGACY_DATABASE_ENTRY_FORMAT
-    PA_LLIST_HEAD(struct clean_up_item, to_be_converted);
-#endif
-    bool done = false;
-    pa_datum key;
-    struct clean_up_item *item = NULL;
-    struct clean_up_item *next = NULL;
-
-    pa_assert(u);
-
-    /* It would be convenient to remove or replace the entries in the database
-     * in the same loop that iterates through the database, but modifying the
-     * database is not supported while iterating through it. That's why we
-     * collect the entries that need to be removed or replaced to these
-     * lists. */
-    PA_LLIST_HEAD_INIT(struct clean_up_item, to_be_removed);
-#ifdef ENABLE_LEGACY_DATABASE_ENTRY_FORMAT
-    PA_LLIST_HEAD_INIT(struct clean_up_item, to_be_converted);
-#endif
-
-    done = !pa_database_first(u->database, &key, NULL);
-    while (!done) {
-        pa_datum next_key;
-        char *entry_name = NULL;
-        struct entry *e = NULL;
-
-        entry_name = pa_xstrndup(key.data, key.size);
-
-        /* Use entry_read() to check whether this entry is valid. */
-        if (!(e = entry_read(u, entry_name))) {
-            item = pa_xnew0(struct clean_up_item, 1);
-            PA_LLIST_INIT(struct clean_up_item, item);
-            item->entry_name = entry_name;
-
-#ifdef ENABLE_LEGACY_DATABASE_ENTRY_FORMAT
-            /* entry_read() failed, but what about legacy_entry_read()? */
-            if (!(e = legacy_entry_read(u, entry_name)))
-                /* Not a legacy entry either, let's remove this. */
-                PA_LLIST_PREPEND(struct clean_up_item, to_be_removed, item);
-            else {
-                /* Yay, it's valid after all! Now let's convert the entry to the current format. */
-                item->entry = e;
-                PA_LLIST_PREPEND(struct clean_up_item, to_be_converted, item);
-            }
-#else
-            /* Invalid entry, let's remove this. */
-            PA_LLIST_PREPEND(struct clean_up_item, to_be_removed, item);
-#endif
-        } else {
-            pa_xfree(entry_name);
-            entry_free(e);
-        }
-
-        done = !pa_database_next(u->database, &key, &next_key, NULL);
-        pa_datum_free(&key);
-        key = next_key;
-    }
-
-    PA_LLIST_FOREACH_SAFE(item, next, to_be_removed) {
-        key.data = item->entry_name;
-        key.size = strlen(item->entry_name);
-
-        pa_log_debug("Removing an invalid entry: %s", item->entry_name);
-
-        pa_assert_se(pa_database_unset(u->database, &key) >= 0);
-        trigger_save(u);
-
-        PA_LLIST_REMOVE(struct clean_up_item, to_be_removed, item);
-        pa_xfree(item->entry_name);
-        pa_xfree(item);
-    }
-
-#ifdef ENABLE_LEGACY_DATABASE_ENTRY_FORMAT
-    PA_LLIST_FOREACH_SAFE(item, next, to_be_converted) {
-        pa_log_debug("Upgrading a legacy entry to the current format: %s", item->entry_name);
-
-        pa_assert_se(entry_write(u, item->entry_name, item->entry, true));
-        trigger_save(u);
-
-        PA_LLIST_REMOVE(struct clean_up_item, to_be_converted, item);
-        pa_xfree(item->entry_name);
-        entry_free(item->entry);
-        pa_xfree(item);
-    }
-#endif
-}
-
 int pa__init(pa_module*m) {
     pa_modargs *ma = NULL;
     struct userdata *u;
@@ -3114,8 +3561,9 @@ int pa__init(pa_module*m) {
     bool restore_route_volume = true, use_voice = false;
 
 #ifdef HAVE_DBUS
-    pa_datum key;
-    bool done;
+    const char *name;
+    struct entry *e;
+    void *state;
 #endif
 
     pa_assert(m);
@@ -3157,6 +3605,15 @@ int pa__init(pa_module*m) {
     u->restore_muted = restore_muted;
     u->restore_route_volume = restore_route_volume;
     u->use_voice = use_voice;
+    u->entries = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, pa_xfree, (pa_free_cb_t) entry_free);
+    u->dirty_entries = pa_idxset_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+    u->route_entries = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, pa_xfree, pa_xfree);
+    u->route_volume_index = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+    u->sink_volume_index = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+    u->changed_sink_inputs = pa_idxset_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+    u->changed_source_outputs = pa_idxset_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+    u->streams_changed_event = m->core->mainloop->defer_new(m->core->mainloop, streams_changed_defer_cb, u);
+    m->core->mainloop->defer_enable(u->streams_changed_event, 0);
 
     u->volume_proxy = pa_volume_proxy_get(u->core);
     u->volume_proxy_hook_slot = pa_hook_connect(&pa_volume_proxy_hooks(u->volume_proxy)[PA_VOLUME_PROXY_HOOK_CHANGED], PA_HOOK_NORMAL, (pa_hook_cb_t) ext_volume_proxy_cb, u);
@@ -3168,7 +3625,10 @@ int pa__init(pa_module*m) {
 
     pa_module_hook_connect(m, &pa_native_protocol_hooks(u->protocol)[PA_NATIVE_HOOK_CONNECTION_UNLINK], PA_HOOK_NORMAL, (pa_hook_cb_t) connection_unlink_hook_cb, u);
 
-    u->subscription = pa_subscription_new(m->core, PA_SUBSCRIPTION_MASK_SINK_INPUT|PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT, subscribe_callback, u);
+    u->subscription_dispatcher = pa_subscription_dispatcher_get(m->core);
+    streams_subscribe(u);
+
+    stream_index_init(u);
 
     if (restore_device) {
         /* A little bit earlier than module-intended-roles ... */
@@ -3186,6 +3646,8 @@ int pa__init(pa_module*m) {
         u->sink_input_move_finished_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_FINISH], PA_HOOK_NORMAL, (pa_hook_cb_t)ext_hw_sink_input_move_finish_callback, u);
     }
 
+    pa_module_hook_connect(m, &m->core->hooks[PA_CORE_HOOK_SINK_STATE_CHANGED], PA_HOOK_NORMAL, (pa_hook_cb_t) ext_sink_state_changed_hook_callback, u);
+
     if (!(state_path = pa_state_path(NULL, true)))
         goto fail;
 
@@ -3196,7 +3658,7 @@ int pa__init(pa_module*m) {
 
     pa_xfree(state_path);
 
-    clean_up_db(u);
+    entries_load(u);
 
     if (fill_db(u, pa_modargs_get_value(ma, "fallback_table", NULL)) < 0)
         goto fail;
@@ -3217,20 +3679,11 @@ int pa__init(pa_module*m) {
     pa_assert_se(pa_dbus_protocol_register_extension(u->dbus_protocol, INTERFACE_STREAM_RESTORE) >= 0);
 
     /* Create the initial dbus entries. */
-    done = !pa_database_first(u->database, &key, NULL);
-    while (!done) {
-        pa_datum next_key;
-        char *name;
+    PA_HASHMAP_FOREACH_KV(name, e, u->entries, state) {
         struct dbus_entry *de;
 
-        name = pa_xstrndup(key.data, key.size);
         de = dbus_entry_new(u, name);
-        pa_assert_se(pa_hashmap_put(u->dbus_entries, de->entry_name, de) == 0);
-        pa_xfree(name);
-
-        done = !pa_database_next(u->database, &key, &next_key, NULL);
-        pa_datum_free(&key);
-        key = next_key;
+        dbus_entries_put(u, de);
     }
 #endif
 
@@ -3246,6 +3699,8 @@ int pa__init(pa_module*m) {
     pa_log_info("Sucessfully opened database file '%s'.", state_path);
     pa_xfree(state_path);
 
+    ext_route_entries_load(u);
+
     PA_IDXSET_FOREACH(si, m->core->sink_inputs, idx)
         subscribe_callback(m->core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_NEW, si->index, u);
 
@@ -3288,16 +3743,28 @@ void pa__done(pa_module*m) {
         pa_assert_se(pa_dbus_protocol_remove_interface(u->dbus_protocol, OBJECT_PATH, stream_restore_interface_info.name) >= 0);
 
         pa_hashmap_free(u->dbus_entries);
+        dbus_entries_changed(u);
 
         pa_dbus_protocol_unref(u->dbus_protocol);
     }
 #endif
 
-    if (u->subscription)
-        pa_subscription_free(u->subscription);
+    streams_unsubscribe(u);
+
+    if (u->streams_changed_event)
+        u->core->mainloop->defer_free(u->streams_changed_event);
+
+    if (u->changed_sink_inputs)
+        pa_idxset_free(u->changed_sink_inputs, NULL);
 
-    if (u->sink_subscription)
-        pa_subscription_free(u->sink_subscription);
+    if (u->changed_source_outputs)
+        pa_idxset_free(u->changed_source_outputs, NULL);
+
+    if (u->sink_volume_slot)
+        pa_subscription_dispatcher_slot_free(u->sink_volume_slot);
+
+    if (u->subscription_dispatcher)
+        pa_subscription_dispatcher_unref(u->subscription_dispatcher);
 
     if (!u->use_voice)
         meego_parameter_stop_updates(NULL, (pa_hook_cb_t) ext_parameters_changed_cb, u);
@@ -3308,15 +3775,23 @@ void pa__done(pa_module*m) {
     if (u->volume_proxy)
         pa_volume_proxy_unref(u->volume_proxy);
 
-    if (u->save_time_event)
-        u->core->mainloop->time_free(u->save_time_event);
+    save_now(u);
 
     if (u->database)
         pa_database_close(u->database);
 
+    if (u->entries)
+        pa_hashmap_free(u->entries);
+
+    if (u->dirty_entries)
+        pa_idxset_free(u->dirty_entries, pa_xfree);
+
     if (u->route_database)
         pa_database_close(u->route_database);
 
+    if (u->route_entries)
+        pa_hashmap_free(u->route_entries);
+
     if (u->protocol) {
         pa_native_protocol_remove_ext(u->protocol, m);
         pa_native_protocol_unref(u->protocol);
@@ -3326,8 +3801,12 @@ void pa__done(pa_module*m) {
         pa_idxset_free(u->subscribed, NULL);
 
     ext_free_route_volumes(u);
+    pa_hashmap_free(u->route_volume_index);
 
     ext_free_sink_volumes(u);
+    pa_hashmap_free(u->sink_volume_index);
+
+    stream_index_done(u);
 
     pa_xfree(u->route);
     pa_xfree(u);
@@ -42,18 +42,24 @@
 
 #include "proplist-meego.h"
 #include "shared-data.h"
+#include "subscription-dispatcher.h"
 #include "proplist-nemo.h"
+#include "trace.h"
+#include "capture.h"
 
 PA_MODULE_AUTHOR("Pekka Ervasti");
 PA_MODULE_DESCRIPTION("test module");
 PA_MODULE_USAGE(
-        "op=<test operation, mode/si/proplist/call> "
+        "op=<test operation, mode/si/proplist/call/trace/trace-dump/capture> "
         "sink_name=<name of hw sink> "
         "audio_mode=<ihf,hs,etc> "
         "active=call active <true/false> "
         "hwid=<accessory hwid> "
         "property=<property key to change> "
-        "value=<property value to change>");
+        "value=<property value to change> "
+        "file=<trace dump file> "
+        "directory=<capture directory, capture is stopped if not set> "
+        "taps=<comma separated capture taps, default all>");
 PA_MODULE_VERSION(PACKAGE_VERSION);
 
 static const char* const valid_modargs[] = {
@@ -68,6 +74,9 @@ static const char* const valid_modargs[] = {
     "cork",
     "uncork",
     "sink-input",
+    "file",
+    "directory",
+    "taps",
     NULL,
 };
 
@@ -77,13 +86,17 @@ static const char* const valid_modargs[] = {
 #define OP_CALL "call"
 #define OP_CORK "cork"
 #define OP_UNCORK "uncork"
+#define OP_TRACE "trace"
+#define OP_TRACE_DUMP "trace-dump"
+#define OP_CAPTURE "capture"
 
 struct userdata {
     pa_core *core;
     pa_module *module;
 
     /* for sink-input test */
-    pa_subscription *subscription;
+    pa_subscription_dispatcher *subscription_dispatcher;
+    pa_subscription_dispatcher_slot *subscription;
 };
 
 /* copy/pasted from module-stream-restore.c */
@@ -120,10 +133,6 @@ static void test_sink_input_subscribe_cb(pa_core *c, pa_subscription_event_type_
     pa_cvolume absolute_volume;
     pa_cvolume reference_ratio;
 
-    if (t != (PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_NEW) &&
-        t != (PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE))
-        return;
-
     if (!(si = pa_idxset_get_by_index(c->sink_inputs, idx)))
         return;
 
@@ -142,7 +151,13 @@ static void test_sink_input_subscribe_cb(pa_core *c, pa_subscription_event_type_
 }
 
 static void test_sink_input(struct userdata *u) {
-    u->subscription = pa_subscription_new(u->core, PA_SUBSCRIPTION_MASK_SINK_INPUT, test_sink_input_subscribe_cb, u);
+    u->subscription_dispatcher = pa_subscription_dispatcher_get(u->core);
+    u->subscription = pa_subscription_dispatcher_connect(u->subscription_dispatcher,
+                                                         PA_SUBSCRIPTION_EVENT_SINK_INPUT,
+                                                         PA_INVALID_INDEX,
+                                                         PA_SUBSCRIPTION_DISPATCHER_NEW | PA_SUBSCRIPTION_DISPATCHER_CHANGE,
+                                                         test_sink_input_subscribe_cb,
+                                                         u);
     pa_log_debug("Setting up subscription for sink-input");
 }
 
@@ -177,6 +192,38 @@ static void test_cork(struct userdata *u, pa_modargs *ma, bool corked) {
 
 }
 
+static void test_trace(struct userdata *u, pa_modargs *ma) {
+    bool active;
+
+    if (pa_modargs_get_value_boolean(ma, "active", &active) < 0)
+        pa_log_error("trace op (active) expects boolean argument");
+    else
+        meego_trace_set_enabled(active);
+}
+
+static void test_trace_dump(struct userdata *u, pa_modargs *ma) {
+    const char *file;
+
+    if (!(file = pa_modargs_get_value(ma, "file", NULL)))
+        pa_log_error("trace-dump op expects file argument");
+    else
+        meego_trace_dump(file);
+}
+
+static void test_capture(struct userdata *u, pa_modargs *ma) {
+    meego_capture *capture;
+    const char *directory;
+
+    capture = meego_capture_get(u->core);
+
+    if ((directory = pa_modargs_get_value(ma, "directory", NULL)))
+        meego_capture_start(capture, directory, pa_modargs_get_value(ma, "taps", NULL));
+    else
+        meego_capture_stop(capture);
+
+    meego_capture_unref(capture);
+}
+
 static void test_proplist(struct userdata *u, pa_modargs *ma) {
     const char *sink_name;
     const char *property;
@@ -254,7 +301,7 @@ int pa__init(pa_module*m) {
     struct userdata *u;
     const char *op;
 
-    u = pa_xmalloc(sizeof(struct userdata));
+    u = pa_xnew0(struct userdata, 1);
 
     pa_assert(m);
 
@@ -285,6 +332,12 @@ int pa__init(pa_module*m) {
         test_cork(u, ma, true);
     else if (pa_streq(op, OP_UNCORK))
         test_cork(u, ma, false);
+    else if (pa_streq(op, OP_TRACE))
+        test_trace(u, ma);
+    else if (pa_streq(op, OP_TRACE_DUMP))
+        test_trace_dump(u, ma);
+    else if (pa_streq(op, OP_CAPTURE))
+        test_capture(u, ma);
 
     /* unload test module immediately, as the work is now done. */
     pa_module_unload_request(u->module, true);
@@ -309,5 +362,11 @@ void pa__done(pa_module*m) {
     if (!u)
         return;
 
+    if (u->subscription)
+        pa_subscription_dispatcher_slot_free(u->subscription);
+
+    if (u->subscription_dispatcher)
+        pa_subscription_dispatcher_unref(u->subscription_dispatcher);
+
     pa_xfree(u);
 }
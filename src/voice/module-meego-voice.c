@@ -36,6 +36,7 @@
 #include "voice-util.h"
 #include "voice-aep-ear-ref.h"
 #include "voice-mainloop-handler.h"
+#include "voice-dbus.h"
 #include "module-voice-api.h"
 
 #include "shared-data.h"
@@ -50,7 +51,10 @@ PA_MODULE_USAGE("voice_sink_name=<name for the voice sink> "
                 "master_source=<source to connect to> "
                 "raw_sink=<name for raw sink> "
                 "raw_source=<name for raw source> "
-                "max_hw_frag_size=<maximum fragment size of master sink and source in usecs>");
+                "max_hw_frag_size=<maximum fragment size of master sink and source in usecs> "
+                "metrics_file=<file to write audio path metrics to> "
+                "metrics_interval=<metrics file update interval in seconds> "
+                "stream_export=<export processed streams to shared memory, default false>");
 PA_MODULE_VERSION(PACKAGE_VERSION) ;
 
 
@@ -62,6 +66,9 @@ static const char* const valid_modargs[] = {
     "raw_sink_name",
     "raw_source_name",
     "max_hw_frag_size",
+    "metrics_file",
+    "metrics_interval",
+    "stream_export",
     NULL,
 };
 
@@ -104,9 +111,6 @@ static void master_source_state_subscribe_cb(pa_core *c, pa_subscription_event_t
     pa_assert(c);
     pa_assert(u);
 
-    if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) != PA_SUBSCRIPTION_EVENT_CHANGE)
-        return;
-
     if (!u->master_source)
         return;
 
@@ -197,6 +201,9 @@ int pa__init(pa_module*m) {
 
     m->userdata = u = pa_xnew0(struct userdata, 1);
 
+    meego_rt_log_attach(m->core);
+    u->rt_log_attached = true;
+
     if (!(u->master_sink = pa_namereg_get(m->core, master_sink_name, PA_NAMEREG_SINK))) {
         pa_log("Master sink \"%s\" not found", master_sink_name);
         goto fail;
@@ -225,6 +232,9 @@ int pa__init(pa_module*m) {
     u->core = m->core;
     u->module = m;
 
+    if (voice_metrics_init(u, ma) < 0)
+        goto fail;
+
     set_hooks(u);
 
     u->mainloop_handler = voice_mainloop_handler_new(u);
@@ -264,12 +274,20 @@ int pa__init(pa_module*m) {
                             u->aep_fragment_size);
 
     voice_memchunk_pool_load(u);
+    voice_capture_init(u);
+    if (voice_stream_export_init(u, ma) < 0)
+        goto fail;
+    voice_dbus_init(u);
 
     if (voice_init_raw_sink(u, raw_sink_name))
         goto fail;
 
     u->shared = pa_shared_data_get(m->core);
 
+    pa_shared_data_set_integer(u->shared, VOICE_SHARED_VOIP_SOURCE_STATE, PA_SOURCE_UNLINKED);
+    if ((u->voip_source_state_slot = pa_shared_data_export(u->shared, VOICE_SHARED_VOIP_SOURCE_STATE)) < 0)
+        goto fail;
+
     pa_atomic_store(&u->mixer_state, PROP_MIXER_TUNING_PRI);
     pa_shared_data_sets(u->shared, PA_NEMO_PROP_CALL_STATE, PA_NEMO_PROP_CALL_STATE_INACTIVE);
     u->alt_mixer_compensation = PA_VOLUME_NORM;
@@ -320,7 +338,7 @@ int pa__init(pa_module*m) {
     u->ul_memblockq =
         pa_memblockq_new("voice ul_memblockq", 0, 2*u->voice_ul_fragment_size, 0, &u->aep_sample_spec, 0, 0, 0, NULL);
 
-    u->dl_sideinfo_queue = pa_queue_new();
+    u->dl_sideinfo_ring = pa_xnew0(voice_sideinfo_ring, 1);
 
     u->ul_deadline = 0;
 
@@ -357,10 +375,24 @@ int pa__init(pa_module*m) {
     pa_source_output_put(u->hw_source_output);
     pa_sink_input_put(u->aep_sink_input);
 
-    u->sink_subscription = pa_subscription_new(m->core, PA_SUBSCRIPTION_MASK_SINK | PA_SUBSCRIPTION_MASK_SINK_INPUT, master_sink_volume_subscribe_cb, u);
+    /* Master sink and source may change when voice hw streams move, so
+     * listen to changes of all sinks and sources. Master sink real volume
+     * changes are posted as sink change events. */
+    u->subscription_dispatcher = pa_subscription_dispatcher_get(m->core);
+    u->sink_subscription = pa_subscription_dispatcher_connect(u->subscription_dispatcher,
+                                                              PA_SUBSCRIPTION_EVENT_SINK,
+                                                              PA_INVALID_INDEX,
+                                                              PA_SUBSCRIPTION_DISPATCHER_CHANGE,
+                                                              master_sink_volume_subscribe_cb,
+                                                              u);
 
     u->previous_master_source_state = u->master_source->state;
-    u->source_change_subscription = pa_subscription_new(m->core, PA_SUBSCRIPTION_MASK_SOURCE, master_source_state_subscribe_cb, u);
+    u->source_change_subscription = pa_subscription_dispatcher_connect(u->subscription_dispatcher,
+                                                                       PA_SUBSCRIPTION_EVENT_SOURCE,
+                                                                       PA_INVALID_INDEX,
+                                                                       PA_SUBSCRIPTION_DISPATCHER_CHANGE,
+                                                                       master_source_state_subscribe_cb,
+                                                                       u);
     return 0;
 
 fail:
@@ -376,11 +408,13 @@ void pa__done(pa_module*m) {
     if (!u)
         return;
 
+    /* Sink and source IO threads read exported shared data,
+     * so release it only after they are gone. */
+    voice_clear_up(u);
+
     if (u->shared)
         pa_shared_data_unref(u->shared);
 
-    voice_clear_up(u);
-
     if (u->modargs)
         pa_modargs_free(u->modargs);
 
@@ -28,6 +28,7 @@
 
 #include <pulsecore/sink.h>
 #include <pulsecore/source.h>
+#include <pulsecore/atomic.h>
 
 #define VOICE_SOURCE_FRAMESIZE (20000) /* us */
 #define VOICE_SINK_FRAMESIZE (10000) /* us */
@@ -39,7 +40,7 @@
 #define VOICE_PERIOD_AEP_USECS    10000
 #define VOICE_PERIOD_CMT_USECS    20000
 
-#define VOICE_API_VERSION "0.1"
+#define VOICE_API_VERSION "0.3"
 
 /*      C-name                                  hook name                                   call_data */
 #define VOICE_HOOK_HW_SINK_PROCESS              "x-meego.voice.hw_sink_process"         /* default 2ch */
@@ -64,19 +65,64 @@ typedef struct {
     pa_memchunk *achunk;
 } aep_uplink;
 
+/* Side info for one downlink AEP fragment. */
+typedef struct {
+    unsigned int flags;         /* VOICE_SIDEINFO_FLAG_* */
+    unsigned int codec_mode;    /* Modem specific, 0 if unknown */
+    pa_usec_t timestamp;        /* Modem frame time, 0 if unknown */
+} voice_sideinfo;
+
 typedef struct {
     pa_memchunk *chunk;
     int spc_flags;
     bool cmt;
+    voice_sideinfo sideinfo;    /* spc_flags is sideinfo.flags */
 } aep_downlink;
 
+/* Processed voice streams exported to shared memory when module is loaded
+ * with stream_export=1. All streams are in AEP sample spec, see
+ * stream-export-layout.h for the memory layout. Other processes get the
+ * descriptors with the GetStream method of the D-Bus interface below,
+ * modules with the GET_STREAM_EXPORT messages. */
+enum {
+    VOICE_STREAM_EXPORT_UL,         /* Uplink after AEP */
+    VOICE_STREAM_EXPORT_DL,         /* Downlink after AEP */
+    VOICE_STREAM_EXPORT_EAR_REF,    /* Echo reference */
+    VOICE_STREAM_EXPORT_MAX
+};
+
+/* fd is -1 if the stream is not exported. The descriptor is owned by the
+ * voice module and valid while it is loaded, dup() it to keep it. */
+typedef struct {
+    int fd;
+    size_t size;
+} voice_stream_export_info;
+
+/* GetStream(in s name, out h fd, out t size), name is one of the
+ * VOICE_DBUS_STREAM_* names. */
+#define VOICE_DBUS_PATH "/com/meego/voice1"
+#define VOICE_DBUS_STREAM_EXPORT_IFACE "com.Meego.Voice1.StreamExport"
+#define VOICE_DBUS_INTERFACE_REVISION (1)
+
+#define VOICE_DBUS_STREAM_UL "ul"
+#define VOICE_DBUS_STREAM_DL "dl"
+#define VOICE_DBUS_STREAM_EAR_REF "ear-ref"
+
 enum {
     /* TODO: Print out BIG warning if in wrong buffer mode when this message is received */
     VOICE_SOURCE_SET_UL_DEADLINE = PA_SOURCE_MESSAGE_MAX + 100,
+    /* offset: VOICE_STREAM_EXPORT_*, data: voice_stream_export_info * */
+    VOICE_SOURCE_GET_STREAM_EXPORT,
 };
 
 enum {
+    /* Obsolete, used to pass a pa_queue of side info. Fails and sets
+     * data to NULL, use VOICE_SINK_GET_SIDE_INFO_RING_PTR. */
     VOICE_SINK_GET_SIDE_INFO_QUEUE_PTR = PA_SINK_MESSAGE_MAX + 100,
+    /* offset: VOICE_STREAM_EXPORT_*, data: voice_stream_export_info * */
+    VOICE_SINK_GET_STREAM_EXPORT,
+    /* data: voice_sideinfo_ring ** */
+    VOICE_SINK_GET_SIDE_INFO_RING_PTR,
 };
 
 #define PA_PROP_SINK_API_EXTENSION_PROPERTY_NAME "sink.api-extension.meego.voice"
@@ -90,8 +136,52 @@ enum {
 
 #define VOICE_SIDEINFO_FLAG_SPEECH (0x0001)
 #define VOICE_SIDEINFO_FLAG_BAD    (0x0002)
-/* Because pa_queue does not like NULL pointers, this flag is added to every
- * set of flags to make the pa_queue entries non null. */
+/* Not needed anymore, ignored if set. */
 #define VOICE_SIDEINFO_FLAG_BOGUS  (0x8000)
 
+/* Downlink side info ring, one entry per AEP fragment. Single producer
+ * (modem side) pushes, voice sink IO thread pops. Neither side allocates
+ * or blocks. Size must be a power of two. */
+#define VOICE_SIDEINFO_RING_SIZE (64)
+
+typedef struct {
+    pa_atomic_t write_index;    /* Written by producer only */
+    pa_atomic_t read_index;     /* Written by consumer only */
+    pa_atomic_t overflows;      /* Pushes dropped because ring was full */
+    pa_atomic_t underflows;     /* Pops from empty ring */
+    voice_sideinfo items[VOICE_SIDEINFO_RING_SIZE];
+} voice_sideinfo_ring;
+
+/* Returns false and counts overflow if ring is full. */
+static inline bool voice_sideinfo_ring_push(voice_sideinfo_ring *r, const voice_sideinfo *info) {
+    unsigned int w = (unsigned int) pa_atomic_load(&r->write_index);
+    unsigned int rd = (unsigned int) pa_atomic_load(&r->read_index);
+
+    if (w - rd >= VOICE_SIDEINFO_RING_SIZE) {
+        pa_atomic_inc(&r->overflows);
+        return false;
+    }
+
+    r->items[w & (VOICE_SIDEINFO_RING_SIZE - 1)] = *info;
+    pa_atomic_store(&r->write_index, (int) (w + 1));
+
+    return true;
+}
+
+/* Returns false and counts underflow if ring is empty. */
+static inline bool voice_sideinfo_ring_pop(voice_sideinfo_ring *r, voice_sideinfo *info) {
+    unsigned int rd = (unsigned int) pa_atomic_load(&r->read_index);
+    unsigned int w = (unsigned int) pa_atomic_load(&r->write_index);
+
+    if (rd == w) {
+        pa_atomic_inc(&r->underflows);
+        return false;
+    }
+
+    *info = r->items[rd & (VOICE_SIDEINFO_RING_SIZE - 1)];
+    pa_atomic_store(&r->read_index, (int) (rd + 1));
+
+    return true;
+}
+
 #endif /* module_voice_api_h */
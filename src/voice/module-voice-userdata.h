@@ -36,14 +36,21 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/semaphore.h>
 #include <pulsecore/fdsem.h>
+#include <pulsecore/protocol-dbus.h>
 
 #include "shared-data.h"
+#include "subscription-dispatcher.h"
+#include "rt-log.h"
+#include "metrics.h"
+#include "capture.h"
+#include "stream-export.h"
 #include "src-48-to-8.h"
 #include "src-8-to-48.h"
 
 #include "algorithm-hook.h"
 
 #include <voice-hooks.h>
+#include "module-voice-api.h"
 
 /* This is a copy/paste from module-alsa-sink-volume.c, keep it up to date!*/
 /* String with single integer defining which mixer
@@ -66,6 +73,16 @@ typedef enum {
 } call_mic_ch_t;
 
 
+enum {
+    VOICE_TAP_MIC_RAW,
+    VOICE_TAP_MIC_8K,
+    VOICE_TAP_EAR_REF,
+    VOICE_TAP_AEP_OUT,
+    VOICE_TAP_DL_IN,
+    VOICE_TAP_DL_OUT,
+    VOICE_TAP_MAX
+};
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -130,7 +147,7 @@ struct userdata {
     int16_t linear_q15_master_volume_L;
     int16_t linear_q15_master_volume_R;
 
-    pa_queue *dl_sideinfo_queue;
+    voice_sideinfo_ring *dl_sideinfo_ring;
 
     src_48_to_8 *hw_source_to_aep_resampler;
     src_48_to_8 *hw_source_to_aep_amb_resampler;
@@ -150,9 +167,11 @@ struct userdata {
     pa_hook_slot *sink_proplist_changed_slot;
     pa_hook_slot *source_proplist_changed_slot;
 
-    pa_subscription *sink_subscription;
+    pa_subscription_dispatcher *subscription_dispatcher;
+    pa_subscription_dispatcher_slot *sink_subscription;
 
     pa_shared_data *shared;
+    int voip_source_state_slot;
 
     unsigned current_audio_mode_hwid_hash;
     meego_algorithm_hook *hooks[HOOK_MAX];
@@ -162,8 +181,31 @@ struct userdata {
     /* store the current volume , to compare next time */
     pa_cvolume previous_volume;
 
-    pa_subscription *source_change_subscription;
+    pa_subscription_dispatcher_slot *source_change_subscription;
     pa_source_state_t previous_master_source_state;
+
+    bool rt_log_attached;
+
+    /* Audio path health, updated from IO threads. */
+    meego_metrics *metrics;
+    struct {
+        meego_metrics_counter *ul_xruns;
+        meego_metrics_counter *dl_xruns;
+        meego_metrics_counter *ear_ref_resets;
+        meego_metrics_counter *ear_ref_push_failures;
+        meego_metrics_counter *ul_deadline_misses;
+        meego_metrics_counter *memchunk_pool_empty;
+        meego_metrics_counter *memblockq_push_failures;
+        meego_metrics_histogram *ul_deadline_headroom;
+    } metric;
+
+    /* Capture taps, see voice_capture_init(). */
+    meego_capture *capture;
+    meego_capture_tap *taps[VOICE_TAP_MAX];
+
+    /* Shared memory stream export, see voice_stream_export_init(). */
+    meego_stream_export *exports[VOICE_STREAM_EXPORT_MAX];
+    pa_dbus_protocol *dbus_protocol;
 };
 
 
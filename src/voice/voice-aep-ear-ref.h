@@ -94,6 +94,7 @@ int voice_aep_ear_ref_check_dl_xrun(struct userdata *u) {
 
     if (underrun) {
         pa_log_debug("DL XRUN -> reset");
+        meego_metrics_counter_inc(u->metric.dl_xruns);
         pa_atomic_store(&r->loop_state, VOICE_EAR_REF_RESET);
         return 1;
     }
@@ -104,14 +105,17 @@ int voice_aep_ear_ref_check_dl_xrun(struct userdata *u) {
 static inline
 int voice_aep_ear_ref_dl_push_to_syncq(struct userdata *u, pa_memchunk *chunk) {
     pa_memchunk *qchunk = voice_memchunk_pool_get(u);
-    if (qchunk == NULL)
+    if (qchunk == NULL) {
+        meego_metrics_counter_inc(u->metric.memchunk_pool_empty);
         return -1;
+    }
     *qchunk = *chunk;
     pa_memblock_ref(qchunk->memblock);
     static int fail_count = 0;
     if (pa_asyncq_push(u->ear_ref.loop_asyncq, qchunk, false)) {
         pa_memblock_unref(qchunk->memblock);
         voice_memchunk_pool_free(u, qchunk);
+        meego_metrics_counter_inc(u->metric.ear_ref_push_failures);
         if (fail_count == 0)
             pa_log_debug("Failed to push dl frame to asyncq");
         fail_count++;
@@ -185,6 +189,7 @@ int voice_aep_ear_ref_ul_drain_asyncq(struct userdata *u, bool push_forward) {
         queue_counter++;
         if (push_forward) {
             if (pa_memblockq_push(r->loop_memblockq, chunk) < 0) {
+                meego_metrics_counter_inc(u->metric.memblockq_push_failures);
                 pa_log_debug("Failed to push %zu bytes of ear ref data to loop_memblockq (len %zu max %zu)",
                              chunk->length, pa_memblockq_get_length(r->loop_memblockq),
                              pa_memblockq_get_maxlength(r->loop_memblockq));
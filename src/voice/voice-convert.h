@@ -23,6 +23,7 @@
 #define voice_aep_convert_h
 
 #include "module-voice-userdata.h"
+#include "trace.h"
 
 /* TODO: Move init and free calls to pa__init and pa__done. The src wrappers should be
          moved to common */
@@ -75,6 +76,8 @@ int voice_convert_run_48_to_8(struct userdata *u, src_48_to_8 *s, const pa_memch
     int ouput_frames = output_frames_src_48_to_8_total(input_frames);
     pa_assert(ouput_frames > 0);
 
+    meego_trace_begin("src-48-to-8");
+
     ochunk->length = ouput_frames*sizeof(short);
     ochunk->memblock = pa_memblock_new(u->core->mempool, ochunk->length);
     ochunk->index = 0;
@@ -93,6 +96,8 @@ int voice_convert_run_48_to_8(struct userdata *u, src_48_to_8 *s, const pa_memch
     pa_memblock_release(ochunk->memblock);
     pa_memblock_release(ichunk->memblock);
 
+    meego_trace_end("src-48-to-8");
+
     return 0;
 }
 
@@ -107,6 +112,8 @@ int voice_convert_run_48_stereo_to_8(struct userdata *u, src_48_to_8 *s, const p
 
     pa_assert(output_frames > 0);
 
+    meego_trace_begin("src-48-stereo-to-8");
+
     ochunk->length = output_frames*sizeof(short);
     ochunk->memblock = pa_memblock_new(u->core->mempool, ochunk->length);
     ochunk->index = 0;
@@ -125,6 +132,8 @@ int voice_convert_run_48_stereo_to_8(struct userdata *u, src_48_to_8 *s, const p
     pa_memblock_release(ochunk->memblock);
     pa_memblock_release(ichunk->memblock);
 
+    meego_trace_end("src-48-stereo-to-8");
+
     return 0;
 }
 
@@ -138,6 +147,8 @@ int voice_convert_run_8_to_48(struct userdata *u, src_8_to_48 *s, const pa_memch
     int ouput_frames = output_frames_src_8_to_48(input_frames);
     pa_assert(ouput_frames > 0);
 
+    meego_trace_begin("src-8-to-48");
+
     ochunk->length = ouput_frames*sizeof(short);
     ochunk->memblock = pa_memblock_new(u->core->mempool, ochunk->length);
     ochunk->index = 0;
@@ -147,6 +158,8 @@ int voice_convert_run_8_to_48(struct userdata *u, src_8_to_48 *s, const pa_memch
     pa_memblock_release(ochunk->memblock);
     pa_memblock_release(ichunk->memblock);
 
+    meego_trace_end("src-8-to-48");
+
     return 0;
 }
 
@@ -160,6 +173,8 @@ int voice_convert_run_8_to_48_stereo(struct userdata *u, src_8_to_48 *s, const p
     int ouput_frames = output_frames_src_8_to_48(input_frames);
     pa_assert(ouput_frames > 0);
 
+    meego_trace_begin("src-8-to-48-stereo");
+
     ochunk->length = ouput_frames*2*sizeof(short);
     ochunk->memblock = pa_memblock_new(u->core->mempool, ochunk->length);
     ochunk->index = 0;
@@ -169,6 +184,8 @@ int voice_convert_run_8_to_48_stereo(struct userdata *u, src_8_to_48 *s, const p
     pa_memblock_release(ochunk->memblock);
     pa_memblock_release(ichunk->memblock);
 
+    meego_trace_end("src-8-to-48-stereo");
+
     return 0;
 }
 
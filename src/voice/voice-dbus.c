@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Maemo MMF Audio <mmf-audio@projects.maemo.org>
+ *          or Jyri Sarha <jyri.sarha@nokia.com>
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/protocol-dbus.h>
+#include <pulsecore/dbus-util.h>
+
+#include "module-voice-userdata.h"
+#include "module-voice-api.h"
+#include "voice-util.h"
+#include "voice-dbus.h"
+
+static const char * const stream_names[VOICE_STREAM_EXPORT_MAX] = {
+    [VOICE_STREAM_EXPORT_UL] = VOICE_DBUS_STREAM_UL,
+    [VOICE_STREAM_EXPORT_DL] = VOICE_DBUS_STREAM_DL,
+    [VOICE_STREAM_EXPORT_EAR_REF] = VOICE_DBUS_STREAM_EAR_REF
+};
+
+static void handle_get_revision(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void handle_get_stream(DBusConnection *conn, DBusMessage *msg, void *userdata);
+
+enum property_handler_index {
+    PROPERTY_HANDLER_INTERFACE_REVISION,
+    PROPERTY_HANDLER_MAX
+};
+
+static pa_dbus_property_handler property_handlers[PROPERTY_HANDLER_MAX] = {
+    [PROPERTY_HANDLER_INTERFACE_REVISION] = {
+        .property_name = "InterfaceRevision",
+        .type = "u",
+        .get_cb = handle_get_revision,
+        .set_cb = NULL
+    }
+};
+
+enum method_handler_index {
+    METHOD_HANDLER_GET_STREAM,
+    METHOD_HANDLER_MAX
+};
+
+static pa_dbus_arg_info get_stream_args[] = { { "name", "s", "in" },
+                                              { "fd",   "h", "out" },
+                                              { "size", "t", "out" } };
+
+static pa_dbus_method_handler method_handlers[METHOD_HANDLER_MAX] = {
+    [METHOD_HANDLER_GET_STREAM] = {
+        .method_name = "GetStream",
+        .arguments = get_stream_args,
+        .n_arguments = sizeof(get_stream_args) / sizeof(pa_dbus_arg_info),
+        .receive_cb = handle_get_stream }
+};
+
+static pa_dbus_interface_info stream_export_interface_info = {
+    .name = VOICE_DBUS_STREAM_EXPORT_IFACE,
+    .method_handlers = method_handlers,
+    .n_method_handlers = METHOD_HANDLER_MAX,
+    .property_handlers = property_handlers,
+    .n_property_handlers = PROPERTY_HANDLER_MAX,
+    .get_all_properties_cb = handle_get_all,
+    .signals = NULL,
+    .n_signals = 0
+};
+
+static void handle_get_revision(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    uint32_t rev = VOICE_DBUS_INTERFACE_REVISION;
+
+    pa_assert(conn);
+    pa_assert(msg);
+
+    pa_dbus_send_basic_variant_reply(conn, msg, DBUS_TYPE_UINT32, &rev);
+}
+
+static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter msg_iter;
+    DBusMessageIter dict_iter;
+    uint32_t rev = VOICE_DBUS_INTERFACE_REVISION;
+
+    pa_assert(conn);
+    pa_assert(msg);
+
+    pa_assert_se((reply = dbus_message_new_method_return(msg)));
+    dbus_message_iter_init_append(reply, &msg_iter);
+    pa_assert_se(dbus_message_iter_open_container(&msg_iter, DBUS_TYPE_ARRAY, "{sv}", &dict_iter));
+
+    pa_dbus_append_basic_variant_dict_entry(&dict_iter,
+                                            property_handlers[PROPERTY_HANDLER_INTERFACE_REVISION].property_name,
+                                            DBUS_TYPE_UINT32, &rev);
+
+    pa_assert_se(dbus_message_iter_close_container(&msg_iter, &dict_iter));
+    pa_assert_se(dbus_connection_send(conn, reply, NULL));
+    dbus_message_unref(reply);
+}
+
+static void handle_get_stream(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    struct userdata *u = userdata;
+    voice_stream_export_info info;
+#ifdef DBUS_TYPE_UNIX_FD
+    DBusMessage *reply = NULL;
+    dbus_uint64_t size;
+#endif
+    const char *name;
+    unsigned i;
+
+    pa_assert(conn);
+    pa_assert(msg);
+    pa_assert(u);
+
+    pa_assert_se(dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &name, DBUS_TYPE_INVALID));
+
+    for (i = 0; i < VOICE_STREAM_EXPORT_MAX; i++) {
+        if (pa_streq(name, stream_names[i]))
+            break;
+    }
+
+    if (i == VOICE_STREAM_EXPORT_MAX) {
+        pa_dbus_send_error(conn, msg, PA_DBUS_ERROR_NOT_FOUND, "No such stream: %s", name);
+        return;
+    }
+
+    voice_stream_export_get_info(u, i, &info);
+
+    if (info.fd < 0) {
+        pa_dbus_send_error(conn, msg, PA_DBUS_ERROR_NOT_FOUND, "Stream %s is not exported.", name);
+        return;
+    }
+
+#ifdef DBUS_TYPE_UNIX_FD
+    if (!dbus_connection_can_send_type(conn, DBUS_TYPE_UNIX_FD)) {
+        pa_dbus_send_error(conn, msg, DBUS_ERROR_NOT_SUPPORTED, "Connection can't pass file descriptors.");
+        return;
+    }
+
+    /* libdbus sends a duplicate of the descriptor. */
+    size = info.size;
+    pa_assert_se((reply = dbus_message_new_method_return(msg)));
+    pa_assert_se(dbus_message_append_args(reply,
+                                          DBUS_TYPE_UNIX_FD, &info.fd,
+                                          DBUS_TYPE_UINT64, &size,
+                                          DBUS_TYPE_INVALID));
+    pa_assert_se(dbus_connection_send(conn, reply, NULL));
+    dbus_message_unref(reply);
+
+    pa_log_debug("D-Bus: Stream %s passed to client", name);
+#else
+    pa_dbus_send_error(conn, msg, DBUS_ERROR_NOT_SUPPORTED, "libdbus can't pass file descriptors.");
+#endif
+}
+
+void voice_dbus_init(struct userdata *u) {
+    unsigned i;
+
+    pa_assert(u);
+
+    for (i = 0; i < VOICE_STREAM_EXPORT_MAX; i++) {
+        if (u->exports[i])
+            break;
+    }
+
+    if (i == VOICE_STREAM_EXPORT_MAX)
+        return;
+
+    u->dbus_protocol = pa_dbus_protocol_get(u->core);
+
+    pa_assert_se(pa_dbus_protocol_add_interface(u->dbus_protocol, VOICE_DBUS_PATH,
+                                                &stream_export_interface_info, u) >= 0);
+    pa_assert_se(pa_dbus_protocol_register_extension(u->dbus_protocol, VOICE_DBUS_STREAM_EXPORT_IFACE) >= 0);
+}
+
+void voice_dbus_done(struct userdata *u) {
+    pa_assert(u);
+
+    if (!u->dbus_protocol)
+        return;
+
+    pa_assert_se(pa_dbus_protocol_unregister_extension(u->dbus_protocol, VOICE_DBUS_STREAM_EXPORT_IFACE) >= 0);
+    pa_assert_se(pa_dbus_protocol_remove_interface(u->dbus_protocol, VOICE_DBUS_PATH,
+                                                   stream_export_interface_info.name) >= 0);
+    pa_dbus_protocol_unref(u->dbus_protocol);
+    u->dbus_protocol = NULL;
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Maemo MMF Audio <mmf-audio@projects.maemo.org>
+ *          or Jyri Sarha <jyri.sarha@nokia.com>
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef _VOICE_DBUS_H_
+#define _VOICE_DBUS_H_
+
+#include "module-voice-userdata.h"
+
+/* Registers the stream export D-Bus interface if stream export is enabled. */
+void voice_dbus_init(struct userdata *u);
+void voice_dbus_done(struct userdata *u);
+
+#endif /* _VOICE_DBUS_H_ */
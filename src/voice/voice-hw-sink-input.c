@@ -51,29 +51,29 @@
 #include "pa-optimized.h"
 #include "optimized.h"
 #include "memory.h"
+#include "trace.h"
 #include "voice-voip-source.h"
 
 #include "module-voice-api.h"
 #include "voice-hooks.h"
 
-static unsigned int voice_dl_sideinfo_pop(struct userdata *u, int length) {
-    unsigned int spc_flags = 0;
-
+/* Side info of the last fragment is returned, zeroed if ring ran empty. */
+static void voice_dl_sideinfo_pop(struct userdata *u, int length, voice_sideinfo *info) {
     pa_assert(u);
+    pa_assert(info);
     pa_assert(length % u->aep_fragment_size == 0);
 
     while (length) {
-        spc_flags = PA_PTR_TO_UINT(pa_queue_pop(u->dl_sideinfo_queue));
+        if (!voice_sideinfo_ring_pop(u->dl_sideinfo_ring, info))
+            pa_zero(*info);
         length -= u->aep_fragment_size;
     }
 
-    return spc_flags & ~VOICE_SIDEINFO_FLAG_BOGUS;
+    info->flags &= ~VOICE_SIDEINFO_FLAG_BOGUS;
 }
 
 /* Called from IO thread context. */
 static void voice_aep_sink_process(struct userdata *u, pa_memchunk *chunk) {
-    unsigned int spc_flags = 0;
-
     pa_assert(u);
 
     /*
@@ -85,10 +85,10 @@ static void voice_aep_sink_process(struct userdata *u, pa_memchunk *chunk) {
         aep_downlink params;
 
         pa_sink_render_full(u->voip_sink, u->aep_fragment_size, chunk);
-        spc_flags = voice_dl_sideinfo_pop(u, u->aep_fragment_size);
+        voice_dl_sideinfo_pop(u, u->aep_fragment_size, &params.sideinfo);
 
         params.chunk = chunk;
-        params.spc_flags = spc_flags;
+        params.spc_flags = params.sideinfo.flags;
         /* TODO: get rid of cmt boolean */
         params.cmt = true;
 
@@ -96,6 +96,7 @@ static void voice_aep_sink_process(struct userdata *u, pa_memchunk *chunk) {
         pa_memchunk_make_writable(chunk, u->aep_fragment_size);
 
         meego_algorithm_hook_fire(u->hooks[HOOK_AEP_DOWNLINK], &params);
+        voice_stream_export_write(u, VOICE_STREAM_EXPORT_DL, chunk);
     }
     else {
         pa_silence_memchunk_get(&u->core->silence_cache,
@@ -119,13 +120,7 @@ static int hw_sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *ch
     pa_assert_se(u = i->userdata);
     pa_assert(chunk);
 
-#ifdef SINK_TIMING_DEBUG_ON
-    static struct timeval tv_last = { 0, 0 };
-    struct timeval tv_new;
-    pa_rtclock_get(&tv_new);
-    pa_usec_t ched_period = pa_timeval_diff(&tv_last, &tv_new);
-    tv_last = tv_new;
-#endif
+    meego_trace_begin("voice-dl");
 
     /* We only operate with N * u->hw_fragment_size chunks. */
     if (length > u->hw_fragment_size_max)
@@ -143,6 +138,7 @@ static int hw_sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *ch
         if (u->voip_sink->thread_info.rewind_requested)
             pa_sink_process_rewind(u->voip_sink, 0);
         voice_aep_sink_process(u, &aepchunk);
+        meego_capture_tap_write(u->taps[VOICE_TAP_DL_IN], &aepchunk);
         if (aep_volume != PA_VOLUME_MUTED && !pa_memblock_is_silence(aepchunk.memblock)) {
             if (aep_volume != PA_VOLUME_NORM) {
                 pa_memchunk_make_writable(&aepchunk, 0);
@@ -289,15 +285,9 @@ static int hw_sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *ch
         pa_memchunk_reset(&aepchunk);
     }
 
-    /* FIXME: voice_voip_source_active_iothread() should only be called from
-     * the source's main thread. The solution will possibly be copying the
-     * source state in some appropriate place to a variable that can be safely
-     * accessed from the sink's IO thread. The fact that we run the IO threads
-     * with FIFO scheduling should remove any synchronization issues between
-     * two IO threads, though, but this is still wrong in principle. */
+    meego_capture_tap_write(u->taps[VOICE_TAP_DL_OUT], chunk);
 
-    /* FIXME: We should have a local atomic indicator to follow source side activity */
-    if (voice_voip_source_active(u)) {
+    if (voice_voip_source_active_sinkthread(u)) {
         pa_memchunk earref;
         if (pa_memblock_is_silence(chunk->memblock))
             pa_silence_memchunk_get(&u->core->silence_cache,
@@ -307,20 +297,13 @@ static int hw_sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *ch
                                     chunk->length/(2*(48/8)));
         else
             voice_convert_run_48_stereo_to_8(u, u->ear_to_aep_resampler, chunk, &earref);
+        meego_capture_tap_write(u->taps[VOICE_TAP_EAR_REF], &earref);
+        voice_stream_export_write(u, VOICE_STREAM_EXPORT_EAR_REF, &earref);
         voice_aep_ear_ref_dl(u, &earref);
         pa_memblock_unref(earref.memblock);
     }
 
-#ifdef SINK_TIMING_DEBUG_ON
-    pa_rtclock_get(&tv_new);
-    pa_usec_t process_delay = pa_timeval_diff(&tv_last, &tv_new);
-    printf("%d,%d ", (int)ched_period, (int)process_delay);
-    /*
-      pa_usec_t latency;
-      PA_MSGOBJECT(u->master_sink)->process_msg(PA_MSGOBJECT(u->master_sink), PA_SINK_MESSAGE_GET_LATENCY, &latency, 0, NULL);
-      printf("%lld ", latency);
-    */
-#endif
+    meego_trace_end("voice-dl");
 
     return 0;
 }
@@ -336,13 +319,7 @@ static int hw_sink_input_pop_8k_mono_cb(pa_sink_input *i, size_t length, pa_memc
     pa_assert_se(u = i->userdata);
     pa_assert(chunk);
 
-#ifdef SINK_TIMING_DEBUG_ON
-    static struct timeval tv_last = { 0, 0 };
-    struct timeval tv_new;
-    pa_rtclock_get(&tv_new);
-    pa_usec_t ched_period = pa_timeval_diff(&tv_last, &tv_new);
-    tv_last = tv_new;
-#endif
+    meego_trace_begin("voice-dl");
 
     pa_volume_t aep_volume = PA_VOLUME_NORM;
     if (u->aep_sink_input && PA_SINK_INPUT_IS_LINKED(
@@ -408,26 +385,13 @@ static int hw_sink_input_pop_8k_mono_cb(pa_sink_input *i, size_t length, pa_memc
                                 length);
     }
 
-    /* FIXME: voice_voip_source_active_iothread() should only be called from
-     * the source's main thread. The solution will possibly be copying the
-     * source state in some appropriate place to a variable that can be safely
-     * accessed from the sink's IO thread. The fact that we run the IO threads
-     * with FIFO scheduling should remove any synchronization issues between
-     * two IO threads, though, but this is still wrong in principle. */
-    /* FIXME: We should have a local atomic indicator to follow source side activity */
-    if (voice_voip_source_active_iothread(u))
+    if (voice_voip_source_running_sinkthread(u)) {
+        meego_capture_tap_write(u->taps[VOICE_TAP_EAR_REF], chunk);
+        voice_stream_export_write(u, VOICE_STREAM_EXPORT_EAR_REF, chunk);
         voice_aep_ear_ref_dl(u, chunk);
+    }
 
-#ifdef SINK_TIMING_DEBUG_ON
-    pa_rtclock_get(&tv_new);
-    pa_usec_t process_delay = pa_timeval_diff(&tv_last, &tv_new);
-    printf("%d,%d ", (int)ched_period, (int)process_delay);
-    /*
-      pa_usec_t latency;
-      PA_MSGOBJECT(u->master_sink)->process_msg(PA_MSGOBJECT(u->master_sink), PA_SINK_MESSAGE_GET_LATENCY, &latency, 0, NULL);
-      printf("%lld ", latency);
-    */
-#endif
+    meego_trace_end("voice-dl");
     return 0;
 }
 
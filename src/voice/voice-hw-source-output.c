@@ -36,6 +36,8 @@
 #include "optimized.h"
 #include "voice-convert.h"
 #include "memory.h"
+#include "rt-log.h"
+#include "trace.h"
 
 #include "module-voice-api.h"
 #include "voice-hooks.h"
@@ -45,12 +47,18 @@ static bool voice_uplink_feed(struct userdata *u, pa_memchunk *chunk) {
     pa_assert(u);
     pa_assert(u->aep_fragment_size == chunk->length);
 
+    meego_capture_tap_write(u->taps[VOICE_TAP_AEP_OUT], chunk);
+    voice_stream_export_write(u, VOICE_STREAM_EXPORT_UL, chunk);
+
     if (pa_memblockq_push(u->ul_memblockq, chunk) < 0) {
+        meego_metrics_counter_inc(u->metric.memblockq_push_failures);
         pa_log("%s %d: Failed to push %zu byte chunk into memblockq (len %zu).",
                __FILE__, __LINE__, chunk->length,
                pa_memblockq_get_length(u->ul_memblockq));
     }
 
+    meego_trace_counter("voice-ul-queue", (int) pa_memblockq_get_length(u->ul_memblockq));
+
     if (util_memblockq_to_chunk(u->core->mempool, u->ul_memblockq, &ichunk, u->voice_ul_fragment_size)) {
         if (pa_memblockq_get_length(u->ul_memblockq) != 0)
             pa_log("%s %d: AEP processed UL left over %zu", __FILE__, __LINE__,
@@ -77,6 +85,7 @@ int voice_aep_ear_ref_check_ul_xrun(struct userdata *u) {
 
     if (overrun) {
         pa_log_debug("UL XRUN -> reset");
+        meego_metrics_counter_inc(u->metric.ul_xruns);
         pa_atomic_store(&r->loop_state, VOICE_EAR_REF_RESET);
         return 1;
     }
@@ -95,6 +104,7 @@ int voice_aep_ear_ref_ul(struct userdata *u, pa_memchunk *chunk) {
             case VOICE_EAR_REF_RUNNING: {
                 if (!voice_aep_ear_ref_check_ul_xrun(u)) {
                     voice_aep_ear_ref_ul_drain_asyncq(u, true);
+                    meego_trace_counter("voice-ear-ref-loop", (int) pa_memblockq_get_length(r->loop_memblockq));
                     if (util_memblockq_to_chunk(u->core->mempool, r->loop_memblockq, chunk, u->aep_fragment_size)) {
                         ret = 1;
                     }
@@ -108,6 +118,7 @@ int voice_aep_ear_ref_ul(struct userdata *u, pa_memchunk *chunk) {
             }
             break;
             case VOICE_EAR_REF_RESET: {
+                meego_metrics_counter_inc(u->metric.ear_ref_resets);
                 voice_aep_ear_ref_ul_drain_asyncq(u, false);
                 pa_memblockq_drop(r->loop_memblockq, pa_memblockq_get_length(r->loop_memblockq));
                 pa_atomic_store(&r->loop_state, VOICE_EAR_REF_UL_READY);
@@ -169,6 +180,7 @@ int voice_aep_ear_ref_ul(struct userdata *u, pa_memchunk *chunk) {
                     loop_padding_bytes);
 
             if (pa_memblockq_push(r->loop_memblockq, &schunk) < 0) {
+                meego_metrics_counter_inc(u->metric.memblockq_push_failures);
             pa_log_debug("Failed to push %zu bytes of ear ref padding to memblockq (len %zu max %zu)",
                      loop_padding_bytes,
                      pa_memblockq_get_length(r->loop_memblockq),
@@ -241,32 +253,37 @@ void voice_uplink_timing_check(struct userdata *u, pa_usec_t now,
         pa_usec_t forward_usecs = (pa_usec_t)
             ((((u->ul_timing_advance-to_deadline)/VOICE_PERIOD_CMT_USECS)+1)*VOICE_PERIOD_CMT_USECS);
 
-        pa_log_debug("Deadline already missed by %" PRId64 " usec (%" PRId64 " < %" PRIu64 " + %d) forwarding %" PRIu64 " usecs",
-                     -to_deadline + u->ul_timing_advance, u->ul_deadline, now,
-                     u->ul_timing_advance, forward_usecs);
+        meego_metrics_counter_inc(u->metric.ul_deadline_misses);
+
+        meego_rt_log_debug("Deadline already missed by %" PRId64 " usec (%" PRId64 " < %" PRIu64 " + %d) forwarding %" PRIu64 " usecs",
+                           -to_deadline + u->ul_timing_advance, u->ul_deadline, now,
+                           u->ul_timing_advance, forward_usecs);
         u->ul_deadline += forward_usecs;
         to_deadline = u->ul_deadline - now;
-        pa_log_debug("New deadline %" PRId64, u->ul_deadline);
+        meego_rt_log_debug("New deadline %" PRId64, u->ul_deadline);
     }
+    else
+        meego_metrics_histogram_record(u->metric.ul_deadline_headroom,
+                                       (unsigned) (to_deadline - u->ul_timing_advance));
 
-    pa_log_debug("Time to next deadline %" PRId64 " usecs (%d)", to_deadline, u->ul_timing_advance);
+    meego_rt_log_debug("Time to next deadline %" PRId64 " usecs (%d)", to_deadline, u->ul_timing_advance);
     if ((int)to_deadline < VOICE_PERIOD_MASTER_USECS + u->ul_timing_advance) {
         if (!ul_frame_sent) {
             // Flush all that we have from buffers, so we should be in time on next round
             size_t drop = pa_memblockq_get_length(u->ul_memblockq);
             pa_memblockq_drop(u->ul_memblockq, drop);
-            pa_log_debug("Dropped %zu bytes (%" PRIu64 " usec) from ul_memblockq", drop,
-                         pa_bytes_to_usec_round_up((uint64_t)drop, &u->aep_sample_spec));
+            meego_rt_log_debug("Dropped %zu bytes (%" PRIu64 " usec) from ul_memblockq", drop,
+                               pa_bytes_to_usec_round_up((uint64_t)drop, &u->aep_sample_spec));
             drop = pa_memblockq_get_length(u->hw_source_memblockq);
             pa_memblockq_drop(u->hw_source_memblockq, drop);
-            pa_log_debug("Dropped %zu bytes (%" PRIu64 " usec) from hw_source_memblockq", drop,
-                         pa_bytes_to_usec_round_up((uint64_t)drop, &u->hw_source_output->thread_info.sample_spec));
+            meego_rt_log_debug("Dropped %zu bytes (%" PRIu64 " usec) from hw_source_memblockq", drop,
+                               pa_bytes_to_usec_round_up((uint64_t)drop, &u->hw_source_output->thread_info.sample_spec));
             voice_aep_ear_ref_ul_drop_log(u, pa_bytes_to_usec_round_up(
                                               (uint64_t)drop, &u->hw_source_output->thread_info.sample_spec));
         }
         else {
-            pa_log_debug("Timing is correct: Frame sent at %" PRIu64 " and deadline at %" PRId64,
-                         now, u->ul_deadline);
+            meego_rt_log_debug("Timing is correct: Frame sent at %" PRIu64 " and deadline at %" PRId64,
+                               now, u->ul_deadline);
         }
         u->ul_deadline = 0;
     }
@@ -285,21 +302,20 @@ static void hw_source_output_push_cb(pa_source_output *o, const pa_memchunk *new
     pa_assert(o);
     pa_assert_se(u = o->userdata);
 
-#ifdef SOURCE_TIMING_DEBUG_ON
-    static struct timeval tv_last = { 0, 0 };
-    struct timeval tv_new;
-    pa_rtclock_get(&tv_new);
-    pa_usec_t ched_period = pa_timeval_diff(&tv_last, &tv_new);
-    tv_last = tv_new;
-#endif
+    meego_trace_begin("voice-ul");
 
     if (pa_memblockq_push(u->hw_source_memblockq, new_chunk) < 0) {
+        meego_metrics_counter_inc(u->metric.memblockq_push_failures);
         pa_log("Failed to push %zu byte chunk into memblockq (len %zu).",
                new_chunk->length, pa_memblockq_get_length(u->hw_source_memblockq));
+        meego_trace_end("voice-ul");
         return;
     }
 
+    meego_trace_counter("voice-ul-hw-queue", (int) pa_memblockq_get_length(u->hw_source_memblockq));
+
     while (util_memblockq_to_chunk(u->core->mempool, u->hw_source_memblockq, &chunk, u->aep_hw_fragment_size)) {
+        meego_capture_tap_write(u->taps[VOICE_TAP_MIC_RAW], &chunk);
 
         if (voice_voip_source_active_iothread(u)) {
             /* This branch is taken when call is active */
@@ -346,6 +362,7 @@ static void hw_source_output_push_cb(pa_source_output *o, const pa_memchunk *new
             hook_data.channel[0] = mic_chunk8k;
             meego_algorithm_hook_fire(u->hooks[HOOK_NARROWBAND_MIC_EQ_MONO], &hook_data);
             mic_chunk8k = hook_data.channel[0];
+            meego_capture_tap_write(u->taps[VOICE_TAP_MIC_8K], &mic_chunk8k);
 
             if (amb_chunk.memblock) {
                 voice_convert_run_48_to_8(u, u->hw_source_to_aep_amb_resampler, &amb_chunk, &amb_chunk8k);
@@ -400,11 +417,7 @@ static void hw_source_output_push_cb(pa_source_output *o, const pa_memchunk *new
     if (u->ul_deadline)
         voice_uplink_timing_check(u, now, ul_frame_sent);
 
-#ifdef SOURCE_TIMING_DEBUG_ON
-    pa_rtclock_get(&tv_new);
-    pa_usec_t process_delay = pa_timeval_diff(&tv_last, &tv_new);
-    printf("%d,%d ", (int)ched_period, (int)process_delay);
-#endif
+    meego_trace_end("voice-ul");
 }
 
 /* Called from I/O thread context */
@@ -417,22 +430,22 @@ static void hw_source_output_push_cb_8k_mono(pa_source_output *o, const pa_memch
     pa_assert(o);
     pa_assert_se(u = o->userdata);
 
-#ifdef SOURCE_TIMING_DEBUG_ON
-    static struct timeval tv_last = { 0, 0 };
-    struct timeval tv_new;
-    pa_rtclock_get(&tv_new);
-    pa_usec_t ched_period = pa_timeval_diff(&tv_last, &tv_new);
-    tv_last = tv_new;
-#endif
+    meego_trace_begin("voice-ul");
 
     if (pa_memblockq_push(u->hw_source_memblockq, new_chunk) < 0) {
+        meego_metrics_counter_inc(u->metric.memblockq_push_failures);
         pa_log("Failed to push %zu byte chunk into memblockq (len %zu).",
                new_chunk->length, pa_memblockq_get_length(u->hw_source_memblockq));
+        meego_trace_end("voice-ul");
         return;
     }
 
+    meego_trace_counter("voice-ul-hw-queue", (int) pa_memblockq_get_length(u->hw_source_memblockq));
+
     /* Assume 8kHz mono */
     while (util_memblockq_to_chunk(u->core->mempool, u->hw_source_memblockq, &chunk, u->aep_fragment_size)) {
+        meego_capture_tap_write(u->taps[VOICE_TAP_MIC_8K], &chunk);
+
         if (voice_voip_source_active_iothread(u)) {
             ul_frame_sent = voice_voip_source_process(u, &chunk, NULL);
         }
@@ -450,11 +463,7 @@ static void hw_source_output_push_cb_8k_mono(pa_source_output *o, const pa_memch
     if (u->ul_deadline)
         voice_uplink_timing_check(u, now, ul_frame_sent);
 
-#ifdef SOURCE_TIMING_DEBUG_ON
-    pa_rtclock_get(&tv_new);
-    pa_usec_t process_delay = pa_timeval_diff(&tv_last, &tv_new);
-    printf("%d,%d ", (int)ched_period, (int)process_delay);
-#endif
+    meego_trace_end("voice-ul");
 }
 
 /* Called from I/O thread context */
@@ -23,7 +23,7 @@
 #include <config.h>
 #endif
 
-#include <errno.h>
+#include <pulse/rtclock.h>
 #include <pulsecore/namereg.h>
 
 #include "module-voice-userdata.h"
@@ -33,6 +33,7 @@
 #include "proplist-meego.h"
 #include "proplist-nemo.h"
 #include "voice-mainloop-handler.h"
+#include "voice-dbus.h"
 
 #include "voice-voip-source.h"
 #include "voice-voip-sink.h"
@@ -102,9 +103,12 @@ void voice_clear_up(struct userdata *u) {
         u->ul_memblockq = NULL;
     }
 
-    if (u->dl_sideinfo_queue) {
-        pa_queue_free(u->dl_sideinfo_queue, NULL);
-        u->dl_sideinfo_queue = NULL;
+    if (u->dl_sideinfo_ring) {
+        pa_log_debug("Side info ring overflows %d underflows %d",
+                     pa_atomic_load(&u->dl_sideinfo_ring->overflows),
+                     pa_atomic_load(&u->dl_sideinfo_ring->underflows));
+        pa_xfree(u->dl_sideinfo_ring);
+        u->dl_sideinfo_ring = NULL;
     }
 
     voice_aep_ear_ref_unload(u);
@@ -120,7 +124,7 @@ void voice_clear_up(struct userdata *u) {
     }
 
     if (u->sink_subscription) {
-        pa_subscription_free(u->sink_subscription);
+        pa_subscription_dispatcher_slot_free(u->sink_subscription);
         u->sink_subscription = NULL;
     }
 
@@ -135,12 +139,63 @@ void voice_clear_up(struct userdata *u) {
     }
 
     if (u->source_change_subscription) {
-        pa_subscription_free(u->source_change_subscription);
+        pa_subscription_dispatcher_slot_free(u->source_change_subscription);
         u->source_change_subscription = NULL;
     }
 
+    if (u->subscription_dispatcher) {
+        pa_subscription_dispatcher_unref(u->subscription_dispatcher);
+        u->subscription_dispatcher = NULL;
+    }
+
     voice_convert_free(u);
     voice_memchunk_pool_unload(u);
+
+    voice_capture_done(u);
+    voice_dbus_done(u);
+    voice_stream_export_done(u);
+
+    if (u->metrics) {
+        meego_metrics_unref(u->metrics);
+        u->metrics = NULL;
+    }
+
+    if (u->rt_log_attached) {
+        meego_rt_log_detach();
+        u->rt_log_attached = false;
+    }
+}
+
+#define DEFAULT_METRICS_INTERVAL_SEC (60)
+
+int voice_metrics_init(struct userdata *u, pa_modargs *ma) {
+    const char *path;
+    uint32_t interval = DEFAULT_METRICS_INTERVAL_SEC;
+
+    pa_assert(u);
+    pa_assert(ma);
+
+    u->metrics = meego_metrics_get(u->core);
+    u->metric.ul_xruns = meego_metrics_counter_get(u->metrics, "voice.ul_xruns");
+    u->metric.dl_xruns = meego_metrics_counter_get(u->metrics, "voice.dl_xruns");
+    u->metric.ear_ref_resets = meego_metrics_counter_get(u->metrics, "voice.ear_ref_resets");
+    u->metric.ear_ref_push_failures = meego_metrics_counter_get(u->metrics, "voice.ear_ref_push_failures");
+    u->metric.ul_deadline_misses = meego_metrics_counter_get(u->metrics, "voice.ul_deadline_misses");
+    u->metric.memchunk_pool_empty = meego_metrics_counter_get(u->metrics, "voice.memchunk_pool_empty");
+    u->metric.memblockq_push_failures = meego_metrics_counter_get(u->metrics, "voice.memblockq_push_failures");
+    u->metric.ul_deadline_headroom = meego_metrics_histogram_get(u->metrics, "voice.ul_deadline_headroom_usec");
+
+    if (!(path = pa_modargs_get_value(ma, "metrics_file", NULL)))
+        return 0;
+
+    if (pa_modargs_get_value_u32(ma, "metrics_interval", &interval) < 0 || interval == 0) {
+        pa_log("Bad value for metrics_interval");
+        return -1;
+    }
+
+    meego_metrics_export_file(u->metrics, path, interval * PA_USEC_PER_SEC);
+
+    return 0;
 }
 
 static voice_memchunk_pool *voice_memchunk_pool_table = NULL;
@@ -454,43 +509,95 @@ size_t voice_convert_nbytes(size_t nbytes, const pa_sample_spec *from_ss, const
     return frames * pa_frame_size(to_ss);
 }
 
-#ifdef EXTRA_DEBUG
-/* This code is not finished and probably dont work. */
-
-struct file_table_entry {
-    const char *name;
-    FILE *file;
-};
+void voice_capture_init(struct userdata *u) {
+    pa_assert(u);
 
-#define FILE_TABLE_SIZE 16
-static const int file_table_size = FILE_TABLE_SIZE;
-static struct file_table_entry file_table[FILE_TABLE_SIZE] = { { NULL, NULL } };
+    u->capture = meego_capture_get(u->core);
+    u->taps[VOICE_TAP_MIC_RAW] = meego_capture_tap_new(u->capture, "voice-mic-raw", &u->hw_sample_spec);
+    u->taps[VOICE_TAP_MIC_8K] = meego_capture_tap_new(u->capture, "voice-mic-8k", &u->aep_sample_spec);
+    u->taps[VOICE_TAP_EAR_REF] = meego_capture_tap_new(u->capture, "voice-ear-ref", &u->aep_sample_spec);
+    u->taps[VOICE_TAP_AEP_OUT] = meego_capture_tap_new(u->capture, "voice-aep-out", &u->aep_sample_spec);
+    u->taps[VOICE_TAP_DL_IN] = meego_capture_tap_new(u->capture, "voice-dl-in", &u->aep_sample_spec);
+    u->taps[VOICE_TAP_DL_OUT] = meego_capture_tap_new(u->capture, "voice-dl-out", &u->hw_sample_spec);
+}
 
-void voice_append_chunk_to_file(struct userdata *u, const char *file_name, pa_memchunk *chunk) {
+void voice_capture_done(struct userdata *u) {
     int i;
-    FILE *file = NULL;
-    for (i = 0; i < file_table_size && file_table[i].name != NULL; i++) {
-        if (0 == strcmp(file_name, file_table[i].name)) {
-            file = file_table[i].file;
+
+    pa_assert(u);
+
+    for (i = 0; i < VOICE_TAP_MAX; i++) {
+        if (u->taps[i]) {
+            meego_capture_tap_free(u->taps[i]);
+            u->taps[i] = NULL;
         }
     }
 
-    if (i >= file_table_size) {
-        pa_log("Can't open new files, not writing to file \"%s\"", file_name);
-        return;
+    if (u->capture) {
+        meego_capture_unref(u->capture);
+        u->capture = NULL;
     }
+}
 
-    if (file == NULL) {
-        file = file_table[i].file = fopen(file_name, "w");
-        if (file == NULL) {
-            pa_log("Can't open file \"%s\": %s", file_name, strerror(errno));
-            return;
+#define VOICE_STREAM_EXPORT_RING_USEC (2 * PA_USEC_PER_SEC)
+
+int voice_stream_export_init(struct userdata *u, pa_modargs *ma) {
+    static const char * const names[VOICE_STREAM_EXPORT_MAX] = {
+        "voice-ul", "voice-dl", "voice-ear-ref"
+    };
+    bool enabled = false;
+    unsigned i;
+
+    pa_assert(u);
+    pa_assert(ma);
+
+    if (pa_modargs_get_value_boolean(ma, "stream_export", &enabled) < 0) {
+        pa_log("Bad value for stream_export");
+        return -1;
+    }
+
+    if (!enabled)
+        return 0;
+
+    /* Not fatal, consumers get fd -1 for streams that failed. */
+    for (i = 0; i < VOICE_STREAM_EXPORT_MAX; i++)
+        u->exports[i] = meego_stream_export_new(names[i], &u->aep_sample_spec, VOICE_STREAM_EXPORT_RING_USEC);
+
+    return 0;
+}
+
+void voice_stream_export_done(struct userdata *u) {
+    unsigned i;
+
+    pa_assert(u);
+
+    for (i = 0; i < VOICE_STREAM_EXPORT_MAX; i++) {
+        if (u->exports[i]) {
+            meego_stream_export_free(u->exports[i]);
+            u->exports[i] = NULL;
         }
     }
+}
+
+void voice_stream_export_get_info(struct userdata *u, unsigned stream, voice_stream_export_info *info) {
+    pa_assert(u);
+    pa_assert(info);
+
+    if (stream >= VOICE_STREAM_EXPORT_MAX || !u->exports[stream]) {
+        info->fd = -1;
+        info->size = 0;
+        return;
+    }
 
-    char *p = pa_memblock_acquire(chunk->memblock);
-    fwrite(p + chunk->index, 1, chunk->length, file);
-    pa_memblock_release(chunk->memblock);
+    info->fd = meego_stream_export_fd(u->exports[stream]);
+    info->size = meego_stream_export_size(u->exports[stream]);
 }
 
-#endif
+/* Called from IO thread. */
+void voice_stream_export_write(struct userdata *u, unsigned stream, const pa_memchunk *chunk) {
+    pa_assert(u);
+    pa_assert(stream < VOICE_STREAM_EXPORT_MAX);
+
+    if (u->exports[stream])
+        meego_stream_export_write(u->exports[stream], chunk, pa_rtclock_now());
+}
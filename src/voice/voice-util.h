@@ -67,6 +67,8 @@ void voice_memchunk_pool_free(struct userdata *u, pa_memchunk *chunk) {
 
 void voice_clear_up(struct userdata *u);
 
+int voice_metrics_init(struct userdata *u, pa_modargs *ma);
+
 int voice_source_set_state(pa_source *s, pa_source *other, pa_source_state_t state);
 
 int voice_sink_set_state(pa_sink *s, pa_sink *other, pa_sink_state_t state);
@@ -93,7 +95,12 @@ void voice_shutdown_aep(void);
 
 size_t voice_convert_nbytes(size_t nbytes, const pa_sample_spec *from_ss, const pa_sample_spec *to_ss) PA_GCC_PURE;
 
-// For debugging...
-void voice_append_chunk_to_file(struct userdata *u, const char *file_name, pa_memchunk *chunk);
+void voice_capture_init(struct userdata *u);
+void voice_capture_done(struct userdata *u);
+
+int voice_stream_export_init(struct userdata *u, pa_modargs *ma);
+void voice_stream_export_done(struct userdata *u);
+void voice_stream_export_get_info(struct userdata *u, unsigned stream, voice_stream_export_info *info);
+void voice_stream_export_write(struct userdata *u, unsigned stream, const pa_memchunk *chunk);
 
 #endif // voice_util_h
@@ -35,16 +35,27 @@ static int voip_sink_process_msg(pa_msgobject *o, int code, void *data, int64_t
 
     switch (code) {
 
-        case VOICE_SINK_GET_SIDE_INFO_QUEUE_PTR: {
+        case VOICE_SINK_GET_SIDE_INFO_QUEUE_PTR:
+            /* Clients built against the old API would push to the ring as
+             * if it was a pa_queue. */
+            pa_log_warn("Obsolete side info queue requested, use VOICE_SINK_GET_SIDE_INFO_RING_PTR");
+            *((void **) data) = NULL;
+            return -1;
+
+        case VOICE_SINK_GET_SIDE_INFO_RING_PTR: {
             /* TODO: Make sure there is only one client (or multiple queues) */
-            if (!u->dl_sideinfo_queue) {
-                pa_log_warn("Side info queue not set");
+            if (!u->dl_sideinfo_ring) {
+                pa_log_warn("Side info ring not set");
             }
-            *((pa_queue **) data) = u->dl_sideinfo_queue;
-            pa_log_debug("Side info queue (%p) passed to client", (void *) u->dl_sideinfo_queue);
+            *((voice_sideinfo_ring **) data) = u->dl_sideinfo_ring;
+            pa_log_debug("Side info ring (%p) passed to client", (void *) u->dl_sideinfo_ring);
             return 0;
         }
 
+        case VOICE_SINK_GET_STREAM_EXPORT:
+            voice_stream_export_get_info(u, (unsigned) offset, (voice_stream_export_info *) data);
+            return 0;
+
         case PA_SINK_MESSAGE_GET_LATENCY: {
             pa_usec_t usec = 0;
 
@@ -42,6 +42,10 @@ static int voip_source_process_msg(pa_msgobject *o, int code, void *data, int64_
             return 0;
         }
 
+        case VOICE_SOURCE_GET_STREAM_EXPORT:
+            voice_stream_export_get_info(u, (unsigned) offset, (voice_stream_export_info *) data);
+            return 0;
+
         case PA_SOURCE_MESSAGE_GET_LATENCY: {
             pa_usec_t usec = 0;
 
@@ -69,6 +73,9 @@ static int voip_source_set_state(pa_source *s, pa_source_state_t state) {
 
     ret = voice_source_set_state(s, u->raw_source, state);
 
+    if (ret >= 0)
+        pa_shared_data_set_integer(u->shared, VOICE_SHARED_VOIP_SOURCE_STATE, state);
+
     /* TODO: Check if we still need to fiddle with PROP_MIXER_TUNING_MODE */
     if (s->state != PA_SOURCE_RUNNING && state == PA_SOURCE_RUNNING) {
         meego_algorithm_hook_fire(u->hooks[HOOK_CALL_BEGIN], s);
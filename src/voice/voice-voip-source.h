@@ -24,6 +24,9 @@
 
 #include <pulsecore/source.h>
 
+/* Integer shared item holding voip source state, exported for the sink IO thread. */
+#define VOICE_SHARED_VOIP_SOURCE_STATE "x-nemo.voice.voip-source-state"
+
 static inline
 bool voice_voip_source_active(struct userdata *u) {
     return (u->voip_source && (u->voip_source->state == PA_SOURCE_RUNNING ||
@@ -35,6 +38,18 @@ bool voice_voip_source_active_iothread(struct userdata *u) {
     return (u->voip_source && (u->voip_source->thread_info.state == PA_SOURCE_RUNNING));
 }
 
+/* Called from sink I/O thread. Reads voip source state published from main thread. */
+static inline
+bool voice_voip_source_active_sinkthread(struct userdata *u) {
+    pa_source_state_t state = (pa_source_state_t) pa_shared_data_read_integer(u->shared, u->voip_source_state_slot);
+    return (state == PA_SOURCE_RUNNING || state == PA_SOURCE_IDLE);
+}
+
+static inline
+bool voice_voip_source_running_sinkthread(struct userdata *u) {
+    return (pa_shared_data_read_integer(u->shared, u->voip_source_state_slot) == PA_SOURCE_RUNNING);
+}
+
 int voice_init_voip_source(struct userdata *u, const char *name);
 
 #endif // voice_voip_source_h